@@ -0,0 +1,186 @@
+#include "HAL.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdarg>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/sysinfo.h>
+#include <sys/timerfd.h>
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+#endif
+
+// Handles are spaced so that the low 12 bits address bytes inside the object
+#define PTR32_HANDLE_BASE   0x10000000
+#define PTR32_OFFSET_BITS   12
+
+namespace HAL
+{
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+static std::mutex ptr32Lock;
+static std::vector<void*> ptr32Objects;
+static std::map<const void*, ptr32_t> ptr32Handles;
+// Released table entries, reused oldest first so that stale handles stay invalid for a while
+static std::deque<uint32_t> ptr32FreeIndices;
+
+// Release timer and wake-up event of a worker or the link thread
+struct Wakeup {
+    int     timerFd;
+    int     eventFd;
+};
+
+static Wakeup wakeups[HAL_WAKEUP_COUNT];
+static std::once_flag wakeupsCreated;
+
+static void createWakeups() {
+    for (Wakeup& wakeup : wakeups) {
+        wakeup.timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+        wakeup.eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    }
+}
+
+Time time() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+uint32_t freeHeap() {
+    struct sysinfo info;
+    if (sysinfo(&info) != 0) return 0;
+    return (uint32_t)std::min((uint64_t)info.freeram * info.mem_unit, (uint64_t)UINT32_MAX);
+}
+
+uint32_t maxAllocHeap() {
+    return freeHeap();
+}
+
+uint32_t cpuFreqMHz() {
+    static uint32_t freq = [] {
+        float mhz = 0;
+        FILE* file = fopen("/proc/cpuinfo", "r");
+        if (!file) return (uint32_t)0;
+        char line[256];
+        while (fgets(line, sizeof(line), file)) {
+            if (sscanf(line, "cpu MHz : %f", &mhz) == 1) break;
+        }
+        fclose(file);
+        return (uint32_t)mhz;
+    }();
+    return freq;
+}
+
+int8_t RSSI() {
+    return 0;
+}
+
+uint32_t cycleCount() {
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)__rdtsc();
+#else
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+#endif
+}
+
+// Steady clock is the monotonic clock of timerfd
+void waitUntil(uint8_t index, Time deadline, uint32_t spin_us) {
+    std::call_once(wakeupsCreated, createWakeups);
+    Wakeup& wakeup = wakeups[index];
+    uint64_t value;
+    const Time sleepUntil = (deadline > spin_us) ? deadline - spin_us : 0;
+    if (time() < sleepUntil) {
+        // Disarmed timer waits for a wake-up only
+        struct itimerspec spec = {};
+        if (deadline != UINT64_MAX) {
+            const auto expiry = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                startTime.time_since_epoch() + std::chrono::microseconds(sleepUntil)).count();
+            spec.it_value.tv_sec = expiry / 1000000000;
+            spec.it_value.tv_nsec = expiry % 1000000000;
+        }
+        timerfd_settime(wakeup.timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+        struct pollfd fds[2] = {
+            { .fd = wakeup.timerFd, .events = POLLIN, .revents = 0 },
+            { .fd = wakeup.eventFd, .events = POLLIN, .revents = 0 }
+        };
+        while (time() < sleepUntil) {
+            if (poll(fds, 2, -1) <= 0) continue;
+            if (fds[1].revents & POLLIN) {
+                if (read(wakeup.eventFd, &value, sizeof(value)) > 0) return;
+            }
+            if (fds[0].revents & POLLIN) {
+                if (read(wakeup.timerFd, &value, sizeof(value)) > 0) break;
+            }
+        }
+    }
+    while (time() < deadline) {
+        if (read(wakeup.eventFd, &value, sizeof(value)) > 0) return;
+    }
+}
+
+void wake(uint8_t index) {
+    std::call_once(wakeupsCreated, createWakeups);
+    const uint64_t value = 1;
+    if (write(wakeups[index].eventFd, &value, sizeof(value)) < 0) return;
+}
+
+void log(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+ptr32_t toPtr32(const void* pointer) {
+    if (!pointer) return 0;
+    std::lock_guard<std::mutex> guard(ptr32Lock);
+    auto it = ptr32Handles.find(pointer);
+    if (it != ptr32Handles.end()) return it->second;
+    uint32_t index;
+    if (ptr32FreeIndices.size()) {
+        index = ptr32FreeIndices.front();
+        ptr32FreeIndices.pop_front();
+        ptr32Objects[index] = (void*)pointer;
+    } else {
+        // Handle space is full
+        if (ptr32Objects.size() >= ((UINT32_MAX - PTR32_HANDLE_BASE) >> PTR32_OFFSET_BITS)) return 0;
+        index = ptr32Objects.size();
+        ptr32Objects.push_back((void*)pointer);
+    }
+    ptr32_t handle = PTR32_HANDLE_BASE + (index << PTR32_OFFSET_BITS);
+    ptr32Handles[pointer] = handle;
+    return handle;
+}
+
+void releasePtr32(const void* begin, size_t size) {
+    if (!begin) return;
+    std::lock_guard<std::mutex> guard(ptr32Lock);
+    auto it = ptr32Handles.lower_bound(begin);
+    while (it != ptr32Handles.end() && it->first < (const uint8_t*)begin + size) {
+        const uint32_t index = (it->second - PTR32_HANDLE_BASE) >> PTR32_OFFSET_BITS;
+        ptr32Objects[index] = nullptr;
+        ptr32FreeIndices.push_back(index);
+        it = ptr32Handles.erase(it);
+    }
+}
+
+void* fromPtr32(ptr32_t handle) {
+    if (handle < PTR32_HANDLE_BASE) return nullptr;
+    std::lock_guard<std::mutex> guard(ptr32Lock);
+    const uint32_t index = (handle - PTR32_HANDLE_BASE) >> PTR32_OFFSET_BITS;
+    const uint32_t offset = handle & ((1 << PTR32_OFFSET_BITS) - 1);
+    if (index >= ptr32Objects.size() || !ptr32Objects[index]) return nullptr;
+    return (uint8_t*)ptr32Objects[index] + offset;
+}
+
+bool isValidPtr32(ptr32_t handle) {
+    if (handle < PTR32_HANDLE_BASE) return false;
+    std::lock_guard<std::mutex> guard(ptr32Lock);
+    const uint32_t index = (handle - PTR32_HANDLE_BASE) >> PTR32_OFFSET_BITS;
+    return index < ptr32Objects.size() && ptr32Objects[index];
+}
+
+}
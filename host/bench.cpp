@@ -0,0 +1,43 @@
+#include "Common.h"
+#include "HAL.h"
+
+#include "Controller.h"
+#include "FunctionFactory.h"
+#include "Benchmark.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Engine benchmarks on the host. Results are written to stdout as JSON
+//   ctrl_bench [--max-blocks N] [--min-time-ms N]
+
+void printText(const char* text)
+{
+    fputs(text, stdout);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t maxBlockCount = 100000;
+    uint32_t minTime_ms = 200;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--max-blocks") == 0) maxBlockCount = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--min-time-ms") == 0) minTime_ms = atoi(argv[i + 1]);
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    Controller* controller = new Controller();
+    FunctionFactory* funcFactory = new FunctionFactory();
+
+    Benchmark benchmark(controller, funcFactory);
+    benchmark.minTime_us = minTime_ms * 1000;
+    benchmark.run(maxBlockCount);
+    benchmark.writeJSON(&printText);
+
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include "Common.h"
+#include "HAL.h"
+
+#include "Controller.h"
+#include "Link.h"
+#include "FunctionBlock.h"
+#include "Circuit.h"
+#include "CyclicTask.h"
+#include "FunctionLib.h"
+#include "FunctionFactory.h"
+
+#include <atomic>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+
+#define CONTROLLER_WORKER_COUNT 2
+
+// Link requests are handled in their own thread, at most the time budget per interval
+#define LINK_TIME_BUDGET_US     2000U
+#define LINK_INTERVAL_US        5000U
+
+
+Controller* controller;
+Link* commLink;
+FunctionFactory* funcFactory;
+
+std::atomic<bool> running { true };
+// Busy wait before each release in microseconds, set from the command line
+uint32_t spinTime_us = 0;
+std::atomic<size_t> sentBytes { 0 };
+
+// Host builds have no network connection. Link responses are counted
+void onSendData(const void* data, size_t len)
+{
+    sentBytes += len;
+}
+
+void onSendText(const char* text)
+{
+    HAL::log("%s\n", text);
+}
+
+// ***********************************************
+//    CTRL32 setup
+// ***********************************************
+
+void ControllerLoop(uint8_t worker) {
+    while (running) {
+        Time nextUpdateTime = controller->tick(worker);
+        HAL::waitUntil(worker, nextUpdateTime, spinTime_us);
+    }
+}
+
+void LinkLoop() {
+    while (running) {
+        bool pending = commLink->processData(LINK_TIME_BUDGET_US);
+        Time nextProcessTime = pending ? HAL::time() + LINK_INTERVAL_US : commLink->nextReportTime();
+        HAL::waitUntil(HAL_WAKEUP_LINK, nextProcessTime);
+    }
+}
+
+Circuit* createTestCircuit() {
+    Circuit *circ = new Circuit(4, 2);
+
+    FunctionBlock *funcADD = funcFactory->createFunction(LIB_ID_MATH_UINT, MathUintLib::FUNC_ID_ADD, 2);
+    FunctionBlock *funcDIV = funcFactory->createFunction(LIB_ID_MATH, MathLib::FUNC_ID_DIV);
+    FunctionBlock *funcSIN = funcFactory->createFunction(LIB_ID_MATH, MathLib::FUNC_ID_SIN);
+    FunctionBlock *funcMUL = funcFactory->createFunction(LIB_ID_MATH, MathLib::FUNC_ID_MUL);
+
+    funcADD->setInput(0, 1);
+    funcADD->connectInput(1, funcADD, 0);
+
+    funcDIV->connectInput(0, funcADD, 0);
+    funcDIV->setInput(1, 10.f);
+
+    funcSIN->connectInput(0, funcDIV, 0);
+
+    funcMUL->connectInput(0, funcSIN, 0);
+    funcMUL->setInput(1, 100.f);
+
+    circ->addFunction(funcADD);
+    circ->addFunction(funcDIV);
+    circ->addFunction(funcSIN);
+    circ->addFunction(funcMUL);
+
+    return circ;
+}
+
+// Request controller info through the link as a client would
+void requestControllerInfo() {
+    MsgRequestHeader_t request = {
+        .msgType    = MSG_TYPE_CONTROLLER_INFO,
+        .msgID      = 1,
+        .pointer    = 0
+    };
+    commLink->receiveData(&request, sizeof(request));
+    HAL::wake(HAL_WAKEUP_LINK);
+}
+
+void printProfile(FunctionBlock* func) {
+#ifdef CTRL_PROFILING
+    if (!func->profile) return;
+    printf("  %s: calls %u  min %u  avg %.0f  max %u cycles\n",
+        func->name(), func->profile->calls, func->profile->minCycles, func->profile->averageCycles(), func->profile->maxCycles);
+#endif
+}
+
+void printTaskInfo(CyclicTask* task) {
+    printf("Task %u ms: runs %u  avg CPU %.1f us  avg interval %.2f ms  drift %u us\n",
+        task->interval_ms, task->runCount, task->averageCPUTime(), task->averageActualInterval_ms(), task->drift_us);
+    printf("  jitter p99 %u us  max %u us  drift p99 %u us  CPU p99 %u us  deadline misses %u  skipped %u\n",
+        task->intervalJitter.percentile(0.99f), task->intervalJitter.maxValue, task->startDrift.percentile(0.99f),
+        task->cpuTime.percentile(0.99f), task->deadlineMisses, task->skippedCycles);
+    for (FunctionBlock* func : task->funcList) {
+        printProfile(func);
+        if (func->opcode == OPCODE_CIRCUIT) {
+            for (FunctionBlock* childFunc : ((Circuit*)func)->funcList) printProfile(childFunc);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const uint32_t runTime_s = (argc > 1) ? atoi(argv[1]) : 5;
+    spinTime_us = (argc > 2) ? atoi(argv[2]) : 0;
+
+    controller = new Controller(CONTROLLER_WORKER_COUNT);
+    commLink = new Link(controller, &onSendData, &onSendText);
+    funcFactory = new FunctionFactory();
+
+    CyclicTask* task10ms = new CyclicTask(controller, 10, 0);
+    controller->tasks.push_back(task10ms);
+    CyclicTask* task100ms = new CyclicTask(controller, 100, 5);
+    controller->tasks.push_back(task100ms);
+
+    controller->addFunction(createTestCircuit(), task10ms);
+    controller->addFunction(createTestCircuit(), task100ms);
+    task100ms->setWorker(CONTROLLER_WORKER_COUNT - 1);
+
+    task10ms->setProfiling(true);
+
+    task10ms->start();
+    task100ms->start();
+
+    commLink->connected();
+
+    printf("Running %u controller workers for %u s\n", CONTROLLER_WORKER_COUNT, runTime_s);
+    std::thread workers[CONTROLLER_WORKER_COUNT];
+    for (uint8_t worker = 0; worker < CONTROLLER_WORKER_COUNT; worker++) {
+        workers[worker] = std::thread(ControllerLoop, worker);
+    }
+    std::thread linkThread(LinkLoop);
+
+    for (uint32_t s = 0; s < runTime_s; s++) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        requestControllerInfo();
+    }
+    running = false;
+    for (uint8_t worker = 0; worker < CONTROLLER_WORKER_COUNT; worker++) HAL::wake(worker);
+    HAL::wake(HAL_WAKEUP_LINK);
+    for (std::thread& worker : workers) worker.join();
+    linkThread.join();
+
+    for (CyclicTask* task : controller->tasks) printTaskInfo(task);
+    printf("Controller ticks %u  link sent %zu bytes\n", controller->tickCount, sentBytes.load());
+
+    return 0;
+}
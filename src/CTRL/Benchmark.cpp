@@ -0,0 +1,326 @@
+#include "Benchmark.h"
+#include "Controller.h"
+#include "Circuit.h"
+#include "CyclicTask.h"
+#include "InstancedCircuit.h"
+#include "Link.h"
+#include "FunctionFactory.h"
+#include "SimdReduce.h"
+#include "HAL.h"
+#ifndef ARDUINO
+#include "ParallelExecutor.h"
+#endif
+#include <stdio.h>
+
+#define BENCH_FAN_IN_WIDTH      64
+#define BENCH_FAN_IN_INPUTS     8
+#define BENCH_LINK_REQUESTS     1024
+#define BENCH_MONITORING_BATCH  64
+#define BENCH_INSTANCES         10
+
+static uint32_t linkSentBytes = 0;
+static uint32_t linkAcceptedResponses = 0;
+static void discardData(const void* data, size_t len) {
+    linkSentBytes += len;
+    if (len >= sizeof(MsgResponseHeader_t) && ((const MsgResponseHeader_t*)data)->result != REQUEST_FAILED) linkAcceptedResponses++;
+}
+static void discardText(const char* text) {}
+
+Benchmark::Benchmark(Controller* controller, FunctionFactory* factory) :
+    controller (controller),
+    factory (factory)
+{}
+
+const char* Benchmark::programName(BENCH_PROGRAM program) {
+    switch (program) {
+        case BENCH_PROGRAM_CHAIN:       return "chain";
+        case BENCH_PROGRAM_FAN_IN:      return "fan_in";
+        case BENCH_PROGRAM_RANDOM_DAG:  return "random_dag";
+        default:                        return "unknown";
+    }
+}
+
+// Same programs on every platform
+uint32_t Benchmark::random() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+std::vector<FunctionBlock*> Benchmark::generate(BENCH_PROGRAM program, uint32_t blockCount) {
+    std::vector<FunctionBlock*> funcs;
+    funcs.reserve(blockCount);
+    seed = 1;
+
+    switch (program) {
+        case BENCH_PROGRAM_CHAIN: {
+            for (uint32_t i = 0; i < blockCount; i++) {
+                FunctionBlock* func = factory->createFunction(LIB_ID_MATH, MathLib::FUNC_ID_ADD, 2);
+                if (i > 0) func->connectInput(0, funcs[i - 1], 0);
+                func->setInput(1, 1.0f);
+                funcs.push_back(func);
+            }
+            break;
+        }
+        case BENCH_PROGRAM_FAN_IN: {
+            for (uint32_t i = 0; i < blockCount; i++) {
+                FunctionBlock* func = factory->createFunction(LIB_ID_MATH, MathLib::FUNC_ID_ADD, BENCH_FAN_IN_INPUTS);
+                const uint32_t layerBegin = i - i % BENCH_FAN_IN_WIDTH;
+                for (uint8_t k = 0; k < BENCH_FAN_IN_INPUTS; k++) {
+                    if (layerBegin == 0) func->setInput(k, 1.0f);
+                    else func->connectInput(k, funcs[layerBegin - BENCH_FAN_IN_WIDTH + random() % BENCH_FAN_IN_WIDTH], 0);
+                }
+                funcs.push_back(func);
+            }
+            break;
+        }
+        case BENCH_PROGRAM_RANDOM_DAG: {
+            static const uint8_t mathFuncs[] = { MathLib::FUNC_ID_ADD, MathLib::FUNC_ID_SUB, MathLib::FUNC_ID_MUL, MathLib::FUNC_ID_ABS };
+            static const uint8_t logicFuncs[] = { LogicLib::FUNC_ID_AND, LogicLib::FUNC_ID_OR, LogicLib::FUNC_ID_XOR, LogicLib::FUNC_ID_NOT };
+            // Functions read earlier functions of the same value type
+            std::vector<FunctionBlock*> mathProducers;
+            std::vector<FunctionBlock*> logicProducers;
+            for (uint32_t i = 0; i < blockCount; i++) {
+                const bool isLogic = random() & 1;
+                std::vector<FunctionBlock*>& producers = isLogic ? logicProducers : mathProducers;
+                FunctionBlock* func = isLogic
+                    ? factory->createFunction(LIB_ID_LOGIC, logicFuncs[random() % 4], 2 + random() % 3)
+                    : factory->createFunction(LIB_ID_MATH, mathFuncs[random() % 4], 2);
+                for (uint8_t k = 0; k < func->numInputs; k++) {
+                    if (producers.size() && random() % 4) {
+                        func->connectInput(k, producers[random() % producers.size()], 0, isLogic && random() % 4 == 0);
+                    }
+                    else if (isLogic) func->setInput(k, (uint32_t)1);
+                    else func->setInput(k, 1.0f);
+                }
+                producers.push_back(func);
+                funcs.push_back(func);
+            }
+            break;
+        }
+        default: break;
+    }
+    return funcs;
+}
+
+template<typename F>
+void Benchmark::measure(const char* name, BENCH_PROGRAM program, uint32_t blockCount, uint32_t itemsPerCall, F&& func) {
+    // Warm up caches and compile plans
+    func();
+    uint32_t iterations = 0;
+    uint32_t batch = 1;
+    const Time start = HAL::time();
+    Time elapsed = 0;
+    while (elapsed < minTime_us) {
+        for (uint32_t i = 0; i < batch; i++) func();
+        iterations += batch;
+        if (batch < 1024) batch *= 2;
+        elapsed = HAL::time() - start;
+    }
+    results.push_back({
+        .name       = name,
+        .program    = program,
+        .blockCount = blockCount,
+        .iterations = iterations,
+        .nsPerItem  = (float)(elapsed * 1000.0 / ((double)iterations * itemsPerCall))
+    });
+}
+
+// Individual function updates in program order
+void Benchmark::benchFunctions(BENCH_PROGRAM program, uint32_t blockCount) {
+    std::vector<FunctionBlock*> funcs = generate(program, blockCount);
+    for (FunctionBlock* func : funcs) func->bindInputs();
+
+    measure("function_update", program, blockCount, blockCount, [&] {
+        for (FunctionBlock* func : funcs) func->update(1);
+    });
+
+    IOValue values[UINT8_MAX];
+    measure("read_input_values", program, blockCount, blockCount, [&] {
+        for (FunctionBlock* func : funcs) func->readInputValues(values);
+    });
+
+    for (FunctionBlock* func : funcs) delete func;
+}
+
+// Change-driven rows run with constant inputs, so only the first cycle evaluates functions.
+// Packed rows pack logic functions of the random program only
+void Benchmark::benchCircuit(BENCH_PROGRAM program, uint32_t blockCount) {
+    static const struct { const char* name; EVALUATION_MODE mode; } modes[] = {
+        { "circuit_run",                EVAL_MODE_CYCLIC },
+        { "circuit_run_change_driven",  EVAL_MODE_CHANGE_DRIVEN },
+        { "circuit_run_packed",         EVAL_MODE_PACKED_LOGIC }
+    };
+    Circuit* circuit = new Circuit(1, 1);
+    for (FunctionBlock* func : generate(program, blockCount)) circuit->addFunction(func);
+
+    for (const auto& mode : modes) {
+        circuit->plan.setMode(mode.mode);
+        circuit->compile();
+        measure(mode.name, program, blockCount, blockCount, [&] {
+            circuit->update(1);
+        });
+    }
+
+    delete circuit;
+}
+
+#ifndef ARDUINO
+void Benchmark::benchParallel(BENCH_PROGRAM program, uint32_t blockCount) {
+    Circuit* circuit = new Circuit(1, 1);
+    for (FunctionBlock* func : generate(program, blockCount)) circuit->addFunction(func);
+    ParallelExecutor executor;
+
+    measure("circuit_run_parallel", program, blockCount, blockCount, [&] {
+        executor.run(circuit, 1);
+    });
+
+    delete circuit;
+}
+#endif
+
+// Instances of one definition against the same number of separate circuits. Definitions hold a
+// tenth of the blocks, so both run blockCount functions per cycle
+void Benchmark::benchInstanced(BENCH_PROGRAM program, uint32_t blockCount) {
+    const uint32_t definitionBlocks = blockCount / BENCH_INSTANCES;
+    Circuit* definition = new Circuit(1, 1);
+    for (FunctionBlock* func : generate(program, definitionBlocks)) definition->addFunction(func);
+    InstancedCircuit* instanced = new InstancedCircuit(definition, BENCH_INSTANCES);
+    if (instanced->compile()) {
+        measure("instanced_run", program, blockCount, blockCount, [&] {
+            instanced->run(1);
+        });
+    }
+    delete instanced;
+    delete definition;
+
+    std::vector<Circuit*> circuits;
+    for (uint32_t n = 0; n < BENCH_INSTANCES; n++) {
+        Circuit* circuit = new Circuit(1, 1);
+        for (FunctionBlock* func : generate(program, definitionBlocks)) circuit->addFunction(func);
+        circuit->compile();
+        circuits.push_back(circuit);
+    }
+    measure("instance_circuits_run", program, blockCount, blockCount, [&] {
+        for (Circuit* circuit : circuits) circuit->update(1);
+    });
+    for (Circuit* circuit : circuits) delete circuit;
+}
+
+void Benchmark::benchTask(BENCH_PROGRAM program, uint32_t blockCount) {
+    // Arena packing relocates references of controller tasks
+    CyclicTask* task = new CyclicTask(controller, 10);
+    controller->tasks.push_back(task);
+    std::vector<FunctionBlock*> funcs = generate(program, blockCount);
+    for (FunctionBlock* func : funcs) task->addFunction(func);
+
+    measure("task_update", program, blockCount, blockCount, [&] {
+        task->update();
+    });
+
+    controller->tasks.pop_back();
+    for (FunctionBlock* func : funcs) delete func;
+    delete task;
+}
+
+// Rejected requests take a shorter path than served ones, so link rows are measured only if every request is answered
+template<typename Request>
+bool Benchmark::acceptsAll(Link& link, std::vector<Request>& requests, const char* name) {
+    linkAcceptedResponses = 0;
+    for (Request& request : requests) link.handleRequest(&request, sizeof(request));
+    if (linkAcceptedResponses == requests.size()) return true;
+    HAL::log("Benchmark %s skipped, %u of %u requests rejected\n", name, (uint32_t)(requests.size() - linkAcceptedResponses), (uint32_t)requests.size());
+    return false;
+}
+
+// Memory read request with its parameters
+struct MemReadRequest {
+    MsgRequestHeader_t  header;
+    MsgMemRead_t        params;
+};
+
+void Benchmark::benchLink(BENCH_PROGRAM program, uint32_t blockCount) {
+    Link link(controller, &discardData, &discardText);
+    link.connected();
+
+    std::vector<FunctionBlock*> funcs = generate(program, blockCount);
+    for (FunctionBlock* func : funcs) {
+        func->bindInputs();
+        func->enableMonitoring();
+        func->update(1);
+    }
+
+    // Info and memory requests of the first functions
+    const uint32_t requestCount = std::min(blockCount, (uint32_t)BENCH_LINK_REQUESTS);
+    std::vector<MsgRequest_t> infoRequests(requestCount);
+    std::vector<MemReadRequest> memRequests(requestCount);
+    for (uint32_t i = 0; i < requestCount; i++) {
+        FunctionBlock* func = funcs[i];
+        infoRequests[i] = {
+            .header  = { .msgType = MSG_TYPE_FUNCTION_INFO, .msgID = i, .pointer = HAL::toPtr32(func) },
+            .payload = 0
+        };
+        memRequests[i] = {
+            .header  = { .msgType = MSG_TYPE_GET_MEM_DATA, .msgID = i, .pointer = HAL::toPtr32(func->ioValues) },
+            .params  = { .ioRevision = IOArena::layoutRevision, .size = (uint32_t)(func->ioCount() * sizeof(IOValue)) }
+        };
+    }
+
+    if (acceptsAll(link, infoRequests, "link_function_info")) {
+        measure("link_function_info", program, blockCount, requestCount, [&] {
+            for (MsgRequest_t& request : infoRequests) link.handleRequest(&request, sizeof(request));
+        });
+    }
+
+    if (acceptsAll(link, memRequests, "link_get_mem_data")) {
+        measure("link_get_mem_data", program, blockCount, requestCount, [&] {
+            for (MemReadRequest& request : memRequests) link.handleRequest(&request, sizeof(request));
+        });
+    }
+
+    // Monitoring reports of batches of functions
+    measure("monitoring_report", program, blockCount, blockCount, [&] {
+        for (uint32_t first = 0; first < blockCount; first += BENCH_MONITORING_BATCH) {
+            const uint32_t last = std::min(first + BENCH_MONITORING_BATCH, blockCount);
+            link.monitoringCollectionStart(&link, last - first);
+            for (uint32_t i = first; i < last; i++) funcs[i]->reportMonitoringValues(&link);
+            link.monitoringCollectionSend();
+        }
+    });
+
+    for (FunctionBlock* func : funcs) delete func;
+}
+
+void Benchmark::run(uint32_t maxBlockCount) {
+    results.clear();
+    for (uint32_t blockCount = 10; blockCount <= maxBlockCount; blockCount *= 10) {
+        for (uint8_t p = 0; p < BENCH_PROGRAM_COUNT; p++) {
+            const BENCH_PROGRAM program = (BENCH_PROGRAM)p;
+            benchFunctions(program, blockCount);
+            benchCircuit(program, blockCount);
+#ifndef ARDUINO
+            benchParallel(program, blockCount);
+#endif
+            benchInstanced(program, blockCount);
+            benchTask(program, blockCount);
+            benchLink(program, blockCount);
+        }
+    }
+}
+
+void Benchmark::writeJSON(bench_output_callback_t output) {
+    char line[160];
+    snprintf(line, sizeof(line), "{\n  \"cpuFreqMHz\": %u,\n  \"simd\": \"%s\",\n  \"results\": [\n",
+        HAL::cpuFreqMHz(), SIMD_BACKEND_NAME);
+    output(line);
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchmarkResult& result = results[i];
+        snprintf(line, sizeof(line),
+            "    { \"name\": \"%s\", \"program\": \"%s\", \"blocks\": %u, \"iterations\": %u, \"nsPerItem\": %.2f }%s\n",
+            result.name, programName(result.program), result.blockCount, result.iterations, result.nsPerItem,
+            (i + 1 < results.size()) ? "," : "");
+        output(line);
+    }
+    output("  ]\n}\n");
+}
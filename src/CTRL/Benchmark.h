@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Common.h"
+#include "FunctionBlock.h"
+
+class Controller;
+class FunctionFactory;
+class Link;
+struct MsgRequest_t;
+
+enum BENCH_PROGRAM {
+    BENCH_PROGRAM_CHAIN,        // Each function reads the previous one
+    BENCH_PROGRAM_FAN_IN,       // Layers of 8 input functions reading the previous layer
+    BENCH_PROGRAM_RANDOM_DAG,   // Math and logic functions reading random earlier functions
+    BENCH_PROGRAM_COUNT
+};
+
+struct BenchmarkResult {
+    const char*     name;
+    BENCH_PROGRAM   program;
+    uint32_t        blockCount;
+    uint32_t        iterations;
+    float           nsPerItem;
+};
+
+typedef void (*bench_output_callback_t)(const char* text);
+
+// Synthetic program benchmarks of the engine. Runs on host builds and, with smaller programs, on target.
+// Results are written as JSON to compare builds
+class Benchmark
+{
+    Controller*         controller;
+    FunctionFactory*    factory;
+    uint32_t            seed = 1;
+
+    uint32_t random();
+    std::vector<FunctionBlock*> generate(BENCH_PROGRAM program, uint32_t blockCount);
+
+    // Repeat a measured function for at least minTime_us
+    template<typename F>
+    void measure(const char* name, BENCH_PROGRAM program, uint32_t blockCount, uint32_t itemsPerCall, F&& func);
+
+    void benchFunctions(BENCH_PROGRAM program, uint32_t blockCount);
+    void benchCircuit(BENCH_PROGRAM program, uint32_t blockCount);
+#ifndef ARDUINO
+    // Circuit levels run on all host cores
+    void benchParallel(BENCH_PROGRAM program, uint32_t blockCount);
+#endif
+    void benchInstanced(BENCH_PROGRAM program, uint32_t blockCount);
+    void benchTask(BENCH_PROGRAM program, uint32_t blockCount);
+    void benchLink(BENCH_PROGRAM program, uint32_t blockCount);
+    template<typename Request>
+    bool acceptsAll(Link& link, std::vector<Request>& requests, const char* name);
+
+public:
+    std::vector<BenchmarkResult> results;
+
+    // Measurement time of each benchmark
+    uint32_t minTime_us = 200000;
+
+    Benchmark(Controller* controller, FunctionFactory* factory);
+
+    // Run all benchmarks with program sizes from 10 blocks up to maxBlockCount in decades
+    void run(uint32_t maxBlockCount);
+
+    void writeJSON(bench_output_callback_t output);
+
+    static const char* programName(BENCH_PROGRAM program);
+};
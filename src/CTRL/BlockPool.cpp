@@ -0,0 +1,158 @@
+#include "BlockPool.h"
+#include <cstddef>
+
+// Small classes hold IO storage and input bindings, larger ones the blocks
+const uint16_t BlockPool::sizeClasses[BLOCK_POOL_SIZE_CLASSES] = { 16, 32, 48, 64, 96, 128, 192, 256 };
+
+// Oversized allocations are listed after the size classes
+#define SIZE_CLASS_OVERSIZED BLOCK_POOL_SIZE_CLASSES
+
+std::atomic<uint32_t> BlockPool::slabCount {0};
+std::atomic<uint32_t> BlockPool::slotCount {0};
+
+BlockPool::~BlockPool() {
+    std::lock_guard<std::mutex> guard(lock);
+    freeSlabs();
+}
+
+// Never destroyed, blocks may be deleted by static destructors
+BlockPool& BlockPool::shared() {
+    static BlockPool* pool = new BlockPool();
+    return *pool;
+}
+
+BlockPool& BlockPool::owner(const void* ptr) {
+    return *((SlotHeader*)ptr - 1)->slab->pool;
+}
+
+int BlockPool::sizeClassIndex(size_t size) {
+    for (size_t i = 0; i < BLOCK_POOL_SIZE_CLASSES; i++) {
+        if (size <= sizeClasses[i]) return i;
+    }
+    return -1;
+}
+
+// Slab header rounded up to keep slot alignment
+size_t BlockPool::headerSize() {
+    return (sizeof(Slab) + alignof(max_align_t) - 1) / alignof(max_align_t) * alignof(max_align_t);
+}
+
+// Slot size including header, rounded up to keep block alignment
+size_t BlockPool::slotSize(uint8_t sizeClass) {
+    const size_t align = alignof(max_align_t);
+    const size_t size = sizeof(SlotHeader) + sizeClasses[sizeClass];
+    return (size + align - 1) / align * align;
+}
+
+BlockPool::Slab* BlockPool::createSlab(uint8_t sizeClass, size_t size) {
+    const bool oversized = (sizeClass == SIZE_CLASS_OVERSIZED);
+    const size_t slot = oversized ? sizeof(SlotHeader) + size : slotSize(sizeClass);
+    const size_t slots = oversized ? 1 : BLOCK_POOL_SLAB_SLOTS;
+    if (ownSlabs >= maxSlabs) return nullptr;
+    uint8_t* memory = (uint8_t*)malloc(headerSize() + slot * slots);
+    if (memory == nullptr) return nullptr;
+
+    Slab* slab = (Slab*)memory;
+    slab->pool = this;
+    slab->used = 0;
+    slab->sizeClass = sizeClass;
+    slab->freeList = nullptr;
+    // Chain slots to free list in address order
+    for (int i = slots - 1; i >= 0; i--) {
+        SlotHeader* header = (SlotHeader*)(memory + headerSize() + i * slot);
+        header->slab = slab;
+        header->nextFree = slab->freeList;
+        slab->freeList = header;
+    }
+    linkSlab(slabs[sizeClass], slab);
+    freeSlots[sizeClass] += slots;
+    ownSlabs++;
+    slabCount++;
+    return slab;
+}
+
+void BlockPool::linkSlab(Slab*& first, Slab* slab) {
+    slab->prev = nullptr;
+    slab->next = first;
+    if (first) first->prev = slab;
+    first = slab;
+}
+
+void BlockPool::unlinkSlab(Slab*& first, Slab* slab) {
+    if (slab->prev) slab->prev->next = slab->next;
+    else first = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+}
+
+void BlockPool::freeSlabs() {
+    for (Slab** list : { slabs, fullSlabs }) {
+        for (size_t i = 0; i <= BLOCK_POOL_SIZE_CLASSES; i++) {
+            while (list[i]) {
+                Slab* slab = list[i];
+                list[i] = slab->next;
+                free(slab);
+            }
+            freeSlots[i] = 0;
+        }
+    }
+    slabCount -= ownSlabs;
+    slotCount -= ownSlots;
+    ownSlabs = 0;
+    ownSlots = 0;
+}
+
+void* BlockPool::allocate(size_t size) {
+    std::lock_guard<std::mutex> guard(lock);
+    int sizeClass = sizeClassIndex(size);
+    Slab* slab;
+    if (sizeClass < 0) {
+        slab = createSlab(SIZE_CLASS_OVERSIZED, size);
+    }
+    else {
+        slab = slabs[sizeClass];
+        if (slab == nullptr) slab = createSlab(sizeClass, size);
+    }
+    if (slab == nullptr) return nullptr;
+    SlotHeader* header = slab->freeList;
+    slab->freeList = header->nextFree;
+    slab->used++;
+    freeSlots[slab->sizeClass]--;
+    if (slab->freeList == nullptr) {
+        unlinkSlab(slabs[slab->sizeClass], slab);
+        linkSlab(fullSlabs[slab->sizeClass], slab);
+    }
+    ownSlots++;
+    slotCount++;
+    return header + 1;
+}
+
+void BlockPool::release(void* ptr) {
+    if (ptr == nullptr) return;
+    SlotHeader* header = (SlotHeader*)ptr - 1;
+    Slab* slab = header->slab;
+    BlockPool* pool = slab->pool;
+    std::lock_guard<std::mutex> guard(pool->lock);
+    // Slabs of a pool being cleared are freed together
+    if (pool->clearing) return;
+    const uint8_t sizeClass = slab->sizeClass;
+    if (slab->freeList == nullptr) {
+        unlinkSlab(pool->fullSlabs[sizeClass], slab);
+        linkSlab(pool->slabs[sizeClass], slab);
+    }
+    header->nextFree = slab->freeList;
+    slab->freeList = header;
+    slab->used--;
+    pool->freeSlots[sizeClass]++;
+    pool->ownSlots--;
+    slotCount--;
+    if (slab->used > 0) return;
+
+    // Return an empty slab to heap only if its size class has another slab with free slots
+    const uint32_t slots = (sizeClass == SIZE_CLASS_OVERSIZED) ? 1 : BLOCK_POOL_SLAB_SLOTS;
+    if (sizeClass != SIZE_CLASS_OVERSIZED && pool->freeSlots[sizeClass] == slots) return;
+    unlinkSlab(pool->slabs[sizeClass], slab);
+    pool->freeSlots[sizeClass] -= slots;
+    free(slab);
+    pool->ownSlabs--;
+    slabCount--;
+}
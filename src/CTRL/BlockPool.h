@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Common.h"
+#include <atomic>
+#include <mutex>
+
+#define BLOCK_POOL_SLAB_SLOTS   16
+#define BLOCK_POOL_SIZE_CLASSES 8
+
+// Size class slab pools for function blocks and their IO storage. Blocks allocate their IO from
+// the pool they were created in. Circuits own a pool for their functions, which is freed in one
+// step when the circuit is deleted
+class BlockPool
+{
+    struct Slab;
+
+    // Header preceding every slot
+    struct SlotHeader {
+        Slab*       slab;
+        SlotHeader* nextFree;
+    };
+
+    // Slots of one size class. Oversized allocations get a slab with a single slot of their own
+    struct Slab {
+        BlockPool*  pool;
+        Slab*       prev;
+        Slab*       next;
+        SlotHeader* freeList;
+        uint16_t    used;
+        uint8_t     sizeClass;
+    };
+
+    static const uint16_t sizeClasses[BLOCK_POOL_SIZE_CLASSES];
+
+    std::mutex  lock;
+    // Slabs with free slots are kept apart from full ones, so allocation takes the first slab
+    Slab*       slabs[BLOCK_POOL_SIZE_CLASSES + 1] = {};
+    Slab*       fullSlabs[BLOCK_POOL_SIZE_CLASSES + 1] = {};
+    uint32_t    freeSlots[BLOCK_POOL_SIZE_CLASSES + 1] = {};
+    uint32_t    ownSlabs = 0;
+    uint32_t    ownSlots = 0;
+    bool        clearing = false;
+
+    static int sizeClassIndex(size_t size);
+    static size_t headerSize();
+    static size_t slotSize(uint8_t sizeClass);
+    Slab* createSlab(uint8_t sizeClass, size_t size);
+    static void linkSlab(Slab*& first, Slab* slab);
+    static void unlinkSlab(Slab*& first, Slab* slab);
+    void freeSlabs();
+
+public:
+    // Totals of all pools
+    static std::atomic<uint32_t> slabCount;
+    static std::atomic<uint32_t> slotCount;
+
+    // Allocation fails once the pool holds this many slabs
+    uint32_t    maxSlabs = UINT32_MAX;
+
+    BlockPool() {}
+    ~BlockPool();
+
+    BlockPool(const BlockPool&) = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+
+    // Pool of blocks not created for a particular circuit
+    static BlockPool& shared();
+
+    // Pool a slot was allocated from
+    static BlockPool& owner(const void* ptr);
+
+    // Allocate a slot of at least given size. Returns null if out of memory
+    void* allocate(size_t size);
+
+    // Return a slot to its pool
+    static void release(void* ptr);
+
+    // Destroy the objects of the pool and free all slabs at once. Slots released by the destroy
+    // function are not returned one by one. Nothing allocated from the pool may be used afterwards
+    template<typename F>
+    void clear(F&& destroy) {
+        lock.lock();
+        clearing = true;
+        lock.unlock();
+        destroy();
+        lock.lock();
+        freeSlabs();
+        clearing = false;
+        lock.unlock();
+    }
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Common.h"
+#include <atomic>
+
+// Single producer, single consumer ring of variable length records in a fixed buffer. Records are
+// contiguous and 4-byte aligned. A record not fitting before the end of the buffer starts from the
+// beginning. The producer reserves space, writes the record in place and commits it. The consumer
+// reads the oldest record in place and releases it
+
+template<size_t Size>
+
+class ByteRing {
+    static_assert(Size >= 8 && (Size & (Size - 1)) == 0, "Ring size must be a power of two");
+
+    // Record header value marking the rest of the buffer unused
+    enum : uint32_t { WRAP = UINT32_MAX };
+
+    // Free running byte counters
+    std::atomic<uint32_t>   _head;
+    std::atomic<uint32_t>   _tail;
+    alignas(4) uint8_t      _buffer[Size];
+
+    // Producer state of the reserved record
+    uint32_t                _reservedStart = 0;
+    uint32_t                _reservedEnd = 0;
+    // Consumer state of the record read
+    uint32_t                _readEnd = 0;
+
+    static uint32_t recordSize(size_t len) {
+        return sizeof(uint32_t) + ((len + 3) & ~(size_t)3);
+    }
+    uint32_t& header(uint32_t position) {
+        return *(uint32_t*)&_buffer[position & (Size - 1)];
+    }
+
+public:
+    ByteRing() : _head(0), _tail(0) {}
+
+    // Space for a record of given length. Returns null if the ring has no room for it
+    uint8_t* reserve(size_t len) {
+        if (len > Size) return nullptr;
+        const uint32_t size = recordSize(len);
+        const uint32_t tail = _tail.load(std::memory_order_relaxed);
+        const uint32_t untilEnd = Size - (tail & (Size - 1));
+        const uint32_t skip = (size > untilEnd) ? untilEnd : 0;
+        if (skip + size > Size - (tail - _head.load(std::memory_order_acquire))) return nullptr;
+        if (skip) header(tail) = WRAP;
+        _reservedStart = tail + skip;
+        _reservedEnd = _reservedStart + size;
+        header(_reservedStart) = len;
+        return &_buffer[(_reservedStart & (Size - 1)) + sizeof(uint32_t)];
+    }
+
+    // Make the reserved record available to the consumer
+    void commit() {
+        _tail.store(_reservedEnd, std::memory_order_release);
+    }
+
+    // Oldest record and its length. Returns null if the ring is empty
+    uint8_t* read(size_t& len) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) return nullptr;
+        // Wrap marker and the record following it are committed together
+        if (header(head) == WRAP) head += Size - (head & (Size - 1));
+        len = header(head);
+        _readEnd = head + recordSize(len);
+        return &_buffer[(head & (Size - 1)) + sizeof(uint32_t)];
+    }
+
+    // Free the record returned by read
+    void release() {
+        _head.store(_readEnd, std::memory_order_release);
+    }
+
+    bool wasEmpty() const {
+        return _head.load() == _tail.load();
+    }
+
+    size_t freeBytes() const {
+        return Size - (_tail.load() - _head.load());
+    }
+
+    static constexpr size_t capacity() { return Size; }
+};
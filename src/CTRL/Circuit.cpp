@@ -1,16 +1,23 @@
 #include "Circuit.h"
+#include "FunctionGraph.h"
+#include "HAL.h"
 #include <algorithm>
 
 Circuit::Circuit(uint8_t numInputs, uint8_t numOutputs) : FunctionBlock(numInputs, numOutputs, 0)
 {
     outputRefs = new IOValue*[numOutputs] {};
+    kernel = &Circuit::updateOutputs;
 }
 
+// Slabs of the circuit pool are freed together instead of returning functions one by one
 Circuit::~Circuit()
 {
-    for (FunctionBlock* func : funcList) {
-        delete func;
-    }
+    pool.clear([this] {
+        for (FunctionBlock* func : funcList) {
+            delete func;
+        }
+    });
+    HAL::releasePtr32(outputRefs, numOutputs * sizeof(IOValue*));
     delete[] outputRefs;
 }
 
@@ -22,6 +29,7 @@ void Circuit::addFunction(FunctionBlock* func, int32_t index)
         funcList.insert(funcList.begin() + index, func);
     }
     else funcList.push_back(func);
+    ExecutionPlan::invalidate();
 }
 
 void Circuit::removeFunction(FunctionBlock* partingFunc) {
@@ -29,8 +37,8 @@ void Circuit::removeFunction(FunctionBlock* partingFunc) {
     for (FunctionBlock* func : funcList) {
         for (size_t i = 0; i < func->numInputs; i++) {
             if (func->inputFlags()[i] & IO_FLAG_REF &&
-                func->inputValue(i).ref >= partingFunc->outputs() &&
-                func->inputValue(i).ref < (partingFunc->outputs() + partingFunc->numOutputs)) {
+                func->inputs()[i].ref >= partingFunc->outputs() &&
+                func->inputs()[i].ref < (partingFunc->outputs() + partingFunc->numOutputs)) {
                     func->disconnectInput(i);
             }
         }
@@ -38,7 +46,7 @@ void Circuit::removeFunction(FunctionBlock* partingFunc) {
     // Remove connections to circuit outputs
     for (size_t i = 0; i < numOutputs; i++) {
         if (outputRefs[i] >= partingFunc->outputs() &&
-            outputRefs[i] < partingFunc->outputs() + numOutputs) {
+            outputRefs[i] < partingFunc->outputs() + partingFunc->numOutputs) {
                 outputRefs[i] = nullptr;
         }
     }
@@ -49,6 +57,7 @@ void Circuit::removeFunction(FunctionBlock* partingFunc) {
             break;
         }
     }
+    ExecutionPlan::invalidate();
 }
 
 void Circuit::reorderFunction(FunctionBlock* func, uint32_t newIndex) {
@@ -56,20 +65,38 @@ void Circuit::reorderFunction(FunctionBlock* func, uint32_t newIndex) {
     for (size_t current = 0; current < funcList.size(); current++) {
         if (funcList.at(current) == func) {
             std::swap(funcList[current], funcList[newIndex]);
+            autoOrder = false;
+            ExecutionPlan::invalidate();
             return;
         }
     }
 }
 
+void Circuit::sortFunctions() {
+    FunctionOrder order = ::sortFunctions(funcList, outputRefs, numOutputs);
+    feedbackCount = order.feedbackCount;
+    latencyCycles = order.latencyCycles;
+}
+
+void Circuit::compile() {
+    if (autoOrder) sortFunctions();
+    plan.compile(funcList);
+}
+
 void Circuit::run(IOValue* inputValues, IOValue* outputValues, uint32_t dt)
 {
     // Update functions
-    for (FunctionBlock* func : funcList) {
-        func->update(dt);
-    }
+    if (!plan.isValid()) compile();
+    plan.run(dt);
     // Update circuit outputs from references
-    for (size_t i = 0; i < numOutputs; i++) {
-        const IOValue* ref = outputRefs[i];
+    updateOutputs(this, inputValues, outputValues, dt);
+}
+
+void Circuit::updateOutputs(FunctionBlock* func, IOValue* inputValues, IOValue* outputValues, uint32_t dt)
+{
+    Circuit* circ = (Circuit*)func;
+    for (size_t i = 0; i < circ->numOutputs; i++) {
+        const IOValue* ref = circ->outputRefs[i];
         if (ref) {
             outputValues[i] = *ref;
         }
@@ -3,12 +3,24 @@
 #include "Common.h"
 #include "FunctionBlock.h"
 #include "Link.h"
+#include "ExecutionPlan.h"
+#include "BlockPool.h"
 
 class Circuit : public FunctionBlock
 {
 public:
     std::vector<FunctionBlock*> funcList;
     IOValue** outputRefs;
+    ExecutionPlan plan;
+
+    // Pool for functions created for the circuit. Freed at once with the circuit, so functions
+    // created in it must not outlive the circuit
+    BlockPool pool;
+
+    // Keep functions in dependency order. Disabled when functions are reordered manually
+    bool autoOrder = true;
+    uint32_t feedbackCount = 0;
+    uint32_t latencyCycles = 0;
 
     Circuit(uint8_t numInputs, uint8_t numOutputs);
 
@@ -21,5 +33,14 @@ public:
     
     void reorderFunction(FunctionBlock* func, uint32_t index);
 
+    // Sort functions to dependency order and flag feedback connections
+    void sortFunctions();
+
+    // Compile execution plan from function list
+    void compile();
+
     void run(IOValue* inputValues, IOValue* outputValues, uint32_t dt);
+
+    // Update circuit outputs from references. Used as the circuit kernel in execution plans
+    static void updateOutputs(FunctionBlock* func, IOValue* inputValues, IOValue* outputValues, uint32_t dt);
 };
\ No newline at end of file
@@ -4,5 +4,6 @@
 #include <string.h>
 #include <vector>
 #include <stdlib.h>
+#include <algorithm>
 
 typedef uint64_t Time;
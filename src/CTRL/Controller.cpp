@@ -1,20 +1,204 @@
 #include "Controller.h"
 #include "CyclicTask.h"
-#include "Esp.h"
-#include "Wifi.h"
+#include "HAL.h"
 #include "Circuit.h"
+#include "ExecutionPlan.h"
+#include "LoadBalancer.h"
+#include <algorithm>
 
-Controller::Controller() {}
+Controller::Controller(uint8_t workerCount) :
+    workerCount (std::min(std::max(workerCount, (uint8_t)1), (uint8_t)HAL_MAX_WORKERS))
+{
+    workers = new ControllerWorker[this->workerCount];
+}
+
+// Schedule entries ordered by release time. Heap functions keep the earliest release in front
+static bool releasesLater(const ScheduleEntry& a, const ScheduleEntry& b) {
+    return a.releaseTime > b.releaseTime;
+}
+
+// Order of tasks due on the same tick. Higher priority first, then earliest deadline first
+static bool runsBefore(const ScheduleEntry& a, const ScheduleEntry& b) {
+    if (a.task->priority != b.task->priority) return a.task->priority > b.task->priority;
+    return a.releaseTime + a.task->interval_ms * 1000 < b.releaseTime + b.task->interval_ms * 1000;
+}
+
+void Controller::buildSchedule(uint8_t workerIndex) {
+    ControllerWorker& worker = workers[workerIndex];
+    worker.scheduleRevision = scheduleRevision;
+    worker.scheduledTaskCount = tasks.size();
+    worker.schedule.clear();
+    for (CyclicTask* task : tasks) {
+        if (task->worker != workerIndex || !task->isRunning()) continue;
+        worker.schedule.push_back({ task->nextUpdateTime(), task });
+    }
+    std::make_heap(worker.schedule.begin(), worker.schedule.end(), releasesLater);
+}
+
+void Controller::invalidateSchedule() {
+    scheduleRevision++;
+    for (uint8_t i = 0; i < workerCount; i++) HAL::wake(i);
+}
+
+// Returns next update time of the worker
+Time Controller::tick(uint8_t workerIndex) {
+    ControllerWorker& worker = workers[workerIndex];
+    worker.lock.lock();
+    // Plans are compiled with all workers paused since IO storage may move between arenas
+    if (!tasksValid()) {
+        worker.lock.unlock();
+        lockProgram();
+        if (!tasksValid()) compileTasks();
+        unlockProgram();
+        worker.lock.lock();
+    }
+    if (workerIndex == 0) tickCount++;
+    worker.tickCount++;
+    if (worker.scheduleRevision != scheduleRevision || worker.scheduledTaskCount != tasks.size()) {
+        buildSchedule(workerIndex);
+    }
+
+    // Take all tasks due by now from the schedule
+    std::vector<ScheduleEntry>& schedule = worker.schedule;
+    const Time now = getTime();
+    worker.ready.clear();
+    while (schedule.size() && schedule.front().releaseTime <= now) {
+        std::pop_heap(schedule.begin(), schedule.end(), releasesLater);
+        worker.ready.push_back(schedule.back());
+        schedule.pop_back();
+    }
+    if (worker.ready.size() > 1) std::sort(worker.ready.begin(), worker.ready.end(), runsBefore);
+
+    // Run due tasks and schedule their next release
+    for (const ScheduleEntry& entry : worker.ready) {
+        const Time releaseTime = entry.task->tick(now);
+        if (!entry.task->isRunning()) continue;
+        schedule.push_back({ releaseTime, entry.task });
+        std::push_heap(schedule.begin(), schedule.end(), releasesLater);
+    }
+
+    // Idle worker waits until woken
+    Time nextUpdateTime = schedule.size() ? schedule.front().releaseTime : UINT64_MAX;
+    worker.nextUpdateTime = nextUpdateTime;
+    // Task list only changes with all workers paused, so worker 0 reads it under its own lock
+    const bool balanceDue = workerIndex == 0 && offsetBalanceDue();
+    worker.lock.unlock();
+
+    // Offsets change with all workers paused. Schedules are rebuilt on next tick
+    if (balanceDue) {
+        lockProgram();
+        if (tasksMeasured()) balanceOffsets();
+        unlockProgram();
+    }
+    return nextUpdateTime;
+}
+
+// Balance when tasks have changed
+bool Controller::offsetBalanceDue() {
+    return autoBalanceOffsets && (offsetBalancePending.load(std::memory_order_relaxed) || balancedTaskCount != tasks.size());
+}
+
+// Every running task has measured CPU times. Run counts are written by the workers, program must be locked
+bool Controller::tasksMeasured() {
+    for (CyclicTask* task : tasks) {
+        if (task->isRunning() && task->runCount < BALANCE_MIN_RUNS) return false;
+    }
+    return true;
+}
+
+void Controller::balanceOffsets() {
+    offsetBalancePending.store(false, std::memory_order_relaxed);
+    balancedTaskCount = tasks.size();
+    std::vector<CyclicTask*> workerTasks;
+    for (uint8_t i = 0; i < workerCount; i++) {
+        workerTasks.clear();
+        for (CyclicTask* task : tasks) {
+            if (task->worker == i && task->isRunning()) workerTasks.push_back(task);
+        }
+        balanceTaskOffsets(workerTasks);
+    }
+}
+
+// Structure lock is taken before workers, workers are always locked in index order
+void Controller::lockProgram() {
+    structureLock.lock();
+    for (uint8_t i = 0; i < workerCount; i++) workers[i].lock.lock();
+}
+
+void Controller::unlockProgram() {
+    for (uint8_t i = workerCount; i > 0; i--) workers[i - 1].lock.unlock();
+    structureLock.unlock();
+}
+
+void Controller::lockStructure() {
+    structureLock.lock();
+}
+
+void Controller::unlockStructure() {
+    structureLock.unlock();
+}
+
+bool Controller::tasksValid() {
+    for (CyclicTask* task : tasks) {
+        if (!task->plan.isValid()) return false;
+    }
+    return true;
+}
+
+// Output storage range of a plan instruction
+struct OutputRange {
+    const IOValue*  begin;
+    const IOValue*  end;
+    CyclicTask*     task;
+};
+
+void Controller::compileTasks() {
+    // Recompiling every plan resets bindings redirected by the previous exchange setup.
+    // Arenas are packed first, so each plan is compiled once against the final IO layout
+    ExecutionPlan::invalidate();
+    for (CyclicTask* task : tasks) task->packArena();
+    for (CyclicTask* task : tasks) task->plan.compile(task->funcList);
+    for (CyclicTask* task : tasks) task->plan.clearExchange();
+    if (workerCount < 2) return;
+
+    // Locate producer tasks of referenced outputs
+    std::vector<OutputRange> ranges;
+    for (CyclicTask* task : tasks) {
+        for (const Instruction& instr : task->plan.instructions) {
+            if (instr.numOutputs) ranges.push_back({instr.outputs, instr.outputs + instr.numOutputs, task});
+        }
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const OutputRange& a, const OutputRange& b) { return a.begin < b.begin; });
+
+    // Inputs referring to outputs of tasks on other workers are read from a consistent copy
+    for (CyclicTask* consumer : tasks) {
+        std::vector<InputBinding*> crossBindings;
+        std::vector<ExecutionPlan*> producers;
+        for (const Instruction& instr : consumer->plan.instructions) {
+            for (uint8_t i = 0; i < instr.numInputBindings; i++) {
+                InputBinding* binding = &instr.inputBindings[i];
+                auto it = std::upper_bound(ranges.begin(), ranges.end(), binding->source,
+                    [](const IOValue* ref, const OutputRange& range) { return ref < range.begin; });
+                if (it == ranges.begin()) continue;
+                const OutputRange& range = *(it - 1);
+                if (binding->source >= range.end || range.task->worker == consumer->worker) continue;
+                crossBindings.push_back(binding);
+                producers.push_back(&range.task->plan);
+            }
+        }
+        for (size_t i = 0; i < crossBindings.size(); i++) {
+            consumer->plan.importSignal(producers[i], crossBindings[i]);
+        }
+        consumer->plan.linkImports();
+    }
+}
 
-// Returns next update time
-Time Controller::tick() {
-    tickCount++;
-    Time nextUpdateTimeMin = UINT32_MAX;
+uint32_t Controller::ioArenaSize() {
+    uint32_t size = 0;
     for (CyclicTask* task : tasks) {
-        Time nextUpdateTime = task->tick();
-        nextUpdateTimeMin = min(nextUpdateTimeMin, nextUpdateTime);
+        size += task->arena.size();
     }
-    return nextUpdateTimeMin;
+    return size;
 }
 
 void Controller::connected() {}
@@ -32,8 +216,8 @@ void Controller::removeFunction(FunctionBlock* partingFunc) {
     for (FunctionBlock* func : funcList) {
         for (size_t i = 0; i < func->numInputs; i++) {
             if (func->inputFlags()[i] & IO_FLAG_REF &&
-                func->inputValue(i).ref >= partingFunc->outputs() &&
-                func->inputValue(i).ref < (partingFunc->outputs() + partingFunc->numOutputs)) {
+                func->inputs()[i].ref >= partingFunc->outputs() &&
+                func->inputs()[i].ref < (partingFunc->outputs() + partingFunc->numOutputs)) {
                     func->disconnectInput(i);
             }
         }
@@ -54,11 +238,13 @@ void Controller::removeFunction(FunctionBlock* partingFunc) {
             }
         }
     }
+    ExecutionPlan::invalidate();
 }
 
-uint32_t Controller::freeHeap() { return ESP.getFreeHeap(); }
-uint32_t Controller::cpuFreq()  { return ESP.getCpuFreqMHz(); }
-    Time Controller::getTime()  { return esp_timer_get_time(); }
-  int8_t Controller::getRSSI()  { return WiFi.RSSI(); }
+uint32_t Controller::freeHeap() { return HAL::freeHeap(); }
+uint32_t Controller::maxAllocHeap() { return HAL::maxAllocHeap(); }
+uint32_t Controller::cpuFreq()  { return HAL::cpuFreqMHz(); }
+    Time Controller::getTime()  { return HAL::time(); }
+  int8_t Controller::getRSSI()  { return HAL::RSSI(); }
 
 
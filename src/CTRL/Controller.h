@@ -1,6 +1,8 @@
 #pragma once
 
 #include "Common.h"
+#include <mutex>
+#include <atomic>
 
 #define MAX_UPDATE_INTERVAL 100U
 
@@ -10,6 +12,33 @@ class CyclicTask;
 class FunctionBlock;
 class Link;
 
+// Heap state before and after the latest IO arena compaction
+struct HeapCompactionStats {
+    uint32_t    freeHeapBefore;
+    uint32_t    maxAllocBefore;
+    uint32_t    freeHeapAfter;
+    uint32_t    maxAllocAfter;
+};
+
+// Pending release of a running task
+struct ScheduleEntry {
+    Time        releaseTime;
+    CyclicTask* task;
+};
+
+// Execution thread running the tasks assigned to it. Each worker tracks its own deadline
+struct ControllerWorker {
+    std::mutex  lock;
+    uint32_t    tickCount = 0;
+    Time        nextUpdateTime = 0;
+
+    // Min-heap of task release times and the tasks due on the current tick
+    std::vector<ScheduleEntry>  schedule;
+    std::vector<ScheduleEntry>  ready;
+    uint32_t    scheduleRevision = 0;
+    size_t      scheduledTaskCount = 0;
+};
+
 class Controller
 {
 public:
@@ -18,10 +47,49 @@ public:
 
     uint32_t tickCount = 0;
 
-    Controller();
+    HeapCompactionStats lastCompaction = {};
+
+    uint8_t workerCount;
+    ControllerWorker* workers;
+
+private:
+    std::mutex structureLock;
+    std::atomic<uint32_t> scheduleRevision {1};
+    void buildSchedule(uint8_t worker);
+
+    // Set by the link thread, read by worker 0
+    std::atomic<bool> offsetBalancePending {false};
+    size_t balancedTaskCount = 0;
+    bool offsetBalanceDue();
+    bool tasksMeasured();
+
+public:
+
+    Controller(uint8_t workerCount = 1);
+
+    // Update tasks assigned to given worker. Returns next pending update time of the worker
+    Time tick(uint8_t worker = 0);
+
+    // Task timing or worker changed. Wakes all workers to rebuild their schedules
+    void invalidateSchedule();
+
+    // Assign task offsets from measured CPU times when tasks are added, started or their intervals change
+    bool autoBalanceOffsets = false;
+    inline void requestOffsetBalance() { offsetBalancePending.store(true, std::memory_order_relaxed); }
+    // Balance offsets of the tasks of each worker. Program must be locked
+    void balanceOffsets();
+
+    // Pause all workers to modify program structure
+    void lockProgram();
+    void unlockProgram();
+
+    // Keep program structure from changing while workers keep running. For readers outside the workers
+    void lockStructure();
+    void unlockStructure();
 
-    // Returns next pending update time in ms
-    Time tick();
+    // Compile task plans and set up signal exchange between workers. Program must be locked
+    void compileTasks();
+    bool tasksValid();
 
     void connected();
     void disconnected();
@@ -30,6 +98,8 @@ public:
     void removeFunction(FunctionBlock* func);
 
     uint32_t    freeHeap();
+    uint32_t    maxAllocHeap();
+    uint32_t    ioArenaSize();
     uint32_t    cpuFreq();
     Time        getTime();
     int8_t      getRSSI();
@@ -1,9 +1,11 @@
 #include "CyclicTask.h"
 #include "Circuit.h"
-#include "Esp.h"
+#include "FunctionGraph.h"
+#include "HAL.h"
 
 CyclicTask::CyclicTask(Controller* controller, uint32_t interval_ms, uint32_t offset_ms) :
     controller (controller),
+    arena (controller),
     interval_ms (interval_ms),
     offset_ms (offset_ms)
 {}
@@ -16,46 +18,115 @@ void CyclicTask::start() {
     baseTimer = (now / interval_us) * interval_us;
     while (nextUpdateTime() < now)
         baseTimer += interval_ms * 1000;
+    controller->invalidateSchedule();
+    controller->requestOffsetBalance();
 }
 
 void CyclicTask::stop() {
     running = false;
     prevRunTime = 0;
+    catchUpPending = 0;
+    controller->invalidateSchedule();
 }
 
 // Returns next pending update time
-Time CyclicTask::tick() {
+Time CyclicTask::tick(Time now) {
     if (!running) return UINT64_MAX;
-    Time now = controller->getTime();
     if (now >= nextUpdateTime()) {
+        const uint32_t interval_us = interval_ms * 1000;
         drift_us = now - nextUpdateTime();
-        do baseTimer += interval_ms * 1000;
-        while (nextUpdateTime() <= now);
+        // Catch-up runs are late by design, they are not counted as drift or misses
+        if (catchUpPending) {
+            catchUpPending--;
+            baseTimer += interval_us;
+            catchingUp = true;
+            update();
+            catchingUp = false;
+            serveReadCapture();
+            return nextUpdateTime();
+        }
+        startDrift.add(drift_us);
+        // Periods started before the current one. Catch-up leaves the burst pending, released on the following ticks
+        uint32_t skipped = drift_us / interval_us;
+        if (overrunPolicy == OVERRUN_POLICY_CATCH_UP) {
+            catchUpPending = std::min(skipped, catchUpBurst);
+            skipped -= catchUpPending;
+        }
+        skippedCycles += skipped;
+        baseTimer += (Time)(skipped + 1) * interval_us;
         update();
+        // Overrun when the run completes after the next period has started
+        const uint32_t completion_us = drift_us + lastCPUTime;
+        if (completion_us > interval_us) {
+            deadlineMisses++;
+            consecutiveOverruns++;
+            maxConsecutiveOverruns = std::max(maxConsecutiveOverruns, consecutiveOverruns);
+            worstOverrun_us = std::max(worstOverrun_us, completion_us - interval_us);
+            inTimeRuns = 0;
+        } else {
+            consecutiveOverruns = 0;
+            inTimeRuns++;
+        }
+        if (overrunPolicy == OVERRUN_POLICY_DEGRADE) {
+            if (consecutiveOverruns) plan.degraded = true;
+            else if (inTimeRuns >= OVERRUN_RECOVERY_RUNS) plan.degraded = false;
+        }
+        serveReadCapture();
     }
     return nextUpdateTime();
 }
 
-inline Time CyclicTask::nextUpdateTime() { return baseTimer + offset_ms * 1000; }
+// Capture requested by the link, after the overrun accounting of the cycle
+void CyclicTask::serveReadCapture() {
+    if (!readCaptureRequested.load(std::memory_order_acquire)) return;
+    captureReadSnapshot();
+    readCaptureRequested.store(false, std::memory_order_release);
+    HAL::wake(HAL_WAKEUP_LINK);
+}
 
 void CyclicTask::update() {
     Time startTime = controller->getTime();
     if (running) {
-        // Skip statistics on the first run
-        if (prevRunTime > 0) {
-            lastActualInterval_ms = (startTime - prevRunTime) / 1000;
+        // Skip statistics on the first run and on back to back catch-up runs
+        if (prevRunTime > 0 && !catchingUp) {
+            const uint32_t actualInterval_us = startTime - prevRunTime;
+            const uint32_t interval_us = interval_ms * 1000;
+            lastActualInterval_ms = actualInterval_us / 1000;
             cumulativeActualInterval_ms += lastActualInterval_ms;
+            intervalJitter.add((actualInterval_us > interval_us) ? actualInterval_us - interval_us : interval_us - actualInterval_us);
             runCount++;
         }
         prevRunTime = startTime;
     }
     // Update all functions attached to this task
-    for (FunctionBlock* func : funcList) {
-        func->update(interval_ms);
+    if (!plan.isValid()) compile();
+    plan.importSignals();
+    plan.run(interval_ms);
+    plan.exportSignals();
+    if (monitoringCaptureRequested.load(std::memory_order_relaxed)) {
+        plan.captureMonitoringValues();
+        monitoringCaptureRequested.store(false, std::memory_order_release);
+        HAL::wake(HAL_WAKEUP_LINK);
     }
+    if (trace && trace->capture((uint32_t)startTime)) HAL::wake(HAL_WAKEUP_LINK);
     Time endTime = controller->getTime();
     lastCPUTime = endTime - startTime;
-    if (running) cumulativeCPUTime += lastCPUTime;
+    if (running) {
+        cumulativeCPUTime += lastCPUTime;
+        cpuTime.add(lastCPUTime);
+    }
+}
+
+void CyclicTask::packArena() {
+    if (autoOrder) feedbackCount = sortFunctions(funcList).feedbackCount;
+    std::vector<FunctionBlock*> funcs;
+    ExecutionPlan::collectFunctions(funcList, funcs);
+    arena.pack(funcs);
+}
+
+void CyclicTask::compile() {
+    packArena();
+    plan.compile(funcList);
 }
 
 float CyclicTask::averageCPUTime() {
@@ -66,6 +137,39 @@ float CyclicTask::averageActualInterval_ms() {
     return runCount ? (float)cumulativeActualInterval_ms / runCount : 0.f;
 }
 
+void CyclicTask::captureReadSnapshot() {
+    readSnapshot.runCount = runCount;
+    readSnapshot.lastCPUTime = lastCPUTime;
+    readSnapshot.avgCPUTime = averageCPUTime();
+    readSnapshot.lastActualInterval_ms = lastActualInterval_ms;
+    readSnapshot.avgActualInterval_ms = averageActualInterval_ms();
+    readSnapshot.drift_us = drift_us;
+    readSnapshot.evaluatedCount = plan.evaluatedCount;
+    if (readSnapshot.timingStats) {
+        readSnapshot.deadlineMisses = deadlineMisses;
+        readSnapshot.skippedCycles = skippedCycles;
+        readSnapshot.consecutiveOverruns = consecutiveOverruns;
+        readSnapshot.maxConsecutiveOverruns = maxConsecutiveOverruns;
+        readSnapshot.worstOverrun_us = worstOverrun_us;
+        readSnapshot.degraded = plan.degraded;
+        readSnapshot.intervalJitter = intervalJitter;
+        readSnapshot.startDrift = startDrift;
+        readSnapshot.cpuTime = cpuTime;
+    }
+    if (readSnapshot.source) memcpy(readSnapshot.data.data(), readSnapshot.source, readSnapshot.data.size());
+}
+
+void CyclicTask::resetTimingStats() {
+    intervalJitter.reset();
+    startDrift.reset();
+    cpuTime.reset();
+    deadlineMisses = 0;
+    skippedCycles = 0;
+    consecutiveOverruns = 0;
+    maxConsecutiveOverruns = 0;
+    worstOverrun_us = 0;
+}
+
 bool CyclicTask::isRunning() {
     return running;
 }
@@ -77,6 +181,42 @@ void CyclicTask::setInterval(uint32_t time) {
 
 void CyclicTask::setOffset(uint32_t time) {
     offset_ms = time;
+    controller->invalidateSchedule();
+}
+
+void CyclicTask::setPriority(uint8_t newPriority) {
+    priority = newPriority;
+}
+
+void CyclicTask::setOverrunPolicy(OVERRUN_POLICY policy, uint32_t burst) {
+    overrunPolicy = policy;
+    catchUpBurst = burst;
+    catchUpPending = 0;
+    plan.degraded = false;
+}
+
+void CyclicTask::setEvaluationMode(EVALUATION_MODE mode) {
+    plan.setMode(mode);
+}
+
+// Returns false if profiling is not compiled in
+bool CyclicTask::setProfiling(bool enable) {
+#ifdef CTRL_PROFILING
+    plan.setProfiling(enable);
+    return true;
+#else
+    return false;
+#endif
+}
+
+// Signal exchange between workers is set up again on next compile
+bool CyclicTask::setWorker(uint8_t newWorker) {
+    if (newWorker >= controller->workerCount) return false;
+    worker = newWorker;
+    ExecutionPlan::invalidate();
+    controller->invalidateSchedule();
+    controller->requestOffsetBalance();
+    return true;
 }
 
 void CyclicTask::addFunction(FunctionBlock* func, int32_t index) {
@@ -84,6 +224,7 @@ void CyclicTask::addFunction(FunctionBlock* func, int32_t index) {
         funcList.insert(funcList.begin() + index, func);
     } else
         funcList.push_back(func);
+    ExecutionPlan::invalidate();
 }
 
 void CyclicTask::removeFunction(FunctionBlock* func) {
@@ -93,4 +234,5 @@ void CyclicTask::removeFunction(FunctionBlock* func) {
             break;
         }
     }
+    ExecutionPlan::invalidate();
 }
\ No newline at end of file
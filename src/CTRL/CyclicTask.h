@@ -4,6 +4,21 @@
 #include "FunctionBlock.h"
 #include "Controller.h"
 #include "Link.h"
+#include "ExecutionPlan.h"
+#include "IOArena.h"
+#include "Histogram.h"
+#include "TraceRecorder.h"
+
+// Consecutive in-time runs before a degraded task runs non-critical functions again
+#define OVERRUN_RECOVERY_RUNS 10
+
+// Handling of periods missed because of an overrunning update
+enum OVERRUN_POLICY
+{
+    OVERRUN_POLICY_SKIP,        // Continue from the next period in the future
+    OVERRUN_POLICY_CATCH_UP,    // Run missed periods back to back, at most catch-up burst periods
+    OVERRUN_POLICY_DEGRADE      // Skip missed periods and suspend non-critical functions until recovered
+};
 
 class CyclicTask
 {
@@ -15,12 +30,24 @@ class CyclicTask
 public:
 
     std::vector<FunctionBlock*> funcList;
+    ExecutionPlan plan;
+    IOArena arena;
+
+    // Keep functions in dependency order
+    bool autoOrder = true;
+    uint32_t feedbackCount = 0;
 
     Link*       link = nullptr;
 
+    // Index of the controller worker running this task
+    uint8_t     worker = 0;
+
     uint32_t    interval_ms = 0;
     uint32_t    offset_ms = 0;
 
+    // Tasks due on the same tick run in priority order, equal priorities earliest deadline first
+    uint8_t     priority = 0;
+
     uint32_t    runCount = 0;
 
     uint32_t    lastCPUTime = 0;
@@ -31,22 +58,89 @@ public:
 
     uint32_t    drift_us = 0;
 
+    // Timing distributions in microseconds. Interval jitter is the difference of actual and set interval
+    Histogram   intervalJitter;
+    Histogram   startDrift;
+    Histogram   cpuTime;
+
+    // Runs that completed after the next cycle start, and cycles skipped entirely
+    uint32_t    deadlineMisses = 0;
+    uint32_t    skippedCycles = 0;
+
+    // Overrun streaks and the latest completion past the next cycle start
+    uint32_t    consecutiveOverruns = 0;
+    uint32_t    maxConsecutiveOverruns = 0;
+    uint32_t    worstOverrun_us = 0;
+    uint32_t    inTimeRuns = 0;
+
+    OVERRUN_POLICY overrunPolicy = OVERRUN_POLICY_SKIP;
+    uint32_t    catchUpBurst = 2;
+    // Missed periods left to run back to back
+    uint32_t    catchUpPending = 0;
+    bool        catchingUp = false;
+
+    // Signals sampled at the end of every cycle. Created by the link
+    TraceRecorder* trace = nullptr;
+
+    // Set by the link to capture monitoring values at the end of the next cycle. Cleared when captured
+    std::atomic<bool> monitoringCaptureRequested {false};
+
+    // Task statistics and a memory range written by the task, copied at the end of a cycle for link reads
+    struct ReadSnapshot {
+        uint32_t    runCount = 0;
+        uint32_t    lastCPUTime = 0;
+        float       avgCPUTime = 0.f;
+        uint32_t    lastActualInterval_ms = 0;
+        float       avgActualInterval_ms = 0.f;
+        uint32_t    drift_us = 0;
+        uint32_t    evaluatedCount = 0;
+        // Timing statistics, copied only if requested since the histograms are large
+        bool        timingStats = false;
+        uint32_t    deadlineMisses = 0;
+        uint32_t    skippedCycles = 0;
+        uint32_t    consecutiveOverruns = 0;
+        uint32_t    maxConsecutiveOverruns = 0;
+        uint32_t    worstOverrun_us = 0;
+        bool        degraded = false;
+        Histogram   intervalJitter;
+        Histogram   startDrift;
+        Histogram   cpuTime;
+        // Memory to copy and its copy, set up by the link before requesting a capture
+        const void* source = nullptr;
+        std::vector<uint8_t> data;
+    };
+    ReadSnapshot readSnapshot;
+
+    // Set by the link to capture the read snapshot at the end of the next cycle. Cleared when captured
+    std::atomic<bool> readCaptureRequested {false};
+    void serveReadCapture();
+
     CyclicTask(Controller* controller, uint32_t interval_ms, uint32_t offset_ms=0);
 
-    // Returns next pending update time
-    Time tick();
+    // Update if due at given time. Returns next pending update time
+    Time tick(Time now);
 
     void update();
+    // Sort functions and lay out their IO storage in the arena. Compiles nothing
+    void packArena();
+    void compile();
     bool isRunning();
-    uint64_t inline nextUpdateTime();
+    inline Time nextUpdateTime() { return baseTimer + offset_ms * 1000; }
 
     float averageCPUTime();
     float averageActualInterval_ms();
+    void resetTimingStats();
+    void captureReadSnapshot();
 
     void start();
     void stop();
     void setInterval(uint32_t time);
     void setOffset(uint32_t time);
+    void setPriority(uint8_t priority);
+    void setOverrunPolicy(OVERRUN_POLICY policy, uint32_t catchUpBurst);
+    void setEvaluationMode(EVALUATION_MODE mode);
+    bool setProfiling(bool enable);
+    bool setWorker(uint8_t worker);
     void addFunction(FunctionBlock* func, int32_t index = -1);
     void removeFunction(FunctionBlock* func);
 };
\ No newline at end of file
@@ -0,0 +1,340 @@
+#include "ExecutionPlan.h"
+#include "Controller.h"
+#include "Circuit.h"
+#include "HAL.h"
+#include <algorithm>
+
+uint32_t ExecutionPlan::revision = 1;
+
+void ExecutionPlan::compile(const std::vector<FunctionBlock*>& funcList) {
+    instructions.clear();
+    inputBuffer.clear();
+    clearExchange();
+#ifdef CTRL_PROFILING
+    profileSpans.clear();
+#endif
+    for (FunctionBlock* func : funcList) {
+        emit(func);
+    }
+#ifdef CTRL_PROFILING
+    profileTimestamps.resize(instructions.size() + 1);
+#endif
+    if (mode == EVAL_MODE_CHANGE_DRIVEN) buildDependencies();
+    logicSegments.clear();
+    if (mode == EVAL_MODE_PACKED_LOGIC) logicSegments = PackedLogic::build(instructions);
+    compiledRevision = revision;
+}
+
+void ExecutionPlan::collectFunctions(const std::vector<FunctionBlock*>& funcList, std::vector<FunctionBlock*>& funcs) {
+    for (FunctionBlock* func : funcList) {
+        if (func->opcode == OPCODE_CIRCUIT) {
+            Circuit* circ = (Circuit*)func;
+            if (circ->autoOrder) circ->sortFunctions();
+            collectFunctions(circ->funcList, funcs);
+        }
+        funcs.push_back(func);
+    }
+}
+
+void ExecutionPlan::emit(FunctionBlock* func, bool nonCritical) {
+#ifdef CTRL_PROFILING
+    const uint32_t first = instructions.size();
+#endif
+    nonCritical = nonCritical || (func->flags & FUNC_FLAG_NON_CRITICAL);
+    // Inline circuit functions followed by the circuit output update
+    if (func->opcode == OPCODE_CIRCUIT) {
+        Circuit* circ = (Circuit*)func;
+        if (circ->autoOrder) circ->sortFunctions();
+        for (FunctionBlock* childFunc : circ->funcList) {
+            emit(childFunc, nonCritical);
+        }
+    }
+    func->bindInputs();
+    // Fused kernels read connected inputs directly from their sources when no conversion is needed
+    bool fused = (func->fusedKernel && func->numInputBindings);
+    for (uint8_t i = 0; fused && i < func->numInputBindings; i++) {
+        if (func->inputBindings[i].op > BIND_REF_INVERT) fused = false;
+    }
+    Instruction instr = {
+        .kernel             = fused ? func->fusedKernel : func->kernel,
+        .func               = func,
+        .inputs             = func->inputs(),
+        .inputBindings      = func->inputBindings,
+        .outputs            = func->outputs(),
+        .opcode             = func->opcode,
+        .numInputs          = func->numInputs,
+        .numOutputs         = func->numOutputs,
+        .numInputBindings   = func->numInputBindings,
+        .fusedInputs        = fused,
+        .nonCritical        = nonCritical
+    };
+    instructions.push_back(instr);
+    if (inputBuffer.size() < func->numInputs) inputBuffer.resize(func->numInputs);
+#ifdef CTRL_PROFILING
+    if (profiling) {
+        if (!func->profile) func->profile = new FunctionProfile();
+        profileSpans.push_back({ func->profile, first, (uint32_t)instructions.size() });
+    }
+#endif
+}
+
+void IRAM_ATTR ExecutionPlan::run(uint32_t dt) {
+    if (degraded && mode != EVAL_MODE_CHANGE_DRIVEN) {
+        runDegraded(dt);
+        return;
+    }
+#ifdef CTRL_PROFILING
+    if (profiling && mode == EVAL_MODE_CYCLIC) {
+        runProfiled(dt);
+        return;
+    }
+#endif
+    if (mode == EVAL_MODE_CHANGE_DRIVEN) {
+        runChangeDriven(dt);
+        return;
+    }
+    if (mode == EVAL_MODE_PACKED_LOGIC) {
+        runPackedLogic(dt);
+        return;
+    }
+    IOValue* buffer = inputBuffer.data();
+    for (const Instruction& instr : instructions) {
+        execute(instr, buffer, dt);
+    }
+    evaluatedCount = instructions.size();
+}
+
+// Run critical functions only. Packed logic segments run unpacked since they may contain non-critical functions
+void IRAM_ATTR ExecutionPlan::runDegraded(uint32_t dt) {
+    IOValue* buffer = inputBuffer.data();
+    uint32_t count = 0;
+    for (const Instruction& instr : instructions) {
+        if (instr.nonCritical) continue;
+        execute(instr, buffer, dt);
+        count++;
+    }
+    logicSegmentsStale = true;
+    evaluatedCount = count;
+}
+
+#ifdef CTRL_PROFILING
+// Take a cycle count before every instruction. Function times are differences over their instruction ranges
+void IRAM_ATTR ExecutionPlan::runProfiled(uint32_t dt) {
+    IOValue* buffer = inputBuffer.data();
+    uint32_t* timestamps = profileTimestamps.data();
+    const uint32_t count = instructions.size();
+    for (uint32_t i = 0; i < count; i++) {
+        timestamps[i] = HAL::cycleCount();
+        execute(instructions[i], buffer, dt);
+    }
+    timestamps[count] = HAL::cycleCount();
+    for (const ProfileSpan& span : profileSpans) {
+        span.profile->add(timestamps[span.end] - timestamps[span.first]);
+    }
+    evaluatedCount = count;
+}
+#endif
+
+// Run scheduled and continuously running functions. Consumers of changed outputs are scheduled,
+// consumers earlier in the plan (feedback) run on the next cycle
+void IRAM_ATTR ExecutionPlan::runChangeDriven(uint32_t dt) {
+    if (inputRevision != FunctionBlock::inputWriteRevision) scheduleChangedInputs();
+    IOValue* buffer = inputBuffer.data();
+    uint32_t count = 0;
+    for (size_t i = 0; i < instructions.size(); i++) {
+        const Instruction& instr = instructions[i];
+        if (!scheduled[i]) continue;
+        // Suspended functions stay scheduled until the task recovers
+        if (degraded && instr.nonCritical) continue;
+        if (scheduled[i] == SCHEDULE_ONCE) scheduled[i] = SCHEDULE_NONE;
+        execute(instr, buffer, dt);
+        count++;
+        // Schedule consumers of changed outputs
+        IOValue* previous = &previousOutputs[previousOutputIndex[i]];
+        for (size_t output = 0; output < instr.numOutputs; output++) {
+            if (previous[output].u == instr.outputs[output].u) continue;
+            previous[output] = instr.outputs[output];
+            for (uint32_t d = dependencyIndex[i]; d < dependencyIndex[i + 1]; d++) {
+                const Dependency& dependency = dependencies[d];
+                if (dependency.output == output && scheduled[dependency.consumer] == SCHEDULE_NONE) scheduled[dependency.consumer] = SCHEDULE_ONCE;
+            }
+        }
+    }
+    evaluatedCount = count;
+}
+
+// Schedule functions with constant inputs written since the previous cycle. Writes happen with the workers paused
+void ExecutionPlan::scheduleChangedInputs() {
+    for (size_t i = 0; i < instructions.size(); i++) {
+        if (instructions[i].func->inputRevision > inputRevision && scheduled[i] == SCHEDULE_NONE) scheduled[i] = SCHEDULE_ONCE;
+    }
+    inputRevision = FunctionBlock::inputWriteRevision;
+}
+
+// Run instructions between packed logic segments one by one
+void IRAM_ATTR ExecutionPlan::runPackedLogic(uint32_t dt) {
+    IOValue* buffer = inputBuffer.data();
+    if (logicSegmentsStale) {
+        for (PackedLogic& segment : logicSegments) segment.reload();
+        logicSegmentsStale = false;
+    }
+    uint32_t i = 0;
+    for (PackedLogic& segment : logicSegments) {
+        for (; i < segment.begin; i++) execute(instructions[i], buffer, dt);
+        segment.run();
+        i = segment.end;
+    }
+    for (; i < instructions.size(); i++) execute(instructions[i], buffer, dt);
+    evaluatedCount = instructions.size();
+}
+
+// Build output consumer lists. Functions reading values produced outside the plan and functions
+// with time dependent state are scheduled to run on every cycle
+void ExecutionPlan::buildDependencies() {
+    struct OutputRange {
+        const IOValue*  begin;
+        const IOValue*  end;
+        uint32_t        producer;
+    };
+    std::vector<OutputRange> ranges;
+    for (size_t i = 0; i < instructions.size(); i++) {
+        const Instruction& instr = instructions[i];
+        if (instr.numOutputs) ranges.push_back({ instr.outputs, instr.outputs + instr.numOutputs, (uint32_t)i });
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const OutputRange& a, const OutputRange& b) { return a.begin < b.begin; });
+
+    // Find producer of a referenced value. Returns false if the value is produced outside the plan
+    auto findProducer = [&ranges](const IOValue* ref, uint32_t& producer, uint8_t& output) {
+        auto it = std::upper_bound(ranges.begin(), ranges.end(), ref,
+            [](const IOValue* ref, const OutputRange& range) { return ref < range.begin; });
+        if (it == ranges.begin()) return false;
+        --it;
+        if (ref >= it->end) return false;
+        producer = it->producer;
+        output = ref - it->begin;
+        return true;
+    };
+
+    std::vector<std::pair<uint32_t, Dependency>> edges;
+    scheduled.assign(instructions.size(), SCHEDULE_ONCE);
+    inputRevision = FunctionBlock::inputWriteRevision;
+    previousOutputIndex.resize(instructions.size());
+    size_t outputCount = 0;
+    for (size_t i = 0; i < instructions.size(); i++) {
+        const Instruction& instr = instructions[i];
+        previousOutputIndex[i] = outputCount;
+        outputCount += instr.numOutputs;
+        if (instr.func->flags & FUNC_FLAG_CONTINUOUS) scheduled[i] = SCHEDULE_ALWAYS;
+
+        std::vector<const IOValue*> refs;
+        for (size_t b = 0; b < instr.numInputBindings; b++) refs.push_back(instr.inputBindings[b].source);
+        if (instr.opcode == OPCODE_CIRCUIT) {
+            Circuit* circ = (Circuit*)instr.func;
+            for (size_t o = 0; o < circ->numOutputs; o++) {
+                if (circ->outputRefs[o]) refs.push_back(circ->outputRefs[o]);
+            }
+        }
+        for (const IOValue* ref : refs) {
+            uint32_t producer;
+            uint8_t output;
+            if (findProducer(ref, producer, output)) edges.push_back({ producer, { .consumer = (uint32_t)i, .output = output } });
+            else scheduled[i] = SCHEDULE_ALWAYS;
+        }
+    }
+    std::stable_sort(edges.begin(), edges.end(),
+        [](const std::pair<uint32_t, Dependency>& a, const std::pair<uint32_t, Dependency>& b) { return a.first < b.first; });
+
+    dependencies.clear();
+    dependencyIndex.assign(instructions.size() + 1, 0);
+    for (const auto& edge : edges) {
+        dependencyIndex[edge.first + 1]++;
+        dependencies.push_back(edge.second);
+    }
+    for (size_t i = 0; i < instructions.size(); i++) dependencyIndex[i + 1] += dependencyIndex[i];
+
+    // Current outputs are the reference for change detection
+    previousOutputs.resize(outputCount);
+    for (size_t i = 0; i < instructions.size(); i++) {
+        const Instruction& instr = instructions[i];
+        memcpy(&previousOutputs[previousOutputIndex[i]], instr.outputs, instr.numOutputs * sizeof(IOValue));
+    }
+}
+
+uint32_t ExecutionPlan::exportSignal(const IOValue* source) {
+    for (size_t i = 0; i < exportSources.size(); i++) {
+        if (exportSources[i] == source) return i;
+    }
+    exportSources.push_back(source);
+    exportValues.push_back(*source);
+    return exportSources.size() - 1;
+}
+
+void ExecutionPlan::importSignal(ExecutionPlan* producer, InputBinding* binding) {
+    imports.push_back({ producer, producer->exportSignal(binding->source), binding });
+}
+
+// Imports are grouped by producer so each producer is read with a single sequence check
+void ExecutionPlan::linkImports() {
+    std::stable_sort(imports.begin(), imports.end(),
+        [](const SignalImport& a, const SignalImport& b) { return a.producer < b.producer; });
+    importValues.resize(imports.size());
+    for (size_t i = 0; i < imports.size(); i++) {
+        importValues[i] = imports[i].producer->exportValues[imports[i].exportIndex];
+        imports[i].binding->source = &importValues[i];
+    }
+}
+
+// Bindings are reset by the compile that follows
+void ExecutionPlan::clearExchange() {
+    exportSources.clear();
+    exportValues.clear();
+    imports.clear();
+    importValues.clear();
+}
+
+// Sequence is odd while export values are being written
+void IRAM_ATTR ExecutionPlan::exportSignals() {
+    if (exportSources.empty()) return;
+    uint32_t sequence = exportSequence.load(std::memory_order_relaxed);
+    exportSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < exportSources.size(); i++) {
+        exportValues[i] = *exportSources[i];
+    }
+    exportSequence.store(sequence + 2, std::memory_order_release);
+}
+
+// Same sequence protocol as signal export. Readers copy the values of all functions of the plan
+// between two equal even sequence values
+void IRAM_ATTR ExecutionPlan::captureMonitoringValues() {
+    uint32_t sequence = monitoringSequence.load(std::memory_order_relaxed);
+    monitoringSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (const Instruction& instr : instructions) {
+        IOValue* monitoringValues = instr.func->monitoringValues;
+        if (!monitoringValues) continue;
+        IOValue* inputValues = FunctionBlock::resolveInputs(monitoringValues, instr.inputs, instr.numInputs, instr.inputBindings, instr.numInputBindings);
+        if (inputValues != monitoringValues) memcpy(&monitoringValues[0], inputValues, instr.numInputs * sizeof(IOValue));
+        memcpy(&monitoringValues[instr.numInputs], instr.outputs, instr.numOutputs * sizeof(IOValue));
+    }
+    monitoringSequence.store(sequence + 2, std::memory_order_release);
+}
+
+// Retry copying from a producer until it was not written meanwhile
+void IRAM_ATTR ExecutionPlan::importSignals() {
+    size_t begin = 0;
+    while (begin < imports.size()) {
+        ExecutionPlan* producer = imports[begin].producer;
+        size_t end = begin;
+        while (end < imports.size() && imports[end].producer == producer) end++;
+        uint32_t sequence;
+        do {
+            sequence = producer->exportSequence.load(std::memory_order_acquire);
+            for (size_t i = begin; i < end; i++) {
+                importValues[i] = producer->exportValues[imports[i].exportIndex];
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((sequence & 1) || producer->exportSequence.load(std::memory_order_relaxed) != sequence);
+        begin = end;
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "Common.h"
+#include "FunctionBlock.h"
+#include "PackedLogic.h"
+#include <atomic>
+
+enum EVALUATION_MODE
+{
+    EVAL_MODE_CYCLIC,           // Run every function on every cycle
+    EVAL_MODE_CHANGE_DRIVEN,    // Run functions whose referenced outputs changed
+    EVAL_MODE_PACKED_LOGIC      // Run every function, logic functions on bit packed signals
+};
+
+// Fixed size execution record of one function block
+struct Instruction
+{
+    FunctionKernel  kernel;
+    FunctionBlock*  func;
+    IOValue*        inputs;
+    InputBinding*   inputBindings;
+    IOValue*        outputs;
+    uint16_t        opcode;
+    uint8_t         numInputs;
+    uint8_t         numOutputs;
+    uint8_t         numInputBindings;
+    bool            fusedInputs;
+    bool            nonCritical;
+};
+
+// Flat list of instructions compiled from a function list. Nested circuits are inlined
+class ExecutionPlan
+{
+    enum SCHEDULE { SCHEDULE_NONE, SCHEDULE_ONCE, SCHEDULE_ALWAYS };
+
+    // Consumer of an instruction output
+    struct Dependency {
+        uint32_t    consumer;
+        uint8_t     output;
+    };
+
+    std::vector<IOValue> inputBuffer;
+    uint32_t compiledRevision = 0;
+
+    // Change-driven evaluation state
+    std::vector<Dependency> dependencies;
+    std::vector<uint32_t>   dependencyIndex;
+    std::vector<IOValue>    previousOutputs;
+    std::vector<uint32_t>   previousOutputIndex;
+    std::vector<uint8_t>    scheduled;
+    // Constant input writes up to this revision are scheduled
+    uint32_t                inputRevision = 0;
+
+    // Signal exchange with plans running on other workers
+    struct SignalImport {
+        ExecutionPlan*  producer;
+        uint32_t        exportIndex;
+        InputBinding*   binding;
+    };
+    std::atomic<uint32_t>       exportSequence {0};
+    std::vector<const IOValue*> exportSources;
+    std::vector<IOValue>        exportValues;
+    std::vector<SignalImport>   imports;
+    std::vector<IOValue>        importValues;
+
+    uint32_t exportSignal(const IOValue* source);
+
+    void emit(FunctionBlock* func, bool nonCritical = false);
+    void buildDependencies();
+    void runChangeDriven(uint32_t dt);
+    void scheduleChangedInputs();
+
+    // Packed logic segments in plan order
+    std::vector<PackedLogic> logicSegments;
+    // Segment functions have run unpacked and the packed state must be reloaded
+    bool logicSegmentsStale = false;
+    void runPackedLogic(uint32_t dt);
+    void runDegraded(uint32_t dt);
+
+#ifdef CTRL_PROFILING
+    // Instruction range of a function. Circuit ranges include their nested functions
+    struct ProfileSpan {
+        FunctionProfile*    profile;
+        uint32_t            first;
+        uint32_t            end;
+    };
+    std::vector<ProfileSpan>    profileSpans;
+    std::vector<uint32_t>       profileTimestamps;
+    void runProfiled(uint32_t dt);
+#endif
+
+public:
+    // Program structure revision. Plans compiled from an older revision are recompiled before next run
+    static uint32_t revision;
+    static inline void invalidate() { revision++; }
+
+    std::vector<Instruction> instructions;
+
+    EVALUATION_MODE mode = EVAL_MODE_CYCLIC;
+
+    // Number of functions run on the latest cycle
+    uint32_t evaluatedCount = 0;
+
+    // Skip non-critical functions and functions of non-critical circuits. Suspended functions keep their outputs
+    bool degraded = false;
+
+    inline bool isValid() { return compiledRevision == revision; }
+
+    // Change evaluation mode. Plan is recompiled before next run
+    inline void setMode(EVALUATION_MODE newMode) { mode = newMode; compiledRevision = 0; }
+
+#ifdef CTRL_PROFILING
+    // Measure function execution times. Applies to cyclic evaluation
+    bool profiling = false;
+    inline void setProfiling(bool enable) { profiling = enable; compiledRevision = 0; }
+#endif
+
+    void compile(const std::vector<FunctionBlock*>& funcList);
+
+    // Functions of a function list in the order compile emits them. Circuits are sorted and preceded by their functions
+    static void collectFunctions(const std::vector<FunctionBlock*>& funcList, std::vector<FunctionBlock*>& funcs);
+
+    void run(uint32_t dt);
+
+    // Read given binding from a copy of the producer output taken before each run
+    void importSignal(ExecutionPlan* producer, InputBinding* binding);
+    // Redirect imported bindings to the local copies. Call after all imports are added
+    void linkImports();
+    void clearExchange();
+
+    // Copy outputs read by other workers. Producer side, called after run
+    void exportSignals();
+    // Take consistent copies of imported signals. Consumer side, called before run
+    void importSignals();
+
+    // Sequence is odd while monitoring values are being captured
+    std::atomic<uint32_t> monitoringSequence {0};
+    // Copy input and output values of monitored functions as of the end of the cycle. Called after run
+    void captureMonitoringValues();
+
+    // Run one instruction using given buffer for gathered input values
+    static inline void execute(const Instruction& instr, IOValue* buffer, uint32_t dt) {
+        IOValue* inputValues = instr.fusedInputs ? instr.inputs
+            : FunctionBlock::resolveInputs(buffer, instr.inputs, instr.numInputs, instr.inputBindings, instr.numInputBindings);
+        instr.kernel(instr.func, inputValues, instr.outputs, dt);
+    }
+};
@@ -2,6 +2,7 @@
 
 #include "../FunctionBlock.h"
 #include "../FunctionLib.h"
+#include "../SimdReduce.h"
 
 namespace LogicLib
 {
@@ -19,7 +20,7 @@ enum FUNC_ID
     FUNC_COUNT
 };
 
-const char* names[] =
+static const char* names[] =
 {
     "AND",
     "OR",
@@ -38,17 +39,29 @@ public:
     {
         for (int i = 0; i < numInputs; i++) initInput(i, true);
         initOutput(0, true);
+        fusedKernel = &runFused;
     }
 
     const char* name() { return names[FUNC_ID_AND]; }
 
     void run(IOValue* inputValues, IOValue* outputValues, uint32_t dt)
     {
-        bool result = true;
-        for (uint i = 0; i < numInputs; i++) {
-            result = (result && inputValues[i].u);
+        outputValues[0].u = Simd::allTrue(inputValues, numInputs);
+    }
+
+    static void runFused(FunctionBlock* func, IOValue* inputs, IOValue* outputs, uint32_t dt)
+    {
+        outputs[0].u = Simd::allTrue(inputs, func->inputFlags(), func->numInputs, func->inputBindings);
+    }
+
+    static void runInstances(const LaneValue* const* inputs, LaneValue* const* outputs, uint8_t numInputs, uint32_t count)
+    {
+        LaneValue* result = outputs[0];
+        for (uint32_t n = 0; n < count; n++) result[n].u = (inputs[0][n].u != 0);
+        for (int i = 1; i < numInputs; i++) {
+            const LaneValue* input = inputs[i];
+            for (uint32_t n = 0; n < count; n++) result[n].u &= (input[n].u != 0);
         }
-        outputValues[0].u = result;
     }
 };
 
@@ -59,17 +72,29 @@ public:
     {
         for (int i = 0; i < numInputs; i++) initInput(i, false);
         initOutput(0, false);
+        fusedKernel = &runFused;
     }
 
     const char* name() { return names[FUNC_ID_OR]; }
 
     void run(IOValue* inputValues, IOValue* outputValues, uint32_t dt)
     {
-        int result = false;
-        for (int i = 0; i < numInputs; i++) {
-            result = (result || inputValues[i].u);
+        outputValues[0].u = Simd::anyTrue(inputValues, numInputs);
+    }
+
+    static void runFused(FunctionBlock* func, IOValue* inputs, IOValue* outputs, uint32_t dt)
+    {
+        outputs[0].u = Simd::anyTrue(inputs, func->inputFlags(), func->numInputs, func->inputBindings);
+    }
+
+    static void runInstances(const LaneValue* const* inputs, LaneValue* const* outputs, uint8_t numInputs, uint32_t count)
+    {
+        LaneValue* result = outputs[0];
+        for (uint32_t n = 0; n < count; n++) result[n].u = (inputs[0][n].u != 0);
+        for (int i = 1; i < numInputs; i++) {
+            const LaneValue* input = inputs[i];
+            for (uint32_t n = 0; n < count; n++) result[n].u |= (input[n].u != 0);
         }
-        outputValues[0].u = result;
     }
 };
 
@@ -80,17 +105,19 @@ public:
     {
         for (int i = 0; i < numInputs; i++) initInput(i, false);
         initOutput(0, false);
+        fusedKernel = &runFused;
     }
 
     const char* name() { return names[FUNC_ID_XOR]; }
 
     void run(IOValue* inputValues, IOValue* outputValues, uint32_t dt)
     {
-        int count = 0;
-        for (int i = 0; i < numInputs; i++) {
-            count += inputValues[i].u;
-        }
-        outputValues[0].u = (count == 1);
+        outputValues[0].u = (Simd::sumUint(inputValues, numInputs) == 1);
+    }
+
+    static void runFused(FunctionBlock* func, IOValue* inputs, IOValue* outputs, uint32_t dt)
+    {
+        outputs[0].u = (Simd::sumUint(inputs, func->inputFlags(), func->numInputs, func->inputBindings) == 1);
     }
 };
 
@@ -161,6 +188,7 @@ class RisingEdge: public FunctionBlock
 public:
     RisingEdge() : FunctionBlock(1, 1, OPCODE(LIB_ID_LOGIC, FUNC_ID_RisingEdge))
     {
+        setFuncFlag(FUNC_FLAG_CONTINUOUS);
         initInput(0, false);
         initOutput(0, false);
     }
@@ -182,6 +210,7 @@ class FallingEdge: public FunctionBlock
 public:
     FallingEdge() : FunctionBlock(1, 1, OPCODE(LIB_ID_LOGIC, FUNC_ID_FallingEdge))
     {
+        setFuncFlag(FUNC_FLAG_CONTINUOUS);
         initInput(0, true);
         initOutput(0, false);
     }
@@ -204,18 +233,18 @@ class Library: public FunctionLibrary
 public:
     Library() : FunctionLibrary(LIB_ID_LOGIC, "Logic", FUNC_COUNT, names) {}
 
-    FunctionBlock* createFunction(uint8_t func_id, uint8_t numInputs, uint8_t numOutputs)
+    FunctionBlock* createFunction(uint8_t func_id, uint8_t numInputs, uint8_t numOutputs, BlockPool& pool)
     {
         switch(func_id)
         {
-            case FUNC_ID_AND:           return new AND(numInputs);   
-            case FUNC_ID_OR:            return new OR(numInputs);
-            case FUNC_ID_XOR:           return new XOR(numInputs);
-            case FUNC_ID_NOT:           return new NOT();
-            case FUNC_ID_RS:            return new RS();
-            case FUNC_ID_SR:            return new SR();
-            case FUNC_ID_RisingEdge:    return new RisingEdge();
-            case FUNC_ID_FallingEdge:   return new FallingEdge();
+            case FUNC_ID_AND:           return create<AND>(pool, numInputs);   
+            case FUNC_ID_OR:            return create<OR>(pool, numInputs);
+            case FUNC_ID_XOR:           return create<XOR>(pool, numInputs);
+            case FUNC_ID_NOT:           return create<NOT>(pool);
+            case FUNC_ID_RS:            return create<RS>(pool);
+            case FUNC_ID_SR:            return create<SR>(pool);
+            case FUNC_ID_RisingEdge:    return create<RisingEdge>(pool);
+            case FUNC_ID_FallingEdge:   return create<FallingEdge>(pool);
             
             default:                    return nullptr;
         }
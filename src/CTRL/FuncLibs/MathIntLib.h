@@ -2,6 +2,7 @@
 
 #include "../FunctionBlock.h"
 #include "../FunctionLib.h"
+#include "../SimdReduce.h"
 
 namespace MathIntLib
 {
@@ -15,7 +16,7 @@ enum FUNC_ID {
     FUNC_COUNT
 };
 
-const char* names[] = {
+static const char* names[] = {
     "ADD",
     "SUB",
     "MUL",
@@ -26,21 +27,23 @@ const char* names[] = {
 class ADD : public FunctionBlock
 {
 public:
-    ADD(uint8_t size = 2) : FunctionBlock(max((uint8_t)2, size), 1, OPCODE(LIB_ID_MATH_INT, FUNC_ID_ADD))
+    ADD(uint8_t size = 2) : FunctionBlock(std::max((uint8_t)2, size), 1, OPCODE(LIB_ID_MATH_INT, FUNC_ID_ADD))
     {
         for (int i = 0; i < numInputs; i++) initInput(i, 0);
         initOutput(0, 0);
+        fusedKernel = &runFused;
     }
 
     const char* name() { return names[FUNC_ID_ADD]; }
 
     void run(IOValue* inputValues, IOValue* outputValues, uint32_t dt)
     {
-        int32_t result = inputValues[0].i;
-        for (int i = 1; i < numInputs; i++) {
-            result += inputValues[i].i;
-        }
-        outputValues[0].i = result;
+        outputValues[0].u = Simd::sumUint(inputValues, numInputs);
+    }
+
+    static void runFused(FunctionBlock* func, IOValue* inputs, IOValue* outputs, uint32_t dt)
+    {
+        outputs[0].u = Simd::sumUint(inputs, func->inputFlags(), func->numInputs, func->inputBindings);
     }
 };
 
@@ -64,21 +67,23 @@ public:
 class MUL : public FunctionBlock
 {
 public:
-    MUL(uint8_t size = 2) : FunctionBlock(max((uint8_t)2, size), 1, OPCODE(LIB_ID_MATH_INT, FUNC_ID_MUL))
+    MUL(uint8_t size = 2) : FunctionBlock(std::max((uint8_t)2, size), 1, OPCODE(LIB_ID_MATH_INT, FUNC_ID_MUL))
     {
         for (int i = 0; i < numInputs; i++) initInput(i, 1);
         initOutput(0, 1);
+        fusedKernel = &runFused;
     }
 
     const char* name() { return names[FUNC_ID_MUL]; }
 
     void run(IOValue* inputValues, IOValue* outputValues, uint32_t dt)
     {
-        int32_t result = inputValues[0].i;
-        for (int i = 1; i < numInputs; i++) {
-            result *= inputValues[i].i;
-        }
-        outputValues[0].i = result;
+        outputValues[0].u = Simd::productUint(inputValues, numInputs);
+    }
+
+    static void runFused(FunctionBlock* func, IOValue* inputs, IOValue* outputs, uint32_t dt)
+    {
+        outputs[0].u = Simd::productUint(inputs, func->inputFlags(), func->numInputs, func->inputBindings);
     }
 };
 
@@ -126,15 +131,15 @@ class Library: public FunctionLibrary
 public:
     Library() : FunctionLibrary(LIB_ID_MATH_INT, "Math Int", FUNC_COUNT, names) {}
 
-    FunctionBlock* createFunction(uint8_t func_id, uint8_t numInputs, uint8_t numOutputs)
+    FunctionBlock* createFunction(uint8_t func_id, uint8_t numInputs, uint8_t numOutputs, BlockPool& pool)
     {
         switch(func_id)
         {
-            case FUNC_ID_ADD:           return new ADD(numInputs);   
-            case FUNC_ID_SUB:           return new SUB();
-            case FUNC_ID_MUL:           return new MUL(numInputs);
-            case FUNC_ID_DIV:           return new DIV();
-            case FUNC_ID_ABS:           return new ABS();
+            case FUNC_ID_ADD:           return create<ADD>(pool, numInputs);   
+            case FUNC_ID_SUB:           return create<SUB>(pool);
+            case FUNC_ID_MUL:           return create<MUL>(pool, numInputs);
+            case FUNC_ID_DIV:           return create<DIV>(pool);
+            case FUNC_ID_ABS:           return create<ABS>(pool);
             
             default:                    return nullptr;
         }
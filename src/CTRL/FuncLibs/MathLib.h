@@ -2,6 +2,8 @@
 
 #include "../FunctionBlock.h"
 #include "../FunctionLib.h"
+#include "../SimdReduce.h"
+#include <math.h>
 
 namespace MathLib
 {
@@ -19,7 +21,7 @@ enum FUNC_ID {
     FUNC_COUNT
 };
 
-const char* names[] = {
+static const char* names[] = {
     "ADD",
     "SUB",
     "MUL",
@@ -34,21 +36,33 @@ const char* names[] = {
 class ADD : public FunctionBlock
 {
 public:
-    ADD(uint8_t size = 2) : FunctionBlock(max((uint8_t)2, size), 1, OPCODE(LIB_ID_MATH, FUNC_ID_ADD))
+    ADD(uint8_t size = 2) : FunctionBlock(std::max((uint8_t)2, size), 1, OPCODE(LIB_ID_MATH, FUNC_ID_ADD))
     {
         for (int i = 0; i < numInputs; i++) initInput(i, 0.0f);
         initOutput(0, 0.0f);
+        fusedKernel = &runFused;
     }
 
     const char* name() { return names[FUNC_ID_ADD]; }
 
     void run(IOValue* inputValues, IOValue* outputValues, uint32_t dt)
     {
-        float result = inputValues[0].f;
+        outputValues[0].f = Simd::sumFloat(inputValues, numInputs);
+    }
+
+    static void runFused(FunctionBlock* func, IOValue* inputs, IOValue* outputs, uint32_t dt)
+    {
+        outputs[0].f = Simd::sumFloat(inputs, func->inputFlags(), func->numInputs, func->inputBindings);
+    }
+
+    static void runInstances(const LaneValue* const* inputs, LaneValue* const* outputs, uint8_t numInputs, uint32_t count)
+    {
+        LaneValue* result = outputs[0];
+        for (uint32_t n = 0; n < count; n++) result[n].f = inputs[0][n].f;
         for (int i = 1; i < numInputs; i++) {
-            result += inputValues[i].f;
+            const LaneValue* input = inputs[i];
+            for (uint32_t n = 0; n < count; n++) result[n].f += input[n].f;
         }
-        outputValues[0].f = result;
     }
 };
 
@@ -72,21 +86,33 @@ public:
 class MUL : public FunctionBlock
 {
 public:
-    MUL(uint8_t size = 2) : FunctionBlock(max((uint8_t)2, size), 1, OPCODE(LIB_ID_MATH, FUNC_ID_MUL))
+    MUL(uint8_t size = 2) : FunctionBlock(std::max((uint8_t)2, size), 1, OPCODE(LIB_ID_MATH, FUNC_ID_MUL))
     {
         for (int i = 0; i < numInputs; i++) initInput(i, 1.0f);
         initOutput(0, 1.0f);
+        fusedKernel = &runFused;
     }
 
     const char* name() { return names[FUNC_ID_MUL]; }
 
     void run(IOValue* inputValues, IOValue* outputValues, uint32_t dt)
     {
-        float result = inputValues[0].f;
+        outputValues[0].f = Simd::productFloat(inputValues, numInputs);
+    }
+
+    static void runFused(FunctionBlock* func, IOValue* inputs, IOValue* outputs, uint32_t dt)
+    {
+        outputs[0].f = Simd::productFloat(inputs, func->inputFlags(), func->numInputs, func->inputBindings);
+    }
+
+    static void runInstances(const LaneValue* const* inputs, LaneValue* const* outputs, uint8_t numInputs, uint32_t count)
+    {
+        LaneValue* result = outputs[0];
+        for (uint32_t n = 0; n < count; n++) result[n].f = inputs[0][n].f;
         for (int i = 1; i < numInputs; i++) {
-            result *= inputValues[i].f;
+            const LaneValue* input = inputs[i];
+            for (uint32_t n = 0; n < count; n++) result[n].f *= input[n].f;
         }
-        outputValues[0].f = result;
     }
 };
 
@@ -110,6 +136,16 @@ public:
         float result = a / b;
         outputValues[0].f = result;
     }
+
+    static void runInstances(const LaneValue* const* inputs, LaneValue* const* outputs, uint8_t numInputs, uint32_t count)
+    {
+        const LaneValue* a = inputs[0];
+        const LaneValue* b = inputs[1];
+        LaneValue* result = outputs[0];
+        for (uint32_t n = 0; n < count; n++) {
+            if (b[n].f != 0.f) result[n].f = a[n].f / b[n].f;
+        }
+    }
 };
 
 class ABS : public FunctionBlock
@@ -144,6 +180,13 @@ public:
     {
         outputValues[0].f = sinf(inputValues[0].f);
     }
+
+    static void runInstances(const LaneValue* const* inputs, LaneValue* const* outputs, uint8_t numInputs, uint32_t count)
+    {
+        const LaneValue* input = inputs[0];
+        LaneValue* result = outputs[0];
+        for (uint32_t n = 0; n < count; n++) result[n].f = sinf(input[n].f);
+    }
 };
 
 class COS : public FunctionBlock
@@ -206,19 +249,19 @@ class Library: public FunctionLibrary
 public:
     Library() : FunctionLibrary(LIB_ID_MATH, "Math", FUNC_COUNT, names) {}
 
-    FunctionBlock* createFunction(uint8_t func_id, uint8_t numInputs, uint8_t numOutputs)
+    FunctionBlock* createFunction(uint8_t func_id, uint8_t numInputs, uint8_t numOutputs, BlockPool& pool)
     {
         switch(func_id)
         {
-            case FUNC_ID_ADD:           return new ADD(numInputs);   
-            case FUNC_ID_SUB:           return new SUB();
-            case FUNC_ID_MUL:           return new MUL(numInputs);
-            case FUNC_ID_DIV:           return new DIV();
-            case FUNC_ID_ABS:           return new ABS();
-            case FUNC_ID_SIN:           return new SIN();
-            case FUNC_ID_COS:           return new COS();
-            case FUNC_ID_POW:           return new POW();
-            case FUNC_ID_SQRT:          return new SQRT();
+            case FUNC_ID_ADD:           return create<ADD>(pool, numInputs);   
+            case FUNC_ID_SUB:           return create<SUB>(pool);
+            case FUNC_ID_MUL:           return create<MUL>(pool, numInputs);
+            case FUNC_ID_DIV:           return create<DIV>(pool);
+            case FUNC_ID_ABS:           return create<ABS>(pool);
+            case FUNC_ID_SIN:           return create<SIN>(pool);
+            case FUNC_ID_COS:           return create<COS>(pool);
+            case FUNC_ID_POW:           return create<POW>(pool);
+            case FUNC_ID_SQRT:          return create<SQRT>(pool);
             
             default:                    return nullptr;
         }
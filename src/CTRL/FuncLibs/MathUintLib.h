@@ -2,6 +2,7 @@
 
 #include "../FunctionBlock.h"
 #include "../FunctionLib.h"
+#include "../SimdReduce.h"
 
 namespace MathUintLib
 {
@@ -14,7 +15,7 @@ enum FUNC_ID {
     FUNC_COUNT
 };
 
-const char* names[] = {
+static const char* names[] = {
     "ADD",
     "SUB",
     "MUL",
@@ -24,21 +25,23 @@ const char* names[] = {
 class ADD : public FunctionBlock
 {
 public:
-    ADD(uint8_t size = 2) : FunctionBlock(max((uint8_t)2, size), 1, OPCODE(LIB_ID_MATH_UINT, FUNC_ID_ADD))
+    ADD(uint8_t size = 2) : FunctionBlock(std::max((uint8_t)2, size), 1, OPCODE(LIB_ID_MATH_UINT, FUNC_ID_ADD))
     {
         for (int i = 0; i < numInputs; i++) initInput(i, 0u);
         initOutput(0, 0u);
+        fusedKernel = &runFused;
     }
 
     const char* name() { return names[FUNC_ID_ADD]; }
 
     void run(IOValue* inputValues, IOValue* outputValues, uint32_t dt)
     {
-        uint32_t result = inputValues[0].u;
-        for (int i = 1; i < numInputs; i++) {
-            result += inputValues[i].u;
-        }
-        outputValues[0].u = result;
+        outputValues[0].u = Simd::sumUint(inputValues, numInputs);
+    }
+
+    static void runFused(FunctionBlock* func, IOValue* inputs, IOValue* outputs, uint32_t dt)
+    {
+        outputs[0].u = Simd::sumUint(inputs, func->inputFlags(), func->numInputs, func->inputBindings);
     }
 };
 
@@ -62,21 +65,23 @@ public:
 class MUL : public FunctionBlock
 {
 public:
-    MUL(uint8_t size = 2) : FunctionBlock(max((uint8_t)2, size), 1, OPCODE(LIB_ID_MATH_UINT, FUNC_ID_MUL))
+    MUL(uint8_t size = 2) : FunctionBlock(std::max((uint8_t)2, size), 1, OPCODE(LIB_ID_MATH_UINT, FUNC_ID_MUL))
     {
         for (int i = 0; i < numInputs; i++) initInput(i, 1u);
         initOutput(0, 1u);
+        fusedKernel = &runFused;
     }
 
     const char* name() { return names[FUNC_ID_MUL]; }
 
     void run(IOValue* inputValues, IOValue* outputValues, uint32_t dt)
     {
-        uint32_t result = inputValues[0].u;
-        for (int i = 1; i < numInputs; i++) {
-            result *= inputValues[i].u;
-        }
-        outputValues[0].u = result;
+        outputValues[0].u = Simd::productUint(inputValues, numInputs);
+    }
+
+    static void runFused(FunctionBlock* func, IOValue* inputs, IOValue* outputs, uint32_t dt)
+    {
+        outputs[0].u = Simd::productUint(inputs, func->inputFlags(), func->numInputs, func->inputBindings);
     }
 };
 
@@ -107,14 +112,14 @@ class Library: public FunctionLibrary
 public:
     Library() : FunctionLibrary(LIB_ID_MATH_UINT, "Math Uint", FUNC_COUNT, names) {}
 
-    FunctionBlock* createFunction(uint8_t func_id, uint8_t numInputs, uint8_t numOutputs)
+    FunctionBlock* createFunction(uint8_t func_id, uint8_t numInputs, uint8_t numOutputs, BlockPool& pool)
     {
         switch(func_id)
         {
-            case FUNC_ID_ADD:           return new ADD(numInputs);   
-            case FUNC_ID_SUB:           return new SUB();
-            case FUNC_ID_MUL:           return new MUL(numInputs);
-            case FUNC_ID_DIV:           return new DIV();
+            case FUNC_ID_ADD:           return create<ADD>(pool, numInputs);   
+            case FUNC_ID_SUB:           return create<SUB>(pool);
+            case FUNC_ID_MUL:           return create<MUL>(pool, numInputs);
+            case FUNC_ID_DIV:           return create<DIV>(pool);
             
             default:                    return nullptr;
         }
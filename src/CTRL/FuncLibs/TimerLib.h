@@ -14,7 +14,7 @@ enum FUNC_ID
     FUNC_COUNT
 };
 
-const char* names[] =
+static const char* names[] =
 {
     "ON_DELAY",
     "OFF_DELAY",
@@ -37,6 +37,7 @@ class OnDelay : public FunctionBlock
 public:
     OnDelay() : FunctionBlock(3, 2, OPCODE(LIB_ID_TIMERS, FUNC_ID_ON_DELAY))
     {
+        setFuncFlag(FUNC_FLAG_CONTINUOUS);
         initInput(0, false);
         initInput(1, 5000u);
         initInput(2, false);
@@ -95,6 +96,7 @@ class OffDelay : public FunctionBlock
 public:
     OffDelay() : FunctionBlock(3, 2, OPCODE(LIB_ID_TIMERS, FUNC_ID_OFF_DELAY))
     {
+        setFuncFlag(FUNC_FLAG_CONTINUOUS);
         initInput(0, true);
         initInput(1, 5000u);
         initInput(2, false);
@@ -141,12 +143,12 @@ class Library: public FunctionLibrary
 public:
     Library() : FunctionLibrary(LIB_ID_TIMERS, "Timers", FUNC_COUNT, names) {}
 
-    FunctionBlock* createFunction(uint8_t func_id, uint8_t numInputs, uint8_t numOutputs)
+    FunctionBlock* createFunction(uint8_t func_id, uint8_t numInputs, uint8_t numOutputs, BlockPool& pool)
     {
         switch(func_id)
         {
-            case FUNC_ID_ON_DELAY:      return new OnDelay();   
-            case FUNC_ID_OFF_DELAY:     return new OffDelay();   
+            case FUNC_ID_ON_DELAY:      return create<OnDelay>(pool);   
+            case FUNC_ID_OFF_DELAY:     return create<OffDelay>(pool);   
             
             default:                    return nullptr;
         }
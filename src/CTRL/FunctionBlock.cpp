@@ -1,20 +1,46 @@
 #include "FunctionBlock.h"
-#include "Esp.h"
+#include "ExecutionPlan.h"
+#include "IOArena.h"
+#include "BlockPool.h"
+#include "HAL.h"
+
+uint32_t FunctionBlock::inputWriteRevision = 0;
 
 FunctionBlock::FunctionBlock(uint8_t numInputs, uint8_t numOutputs, uint16_t opcode) :
     numInputs (numInputs),
     numOutputs (numOutputs),
     opcode (opcode)
 {
+    // IO values followed by flags in one slot of the pool the block was allocated from
     const size_t ioCount = numInputs + numOutputs;
-    ioValues = (IOValue*)calloc(sizeof(IOValue), ioCount);
-    ioFlags = (uint8_t*)calloc(sizeof(uint8_t), ioCount);
+    const size_t ioSize = ioCount * (sizeof(IOValue) + sizeof(uint8_t));
+    ioValues = (IOValue*)BlockPool::owner(this).allocate(ioSize);
+    // Block without IO storage is left invalid and deleted by the library
+    if (ioValues == nullptr) return;
+    memset(ioValues, 0, ioSize);
+    ioFlags = (uint8_t*)(ioValues + ioCount);
 }
 
 FunctionBlock::~FunctionBlock() {
-    free(ioValues);
-    free(ioFlags);
-    free(monitoringValues);
+    if (ioArena) ioArena->release(this);
+    IOArena::layoutRevision++;
+    // Link handles of the block and of IO storage of its own
+    HAL::releasePtr32(this, sizeof(FunctionBlock));
+    HAL::releasePtr32(ioValues, ioCount() * (sizeof(IOValue) + sizeof(uint8_t)));
+    BlockPool::release(ioValues);
+    BlockPool::release(monitoringValues);
+    BlockPool::release(inputBindings);
+#ifdef CTRL_PROFILING
+    delete profile;
+#endif
+}
+
+void* FunctionBlock::operator new(size_t size) {
+    return BlockPool::shared().allocate(size);
+}
+
+void FunctionBlock::operator delete(void* ptr) {
+    BlockPool::release(ptr);
 }
 
 size_t FunctionBlock::dataSize() {
@@ -25,18 +51,11 @@ size_t FunctionBlock::dataSize() {
 void IRAM_ATTR FunctionBlock::update(uint32_t dt)
 {
     // Create temporary array for input values
-    IOValue inputValues[numInputs];
+    IOValue buffer[numInputs];
     // Read input values
-    readInputValues(inputValues);
+    IOValue* inputValues = resolveInputs(buffer, inputs(), numInputs, inputBindings, numInputBindings);
     // Run function
     run(inputValues, outputs(), dt);
-    // Update monitoring values
-    if (monitoringValues) {
-        // Copy input values
-        memcpy(&monitoringValues[0], &inputValues[0], numInputs * sizeof(IOValue));
-        // Copy output values
-        memcpy(&monitoringValues[numInputs], outputs(), numOutputs * sizeof(IOValue));
-    }
 }
 
 // Return an input value. Dereferece if needed
@@ -45,78 +64,138 @@ IOValue IRAM_ATTR FunctionBlock::inputValue(uint8_t index) {
     IOValue value = inputs()[index];
     // Check if input is a reference
     if (flags & IO_FLAG_REF) {
-        value = *value.ref;
-        // Check if value needs type conversion
-        // Serial.printf("flag: %x mask: %x AND: %x \n", flags, IO_FLAG_CONV_TYPE_MASK, (flags & IO_FLAG_CONV_TYPE_MASK));
-        if (flags & IO_FLAG_CONV_TYPE_MASK) {
-            const uint8_t ioConvType = (flags & IO_FLAG_CONV_TYPE_MASK);
-            const uint8_t inputType = (flags & IO_FLAG_TYPE_MASK);
-            switch (inputType) {
-                case IO_TYPE_BOOL:
-                case IO_TYPE_UINT:
-                case IO_TYPE_TIME:
-                    if (ioConvType == IO_CONV_FLOAT)    { value.u = value.f;  break; }
-                    if (ioConvType == IO_CONV_SIGNED)   { value.u = value.i;  break; }
-                    break;
-                case IO_TYPE_FLOAT:
-                    if (ioConvType == IO_CONV_UNSIGNED) { value.f = value.u;  break; }
-                    if (ioConvType == IO_CONV_SIGNED)   { value.f = value.i;  break; }
-                    break;
-                case IO_TYPE_INT:
-                    if (ioConvType == IO_CONV_FLOAT)    { value.i = value.f;  break; }
-                    if (ioConvType == IO_CONV_UNSIGNED) { value.i = value.u;  break; }
-                    break;
-            }
-        }
-        // Check if value needs inversion
-        if (flags & IO_FLAG_REF_INVERT) {
-            value.u = (value.u) ? 0 : 1;
-        }
+        value = decodeInput(*value.ref, flags);
     }
     return value;
 }
 
 // Read all input values to given array. Dereference values if needed
 void IRAM_ATTR FunctionBlock::readInputValues(IOValue* values) {
-    for (size_t index = 0; index < numInputs; index++) {
-        const uint8_t flags = inputFlag(index);
-        IOValue value = inputs()[index];
-        // Check if input is a reference
-        if (flags & IO_FLAG_REF) {
-            value = *value.ref;
-            // Check if value needs type conversion
-            if (flags & IO_FLAG_CONV_TYPE_MASK) {
-                const uint8_t ioConvType = (flags & IO_FLAG_CONV_TYPE_MASK);
-                const uint8_t inputType = (flags & IO_FLAG_TYPE_MASK);
-                switch (inputType) {
-                    case IO_TYPE_BOOL:
-                    case IO_TYPE_UINT:
-                    case IO_TYPE_TIME:
-                        if (ioConvType == IO_CONV_FLOAT)    { value.u = value.f;  break; }
-                        if (ioConvType == IO_CONV_SIGNED)   { value.u = value.i;  break; }
-                        break;
-                    case IO_TYPE_FLOAT:
-                        if (ioConvType == IO_CONV_UNSIGNED) { value.f = value.u;  break; }
-                        if (ioConvType == IO_CONV_SIGNED)   { value.f = value.i;  break; }
-                        break;
-                    case IO_TYPE_INT:
-                        if (ioConvType == IO_CONV_FLOAT)    { value.i = value.f;  break; }
-                        if (ioConvType == IO_CONV_UNSIGNED) { value.i = value.u;  break; }
-                        break;
-                }
-            }
-            // Check if value needs inversion
-            if (flags & IO_FLAG_REF_INVERT) {
-                if (value.u != 0) value.u = 0;
-                else value.u = 1;
-            }
+    IOValue* inputValues = resolveInputs(values, inputs(), numInputs, inputBindings, numInputBindings);
+    if (inputValues != values) memcpy(values, inputValues, numInputs * sizeof(IOValue));
+}
+
+// Return a referenced value converted according to input flags
+IOValue IRAM_ATTR FunctionBlock::decodeInput(IOValue value, uint8_t flags) {
+    // Check if value needs type conversion
+    if (flags & IO_FLAG_CONV_TYPE_MASK) {
+        const uint8_t ioConvType = (flags & IO_FLAG_CONV_TYPE_MASK);
+        const uint8_t inputType = (flags & IO_FLAG_TYPE_MASK);
+        switch (inputType) {
+            case IO_TYPE_BOOL:
+            case IO_TYPE_UINT:
+            case IO_TYPE_TIME:
+                if (ioConvType == IO_CONV_FLOAT)    { value.u = value.f;  break; }
+                if (ioConvType == IO_CONV_SIGNED)   { value.u = value.i;  break; }
+                break;
+            case IO_TYPE_FLOAT:
+                if (ioConvType == IO_CONV_UNSIGNED) { value.f = value.u;  break; }
+                if (ioConvType == IO_CONV_SIGNED)   { value.f = value.i;  break; }
+                break;
+            case IO_TYPE_INT:
+                if (ioConvType == IO_CONV_FLOAT)    { value.i = value.f;  break; }
+                if (ioConvType == IO_CONV_UNSIGNED) { value.i = value.u;  break; }
+                break;
+        }
+    }
+    // Check if value needs inversion
+    if (flags & IO_FLAG_REF_INVERT) {
+        value.u = (value.u) ? 0 : 1;
+    }
+    return value;
+}
+
+// Select binding operation matching the conversion done by decodeInput()
+static uint8_t bindingOp(uint8_t flags) {
+    const uint8_t ioConvType = (flags & IO_FLAG_CONV_TYPE_MASK);
+    const bool inverted = (flags & IO_FLAG_REF_INVERT);
+    switch (flags & IO_FLAG_TYPE_MASK) {
+        case IO_TYPE_BOOL:
+        case IO_TYPE_UINT:
+        case IO_TYPE_TIME:
+            if (ioConvType == IO_CONV_FLOAT)    return inverted ? BIND_REF_FLOAT_TO_UINT_INVERT : BIND_REF_FLOAT_TO_UINT;
+            if (ioConvType == IO_CONV_SIGNED)   return inverted ? BIND_REF_INT_TO_UINT_INVERT : BIND_REF_INT_TO_UINT;
+            return inverted ? BIND_REF_INVERT : BIND_REF;
+        case IO_TYPE_FLOAT:
+            if (inverted) break;
+            if (ioConvType == IO_CONV_UNSIGNED) return BIND_REF_UINT_TO_FLOAT;
+            if (ioConvType == IO_CONV_SIGNED)   return BIND_REF_INT_TO_FLOAT;
+            return BIND_REF;
+        case IO_TYPE_INT:
+            if (inverted) break;
+            if (ioConvType == IO_CONV_FLOAT)    return BIND_REF_FLOAT_TO_INT;
+            if (ioConvType == IO_CONV_UNSIGNED) return BIND_REF_UINT_TO_INT;
+            return BIND_REF;
+    }
+    return BIND_REF_DECODE_FLAGS;
+}
+
+// Rebuild input bindings from input flags. Fewer bindings reuse their storage, so only added
+// connections allocate. Returns false and keeps the bindings if the allocation fails
+bool FunctionBlock::bindInputs() {
+    uint8_t count = 0;
+    for (size_t i = 0; i < numInputs; i++) {
+        if (inputFlags()[i] & IO_FLAG_REF) count++;
+    }
+    if (count > numInputBindings) {
+        InputBinding* bindings = (InputBinding*)BlockPool::owner(this).allocate(count * sizeof(InputBinding));
+        if (bindings == nullptr) return false;
+        BlockPool::release(inputBindings);
+        inputBindings = bindings;
+    }
+    else if (count == 0) {
+        BlockPool::release(inputBindings);
+        inputBindings = nullptr;
+    }
+    numInputBindings = count;
+    InputBinding* binding = inputBindings;
+    for (size_t i = 0; i < numInputs; i++) {
+        const uint8_t flags = inputFlags()[i];
+        if (!(flags & IO_FLAG_REF)) continue;
+        binding->source = inputs()[i].ref;
+        binding->index = i;
+        binding->op = bindingOp(flags);
+        binding->flags = flags;
+        binding++;
+    }
+    return true;
+}
+
+// Return input values for run(). Inputs array is returned as is if no input is connected,
+// otherwise input values are gathered to given buffer
+IOValue* IRAM_ATTR FunctionBlock::resolveInputs(IOValue* buffer, IOValue* inputs, uint8_t numInputs, const InputBinding* bindings, uint8_t numBindings) {
+    if (numBindings == 0) return inputs;
+    // Constant inputs
+    if (numBindings < numInputs) memcpy(buffer, inputs, numInputs * sizeof(IOValue));
+    // Connected inputs
+    for (const InputBinding* binding = bindings; binding < bindings + numBindings; binding++) {
+        IOValue value = *binding->source;
+        switch (binding->op) {
+            case BIND_REF:                                                          break;
+            case BIND_REF_INVERT:               value.u = (value.u) ? 0 : 1;        break;
+            case BIND_REF_FLOAT_TO_UINT:        value.u = value.f;                  break;
+            case BIND_REF_FLOAT_TO_UINT_INVERT: value.u = ((uint32_t)value.f) ? 0 : 1; break;
+            case BIND_REF_INT_TO_UINT:          value.u = value.i;                  break;
+            case BIND_REF_INT_TO_UINT_INVERT:   value.u = (value.i) ? 0 : 1;        break;
+            case BIND_REF_UINT_TO_INT:          value.i = value.u;                  break;
+            case BIND_REF_FLOAT_TO_INT:         value.i = value.f;                  break;
+            case BIND_REF_UINT_TO_FLOAT:        value.f = value.u;                  break;
+            case BIND_REF_INT_TO_FLOAT:         value.f = value.i;                  break;
+            default:                            value = decodeInput(value, binding->flags); break;
         }
-        values[index] = value;
+        buffer[binding->index] = value;
     }
+    return buffer;
+}
+
+void IRAM_ATTR FunctionBlock::virtualKernel(FunctionBlock* func, IOValue* inputValues, IOValue* outputValues, uint32_t dt) {
+    func->run(inputValues, outputValues, dt);
 }
 
-void FunctionBlock::connectInput(uint8_t inputNum, FunctionBlock* sourceFunc, uint8_t outputNum, bool inverted)
+bool FunctionBlock::connectInput(uint8_t inputNum, FunctionBlock* sourceFunc, uint8_t outputNum, bool inverted)
 {
+    const IOValue prevValue = inputs()[inputNum];
+    const uint8_t prevFlags = inputFlags()[inputNum];
     inputs()[inputNum].ref = sourceFunc->getOutputRef(outputNum);
     setInputFlag(inputNum, IO_FLAG_REF);
     
@@ -146,12 +225,24 @@ void FunctionBlock::connectInput(uint8_t inputNum, FunctionBlock* sourceFunc, ui
         setInputFlag(inputNum, IO_FLAG_REF_INVERT);
     else
         clearInputFlag(inputNum, IO_FLAG_REF_INVERT);
+
+    // Input stays as it was if no binding could be allocated for it
+    if (!bindInputs()) {
+        inputs()[inputNum] = prevValue;
+        inputFlags()[inputNum] = prevFlags;
+        return false;
+    }
+    ExecutionPlan::invalidate();
+    return true;
 }
 
 void FunctionBlock::disconnectInput(uint8_t inputNum) {
     IOValue value = inputValue(inputNum);
     clearInputFlag(inputNum, IO_FLAG_REF | IO_FLAG_REF_INVERT | IO_FLAG_CONV_TYPE_MASK);
     setInput(inputNum, value);
+
+    bindInputs();
+    ExecutionPlan::invalidate();
 }
 
 const char* FunctionBlock::getIOTypeString(IO_TYPE ioType)
@@ -166,53 +257,68 @@ const char* FunctionBlock::getIOTypeString(IO_TYPE ioType)
     }
 }
 
-void FunctionBlock::enableMonitoring(bool once) {
+// Returns false if the monitoring buffer could not be allocated
+bool FunctionBlock::enableMonitoring(bool once) {
+    if (!monitoringValues) {
+        const size_t size = 2 * (numInputs + numOutputs) * sizeof(IOValue);
+        monitoringValues = (IOValue*)BlockPool::owner(this).allocate(size);
+        if (monitoringValues == nullptr) return false;
+        memset(monitoringValues, 0, size);
+    }
     if (once) setFuncFlag(FUNC_FLAG_MONITOR_ONCE);
     setFuncFlag(FUNC_FLAG_MONITORING);
-    if (!monitoringValues) monitoringValues = (IOValue*)calloc(sizeof(IOValue), numInputs + numOutputs);
+    return true;
 }
 
 void FunctionBlock::disableMonitoring() {
     clearFuncFlag(FUNC_FLAG_MONITORING || FUNC_FLAG_MONITOR_ONCE);
-    free(monitoringValues);
+    BlockPool::release(monitoringValues);
     monitoringValues = nullptr;
 }
 
 void IRAM_ATTR FunctionBlock::reportMonitoringValues(Link* link) {
     if (!monitoringValues) return;
-    link->monitoringValueHandler(this, monitoringValues, (numInputs + numOutputs) * sizeof(IOValue));
+    link->monitoringValueHandler(this, monitoringSnapshot(), (numInputs + numOutputs) * sizeof(IOValue));
 }
 
 void FunctionBlock::initInput(uint8_t index, bool value) {
+    if (!isValid()) return;
     inputs()[index].u = value;
     inputFlags()[index] = IO_TYPE_BOOL;
 }
 void FunctionBlock::initInput(uint8_t index, uint32_t value) {
+    if (!isValid()) return;
     inputs()[index].u = value;
     inputFlags()[index] = IO_TYPE_UINT;
 }
 void FunctionBlock::initInput(uint8_t index, int32_t value) {
+    if (!isValid()) return;
     inputs()[index].i = value;
     inputFlags()[index] = IO_TYPE_INT;
 }
 void FunctionBlock::initInput(uint8_t index, float value) {
+    if (!isValid()) return;
     inputs()[index].f = value;
     inputFlags()[index] = IO_TYPE_FLOAT;
 }
 
 void FunctionBlock::initOutput(uint8_t index, bool value) {
+    if (!isValid()) return;
     outputs()[index].u = value;
     outputFlags()[index] = IO_TYPE_BOOL;
 }
 void FunctionBlock::initOutput(uint8_t index, uint32_t value) {
+    if (!isValid()) return;
     outputs()[index].u = value;
     outputFlags()[index] = IO_TYPE_UINT;
 }
 void FunctionBlock::initOutput(uint8_t index, int32_t value) {
+    if (!isValid()) return;
     outputs()[index].i = value;
     outputFlags()[index] = IO_TYPE_INT;
 }
 void FunctionBlock::initOutput(uint8_t index, float value) {
+    if (!isValid()) return;
     outputs()[index].f = value;
     outputFlags()[index] = IO_TYPE_FLOAT;
 }
@@ -6,11 +6,13 @@
 #define FUNC_FLAG_MONITORING        (1 << 0)
 #define FUNC_FLAG_MONITOR_ONCE      (1 << 1)
 #define FUNC_FLAG_B2                (1 << 2)
+#define FUNC_FLAG_CONTINUOUS        (1 << 3)    // Time dependent state, run on every cycle in change-driven mode
+#define FUNC_FLAG_NON_CRITICAL      (1 << 4)    // Suspended while the task is degraded by overruns
 
 #define IO_FLAG_TYPE_B0             (1 << 0)
 #define IO_FLAG_TYPE_B1             (1 << 1)
 #define IO_FLAG_TYPE_B2             (1 << 2)
-#define IO_FLAG_BIT3                (1 << 3)
+#define IO_FLAG_FEEDBACK            (1 << 3)    // Connection reads the value of the previous cycle
 #define IO_FLAG_REF                 (1 << 4)
 #define IO_FLAG_REF_INVERT          (1 << 5)
 #define IO_FLAG_REF_CONV_TYPE_B0    (1 << 6)
@@ -51,8 +53,71 @@ union IOValue
     IOValue*    ref;
 };
 
+// Pre-resolved fetch operation of a connected input
+enum INPUT_BINDING_OP
+{
+    BIND_REF,
+    BIND_REF_INVERT,
+    BIND_REF_FLOAT_TO_UINT,
+    BIND_REF_FLOAT_TO_UINT_INVERT,
+    BIND_REF_INT_TO_UINT,
+    BIND_REF_INT_TO_UINT_INVERT,
+    BIND_REF_UINT_TO_INT,
+    BIND_REF_FLOAT_TO_INT,
+    BIND_REF_UINT_TO_FLOAT,
+    BIND_REF_INT_TO_FLOAT,
+    BIND_REF_DECODE_FLAGS
+};
+
+// Connected input binding. Built at connect time from input flags
+struct InputBinding
+{
+    const IOValue*  source;
+    uint8_t         index;
+    uint8_t         op;
+    uint8_t         flags;
+};
+
 inline uint16_t OPCODE(uint8_t libID, uint8_t funcID) { return (libID << 8) + funcID; }
 
+class FunctionBlock;
+class IOArena;
+
+// Non-virtual entry point to a function block run routine
+typedef void (*FunctionKernel)(FunctionBlock* func, IOValue* inputValues, IOValue* outputValues, uint32_t dt);
+
+// IO value of one instance in struct-of-arrays storage. Connections are resolved, so there is no reference
+union LaneValue
+{
+    uint32_t    u;
+    int32_t     i;
+    float       f;
+};
+
+// Run a function for count instances. Each input and output points to an array of count values.
+// Outputs never alias inputs
+typedef void (*InstanceKernel)(const LaneValue* const* inputs, LaneValue* const* outputs, uint8_t numInputs, uint32_t count);
+
+// Execution time of a function in CPU cycles. Circuit times include their nested functions
+struct FunctionProfile
+{
+    uint32_t    calls = 0;
+    uint32_t    lastCycles = 0;
+    uint32_t    minCycles = UINT32_MAX;
+    uint32_t    maxCycles = 0;
+    uint64_t    totalCycles = 0;
+
+    inline void add(uint32_t cycles) {
+        calls++;
+        lastCycles = cycles;
+        if (cycles < minCycles) minCycles = cycles;
+        if (cycles > maxCycles) maxCycles = cycles;
+        totalCycles += cycles;
+    }
+    inline void reset() { *this = FunctionProfile(); }
+    inline float averageCycles() { return calls ? (float)totalCycles / calls : 0.f; }
+};
+
 class FunctionBlock
 {
 public:
@@ -62,10 +127,35 @@ public:
     
     uint32_t flags = 0;
 
+    // Values followed by flags. Allocated from the pool of the block unless packed to an arena
     IOValue* ioValues = nullptr;
     uint8_t* ioFlags = nullptr;
+    // Values captured by the task at a reported cycle, followed by the snapshot read by the link
     IOValue* monitoringValues = nullptr;
 
+#ifdef CTRL_PROFILING
+    // Allocated when the function is compiled into a profiling plan
+    FunctionProfile* profile = nullptr;
+#endif
+
+    // Arena owning IO values and flags. Null when IO is allocated separately
+    IOArena* ioArena = nullptr;
+
+    // Connected inputs. Constant inputs have no binding and are read in place
+    InputBinding* inputBindings = nullptr;
+    uint8_t numInputBindings = 0;
+
+    // Run routine used by compiled execution plans. Defaults to the virtual run()
+    FunctionKernel kernel = &FunctionBlock::virtualKernel;
+
+    // Optional run routine reading connected inputs through input bindings. Gets the input array as is
+    FunctionKernel fusedKernel = nullptr;
+
+    // Revision of the latest constant input write. Change-driven plans run functions written since their previous cycle
+    uint32_t inputRevision = 0;
+    static uint32_t inputWriteRevision;
+    inline void markInputsChanged() { inputRevision = ++inputWriteRevision; }
+
     FunctionBlock(uint8_t numInputs, uint8_t numOutputs, uint16_t opcode);
 
     virtual const char* name() = 0;
@@ -74,6 +164,11 @@ public:
 
     virtual ~FunctionBlock();
 
+    // Function blocks are always allocated from size class slab pools, the shared pool by default
+    static void* operator new(size_t size);
+    static void* operator new(size_t size, void* slot) { return slot; }
+    static void operator delete(void* ptr);
+
     size_t dataSize();
 
     void update(uint32_t dt);
@@ -84,13 +179,29 @@ public:
     // Read all input values to given array. Dereference values if needed
     void readInputValues(IOValue* values);
 
-    void connectInput(uint8_t inputNum, FunctionBlock* sourceFunc, uint8_t outputNum, bool inverted = false);
+    // Rebuild input bindings from input flags. Returns false if bindings could not be allocated
+    bool bindInputs();
+
+    // Return input values for run(). Inputs array is returned as is if no input is connected,
+    // otherwise input values are gathered to given buffer
+    static IOValue* resolveInputs(IOValue* buffer, IOValue* inputs, uint8_t numInputs, const InputBinding* bindings, uint8_t numBindings);
+
+    // Return a referenced value converted according to input flags
+    static IOValue decodeInput(IOValue value, uint8_t flags);
+
+    static void virtualKernel(FunctionBlock* func, IOValue* inputValues, IOValue* outputValues, uint32_t dt);
+
+    // Returns false and leaves the input unconnected if its binding could not be allocated
+    bool connectInput(uint8_t inputNum, FunctionBlock* sourceFunc, uint8_t outputNum, bool inverted = false);
     void disconnectInput(uint8_t inputNum);
 
     inline size_t ioCount() { return numInputs + numOutputs; }
+    // IO storage was allocated. Invalid blocks are only constructed to be deleted
+    inline bool isValid() { return ioValues != nullptr; }
 
     inline IOValue* inputs() { return ioValues; }
     inline IOValue* outputs() { return ioValues + numInputs; }
+    inline IOValue* monitoringSnapshot() { return monitoringValues + numInputs + numOutputs; }
 
     inline uint8_t* inputFlags() { return ioFlags; }
     inline uint8_t* outputFlags() { return ioFlags + numInputs; }
@@ -105,16 +216,23 @@ public:
         return (IO_TYPE)(ioFlags[numInputs + index] & IO_FLAG_TYPE_MASK);
     }
 
+    // Writes changing the value mark the inputs changed
     inline void setInput(uint8_t inputNum, int32_t value) {
+        if (inputs()[inputNum].i != value) markInputsChanged();
         inputs()[inputNum].i = value;
     }
     inline void setInput(uint8_t inputNum, uint32_t value) {
+        if (inputs()[inputNum].u != value) markInputsChanged();
         inputs()[inputNum].u = value;
     }
     inline void setInput(uint8_t inputNum, float value) {
+        IOValue bits;
+        bits.f = value;
+        if (inputs()[inputNum].u != bits.u) markInputsChanged();
         inputs()[inputNum].f = value;
     }
     inline void setInput(uint8_t inputNum, IOValue value) {
+        if (inputs()[inputNum].u != value.u) markInputsChanged();
         inputs()[inputNum] = value;
     }
 
@@ -152,7 +270,7 @@ public:
 
     const char* getIOTypeString(IO_TYPE ioType);
 
-    void enableMonitoring(bool once = false);
+    bool enableMonitoring(bool once = false);
     void disableMonitoring();
 
     void reportMonitoringValues(Link* link);
@@ -166,4 +284,10 @@ public:
     void initOutput(uint8_t index, uint32_t value);
     void initOutput(uint8_t index, int32_t value);
     void initOutput(uint8_t index, float value);
-};
\ No newline at end of file
+};
+
+// Kernel calling Block::run() directly without virtual dispatch
+template<class Block>
+void blockKernel(FunctionBlock* func, IOValue* inputValues, IOValue* outputValues, uint32_t dt) {
+    static_cast<Block*>(func)->Block::run(inputValues, outputValues, dt);
+}
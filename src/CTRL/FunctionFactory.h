@@ -26,12 +26,13 @@ public:
         libs[LIB_ID_TIMERS] =       new TimerLib::Library();
     }
 
-    FunctionBlock* createFunction(uint8_t lib_id, uint8_t func_id, uint8_t numInputs = 0, uint8_t numOutputs = 0)
+    // Blocks are created in the shared pool unless a pool is given, e.g. the pool of the circuit they are created for
+    FunctionBlock* createFunction(uint8_t lib_id, uint8_t func_id, uint8_t numInputs = 0, uint8_t numOutputs = 0, BlockPool* pool = nullptr)
     {
         FunctionLibrary* lib = getFunctionLib(lib_id);
         if (lib == nullptr) return nullptr;
 
-        return lib->createFunction(func_id, numInputs, numOutputs);
+        return lib->createFunction(func_id, numInputs, numOutputs, pool ? *pool : BlockPool::shared());
     }
 };
 
@@ -0,0 +1,134 @@
+#include "FunctionGraph.h"
+#include "Controller.h"
+#include "Circuit.h"
+#include <algorithm>
+#include <queue>
+#include <functional>
+
+struct OutputRange {
+    const IOValue*  begin;
+    const IOValue*  end;
+    uint32_t        node;
+};
+
+struct Edge {
+    uint32_t        producer;
+    uint32_t        consumer;
+    FunctionBlock*  func;
+    uint8_t         input;
+};
+
+// Collect output ranges of a function and functions nested in it
+static void collectOutputs(FunctionBlock* func, uint32_t node, std::vector<OutputRange>& ranges) {
+    if (func->numOutputs) ranges.push_back({ func->outputs(), func->outputs() + func->numOutputs, node });
+    if (func->opcode == OPCODE_CIRCUIT) {
+        for (FunctionBlock* childFunc : ((Circuit*)func)->funcList) collectOutputs(childFunc, node, ranges);
+    }
+}
+
+static int findNode(const std::vector<OutputRange>& ranges, const IOValue* ref) {
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), ref,
+        [](const IOValue* ref, const OutputRange& range) { return ref < range.begin; });
+    if (it == ranges.begin()) return -1;
+    --it;
+    return (ref < it->end) ? it->node : -1;
+}
+
+// Collect connections of a function and functions nested in it. Connections between
+// functions inside a nested circuit are left to the circuit itself
+static void collectEdges(FunctionBlock* func, FunctionBlock* nodeFunc, uint32_t node, const std::vector<OutputRange>& ranges, std::vector<Edge>& edges) {
+    for (size_t i = 0; i < func->numInputs; i++) {
+        if (!(func->inputFlags()[i] & IO_FLAG_REF)) continue;
+        int producer = findNode(ranges, func->inputs()[i].ref);
+        if (producer < 0) continue;
+        if (producer == (int)node && func != nodeFunc) continue;
+        edges.push_back({ (uint32_t)producer, node, func, (uint8_t)i });
+    }
+    if (func->opcode == OPCODE_CIRCUIT) {
+        for (FunctionBlock* childFunc : ((Circuit*)func)->funcList) collectEdges(childFunc, nodeFunc, node, ranges, edges);
+    }
+}
+
+FunctionOrder sortFunctions(std::vector<FunctionBlock*>& funcList, IOValue** outputRefs, size_t numOutputRefs) {
+    const size_t count = funcList.size();
+
+    std::vector<OutputRange> ranges;
+    for (size_t node = 0; node < count; node++) collectOutputs(funcList[node], node, ranges);
+    std::sort(ranges.begin(), ranges.end(), [](const OutputRange& a, const OutputRange& b) { return a.begin < b.begin; });
+
+    std::vector<Edge> edges;
+    for (size_t node = 0; node < count; node++) collectEdges(funcList[node], funcList[node], node, ranges, edges);
+
+    std::vector<uint32_t> inDegree(count, 0);
+    std::vector<std::vector<uint32_t>> consumers(count);
+    for (const Edge& edge : edges) {
+        if (edge.producer == edge.consumer) continue;
+        inDegree[edge.consumer]++;
+        consumers[edge.producer].push_back(edge.consumer);
+    }
+
+    // Kahn's algorithm, lowest original index first. When only cycles remain the first
+    // remaining function is placed and its unresolved connections become feedback
+    std::priority_queue<uint32_t, std::vector<uint32_t>, std::greater<uint32_t>> ready;
+    for (size_t node = 0; node < count; node++) {
+        if (inDegree[node] == 0) ready.push(node);
+    }
+    std::vector<bool> placed(count, false);
+    std::vector<uint32_t> position(count);
+    std::vector<uint32_t> order;
+    size_t firstUnplaced = 0;
+    while (order.size() < count) {
+        if (ready.empty()) {
+            while (placed[firstUnplaced]) firstUnplaced++;
+            inDegree[firstUnplaced] = 0;
+            ready.push(firstUnplaced);
+        }
+        uint32_t node = ready.top();
+        ready.pop();
+        if (placed[node]) continue;
+        placed[node] = true;
+        position[node] = order.size();
+        order.push_back(node);
+        for (uint32_t consumer : consumers[node]) {
+            if (!placed[consumer] && inDegree[consumer] > 0 && --inDegree[consumer] == 0) ready.push(consumer);
+        }
+    }
+
+    // Flag connections reading values produced later in the order (or by the function itself)
+    FunctionOrder result = {};
+    for (const Edge& edge : edges) {
+        if (position[edge.producer] >= position[edge.consumer]) {
+            edge.func->setInputFlag(edge.input, IO_FLAG_FEEDBACK);
+            result.feedbackCount++;
+        }
+        else edge.func->clearInputFlag(edge.input, IO_FLAG_FEEDBACK);
+    }
+
+    // Count one cycle delays on the longest path. Latency through a feedback connection is
+    // estimated from the forward only latency of its producer
+    std::vector<uint32_t> forwardLatency(count, 0);
+    std::vector<uint32_t> latency(count, 0);
+    std::vector<std::vector<const Edge*>> inputEdges(count);
+    for (const Edge& edge : edges) inputEdges[edge.consumer].push_back(&edge);
+    for (uint32_t node : order) {
+        for (const Edge* edge : inputEdges[node]) {
+            if (position[edge->producer] < position[node]) {
+                forwardLatency[node] = std::max(forwardLatency[node], forwardLatency[edge->producer]);
+                latency[node] = std::max(latency[node], latency[edge->producer]);
+            }
+            else if (edge->producer != node) {
+                latency[node] = std::max(latency[node], forwardLatency[edge->producer] + 1);
+            }
+        }
+    }
+    for (size_t i = 0; i < numOutputRefs; i++) {
+        if (outputRefs[i] == nullptr) continue;
+        int producer = findNode(ranges, outputRefs[i]);
+        if (producer >= 0) result.latencyCycles = std::max(result.latencyCycles, latency[producer]);
+    }
+
+    std::vector<FunctionBlock*> sorted;
+    for (uint32_t node : order) sorted.push_back(funcList[node]);
+    funcList.swap(sorted);
+    return result;
+}
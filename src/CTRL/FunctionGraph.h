@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Common.h"
+#include "FunctionBlock.h"
+
+struct FunctionOrder
+{
+    uint32_t    feedbackCount;      // Connections reading a value produced later in the order
+    uint32_t    latencyCycles;      // One cycle delays on the longest path to an output reference
+};
+
+// Sort functions so that producers run before their consumers. Original order is kept where
+// dependencies allow it. Connections closing a cycle are flagged with IO_FLAG_FEEDBACK
+FunctionOrder sortFunctions(std::vector<FunctionBlock*>& funcList, IOValue** outputRefs = nullptr, size_t numOutputRefs = 0);
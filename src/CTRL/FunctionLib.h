@@ -1,5 +1,8 @@
 #pragma once
 
+#include "FunctionBlock.h"
+#include "BlockPool.h"
+
 enum LIBRARY_ID
 {
     LIB_ID_NULL,
@@ -33,5 +36,22 @@ public:
         return funcNames[func_id];
     }
 
-    virtual FunctionBlock* createFunction(uint8_t funcID, uint8_t numInputs, uint8_t numOutputs) = 0;
+    virtual FunctionBlock* createFunction(uint8_t funcID, uint8_t numInputs, uint8_t numOutputs, BlockPool& pool) = 0;
+
+protected:
+
+    // Construct a function block in a pool slot and bind its non-virtual run kernel for execution plans.
+    // Returns nullptr if the pool can not hold the block or its IO storage
+    template<class Block, typename... Args>
+    FunctionBlock* create(BlockPool& pool, Args... args) {
+        void* slot = pool.allocate(sizeof(Block));
+        if (slot == nullptr) return nullptr;
+        Block* func = new (slot) Block(args...);
+        if (!func->isValid()) {
+            delete func;
+            return nullptr;
+        }
+        func->kernel = &blockKernel<Block>;
+        return func;
+    }
 };
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Common.h"
+
+// Hardware abstraction of the controller platform. Implemented by HAL_ESP32.cpp on target
+// and by host/HAL_Linux.cpp for native builds
+
+#ifndef ARDUINO
+    // Functions are placed in instruction RAM only on target
+    #define IRAM_ATTR
+#endif
+
+// Object reference in link messages
+typedef uint32_t ptr32_t;
+
+// Number of controller workers with their own wake-up
+#define HAL_MAX_WORKERS 8
+// Wake-up of the link processing thread, after the worker wake-ups
+#define HAL_WAKEUP_LINK HAL_MAX_WORKERS
+#define HAL_WAKEUP_COUNT (HAL_MAX_WORKERS + 1)
+
+namespace HAL
+{
+    // Microseconds since start
+    Time        time();
+
+    uint32_t    freeHeap();
+    uint32_t    maxAllocHeap();
+    uint32_t    cpuFreqMHz();
+    int8_t      RSSI();
+
+    // CPU cycle counter, wraps around
+    uint32_t    cycleCount();
+
+    // Block calling controller worker or the link thread until given time or until woken. The last
+    // spin_us microseconds before the deadline are busy waited for precise release times
+    void        waitUntil(uint8_t index, Time deadline, uint32_t spin_us = 0);
+    // Return the waiter from waitUntil. A wake-up before the waiter waits is kept pending
+    void        wake(uint8_t index);
+
+    // Debug output
+    void        log(const char* format, ...);
+
+    // Link message references. On target these are memory addresses. On 64-bit hosts objects
+    // are registered in a handle table, where the low 12 bits of a handle are an offset to the object
+    ptr32_t     toPtr32(const void* pointer);
+    void*       fromPtr32(ptr32_t handle);
+    bool        isValidPtr32(ptr32_t handle);
+    // Drop handles of objects in freed memory. Dropped handles are invalid until reused
+    void        releasePtr32(const void* begin, size_t size);
+}
@@ -0,0 +1,107 @@
+#ifdef ARDUINO
+
+#include "HAL.h"
+#include "Esp.h"
+#include "WiFi.h"
+#include "esp_timer.h"
+#include <stdarg.h>
+#include <atomic>
+
+#define ADDRESS_MIN 0x3F400000
+#define ADDRESS_MAX 0x50002000
+
+// Worker task notification bits
+#define WAKEUP_BIT_TIMER    (1 << 0)
+#define WAKEUP_BIT_WAKE     (1 << 1)
+
+namespace HAL
+{
+
+Time IRAM_ATTR time()       { return esp_timer_get_time(); }
+
+uint32_t freeHeap()         { return ESP.getFreeHeap(); }
+uint32_t maxAllocHeap()     { return ESP.getMaxAllocHeap(); }
+uint32_t cpuFreqMHz()       { return ESP.getCpuFreqMHz(); }
+int8_t RSSI()               { return WiFi.RSSI(); }
+
+uint32_t IRAM_ATTR cycleCount() { return ESP.getCycleCount(); }
+
+// Waiting task is registered on its first wait. Wake-ups are latched in pending, so a wake-up
+// before the first wait or while the task runs ends the next wait
+struct Wakeup {
+    std::atomic<TaskHandle_t>   task;
+    std::atomic<bool>           pending;
+    esp_timer_handle_t          timer;
+};
+
+static Wakeup wakeups[HAL_WAKEUP_COUNT] = {};
+
+static void IRAM_ATTR onWakeupTimer(void* arg) {
+    xTaskNotify(((Wakeup*)arg)->task.load(), WAKEUP_BIT_TIMER, eSetBits);
+}
+
+void IRAM_ATTR waitUntil(uint8_t index, Time deadline, uint32_t spin_us) {
+    Wakeup& wakeup = wakeups[index];
+    if (!wakeup.timer) {
+        wakeup.task.store(xTaskGetCurrentTaskHandle());
+        const esp_timer_create_args_t args = {
+            .callback           = &onWakeupTimer,
+            .arg                = &wakeup,
+            .dispatch_method    = ESP_TIMER_TASK,
+            .name               = "CTRL wakeup"
+        };
+        esp_timer_create(&args, &wakeup.timer);
+    }
+    // Task is registered before pending is read, so a wake-up either sets pending here or notifies the task
+    if (wakeup.pending.exchange(false)) {
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, 0);
+        return;
+    }
+    const Time sleepUntil = (deadline > spin_us) ? deadline - spin_us : 0;
+    Time now = time();
+    if (now < sleepUntil && deadline != UINT64_MAX) esp_timer_start_once(wakeup.timer, sleepUntil - now);
+    // Timer bits left from an earlier wait do not end this one
+    while (now < sleepUntil) {
+        uint32_t bits = 0;
+        xTaskNotifyWait(0, UINT32_MAX, &bits, portMAX_DELAY);
+        if (bits & WAKEUP_BIT_WAKE) {
+            esp_timer_stop(wakeup.timer);
+            wakeup.pending.store(false);
+            return;
+        }
+        now = time();
+    }
+    while (time() < deadline) {
+        uint32_t bits = 0;
+        if (xTaskNotifyWait(0, UINT32_MAX, &bits, 0) && (bits & WAKEUP_BIT_WAKE)) {
+            wakeup.pending.store(false);
+            return;
+        }
+    }
+}
+
+void IRAM_ATTR wake(uint8_t index) {
+    Wakeup& wakeup = wakeups[index];
+    wakeup.pending.store(true);
+    TaskHandle_t task = wakeup.task.load();
+    if (task) xTaskNotify(task, WAKEUP_BIT_WAKE, eSetBits);
+}
+
+void log(const char* format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    Serial.print(buffer);
+}
+
+ptr32_t toPtr32(const void* pointer)    { return (ptr32_t)pointer; }
+void* fromPtr32(ptr32_t handle)         { return (void*)handle; }
+bool isValidPtr32(ptr32_t handle)       { return handle >= ADDRESS_MIN && handle < ADDRESS_MAX; }
+void releasePtr32(const void* begin, size_t size) {}
+
+}
+
+#endif
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Common.h"
+
+#define HISTOGRAM_BUCKETS           64
+#define HISTOGRAM_SUB_BUCKET_BITS   2
+
+// Fixed size log-linear histogram of microsecond values. Values below 4 have their own buckets,
+// every power of two above is split in 4 buckets. Values beyond the range count in the last bucket
+struct Histogram
+{
+    uint32_t    counts[HISTOGRAM_BUCKETS] = {};
+    uint32_t    count = 0;
+    uint32_t    maxValue = 0;
+
+    static inline uint32_t bucket(uint32_t value) {
+        const uint32_t subBuckets = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+        if (value < subBuckets) return value;
+        const uint32_t octave = 31 - __builtin_clz(value);
+        const uint32_t sub = (value >> (octave - HISTOGRAM_SUB_BUCKET_BITS)) & (subBuckets - 1);
+        const uint32_t index = subBuckets + (octave - HISTOGRAM_SUB_BUCKET_BITS) * subBuckets + sub;
+        return (index < HISTOGRAM_BUCKETS) ? index : HISTOGRAM_BUCKETS - 1;
+    }
+
+    // Smallest value counted in a bucket
+    static inline uint32_t lowerBound(uint32_t index) {
+        const uint32_t subBuckets = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+        if (index < subBuckets) return index;
+        const uint32_t octave = (index - subBuckets) / subBuckets;
+        const uint32_t sub = (index - subBuckets) % subBuckets;
+        return (subBuckets + sub) << octave;
+    }
+
+    inline void add(uint32_t value) {
+        counts[bucket(value)]++;
+        count++;
+        if (value > maxValue) maxValue = value;
+    }
+
+    inline void reset() { *this = Histogram(); }
+
+    // Upper bound of the bucket holding given fraction of values
+    uint32_t percentile(float fraction) {
+        const uint32_t target = (uint32_t)(fraction * count + 0.5f);
+        uint32_t sum = 0;
+        for (uint32_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+            sum += counts[i];
+            if (sum >= target && sum > 0) return (i + 1 < HISTOGRAM_BUCKETS) ? std::min(lowerBound(i + 1) - 1, maxValue) : maxValue;
+        }
+        return maxValue;
+    }
+};
@@ -0,0 +1,189 @@
+#include "IOArena.h"
+#include "Controller.h"
+#include "CyclicTask.h"
+#include "Circuit.h"
+#include "BlockPool.h"
+#include "HAL.h"
+#include <algorithm>
+
+uint32_t IOArena::layoutRevision = 1;
+
+IOArena::IOArena(Controller* controller) : controller (controller) {}
+
+IOArena::~IOArena() {
+    detachAll();
+}
+
+static size_t valuesSize(FunctionBlock* func) { return func->ioCount() * sizeof(IOValue); }
+static size_t flagsSize(FunctionBlock* func)  { return func->ioCount() * sizeof(uint8_t); }
+
+bool IOArena::pack(const std::vector<FunctionBlock*>& planFuncs) {
+    // Functions hosted by another arena are left where they are
+    std::vector<FunctionBlock*> funcs;
+    for (FunctionBlock* func : planFuncs) {
+        if (func->ioArena == nullptr || func->ioArena == this) funcs.push_back(func);
+    }
+    // Keep current layout if plan functions are unchanged and nothing has been released
+    if (releasedSize == 0 && funcs == members) return false;
+
+    uint32_t freeHeapBefore = controller->freeHeap();
+    uint32_t maxAllocBefore = controller->maxAllocHeap();
+
+    // Functions no longer in the plan get their own storage back from their pool. Without storage they stay in the arena
+    std::vector<FunctionBlock*> leaving;
+    std::vector<IOValue*> leavingStorage;
+    for (FunctionBlock* func : members) {
+        if (std::find(funcs.begin(), funcs.end(), func) != funcs.end()) continue;
+        IOValue* storage = (IOValue*)BlockPool::owner(func).allocate(valuesSize(func) + flagsSize(func));
+        if (storage == nullptr) {
+            funcs.push_back(func);
+            continue;
+        }
+        leaving.push_back(func);
+        leavingStorage.push_back(storage);
+    }
+
+    // Values first in execution order, flags after all values
+    size_t valuesTotal = 0;
+    size_t flagsTotal = 0;
+    for (FunctionBlock* func : funcs) {
+        valuesTotal += valuesSize(func);
+        flagsTotal += flagsSize(func);
+    }
+    uint8_t* newMemory = (valuesTotal + flagsTotal) ? (uint8_t*)malloc(valuesTotal + flagsTotal) : nullptr;
+    if (valuesTotal + flagsTotal > 0 && newMemory == nullptr) {
+        for (IOValue* storage : leavingStorage) BlockPool::release(storage);
+        return false;
+    }
+
+    relocations.clear();
+    std::vector<IOValue*> oldStorage;
+    std::vector<size_t> oldStorageSize;
+
+    for (size_t i = 0; i < leaving.size(); i++) {
+        FunctionBlock* func = leaving[i];
+        IOValue* values = leavingStorage[i];
+        uint8_t* flags = (uint8_t*)(values + func->ioCount());
+        memcpy(values, func->ioValues, valuesSize(func));
+        memcpy(flags, func->ioFlags, flagsSize(func));
+        addRelocation(func, values);
+        func->ioValues = values;
+        func->ioFlags = flags;
+        func->ioArena = nullptr;
+    }
+
+    // Copy plan functions to the new arena
+    IOValue* values = (IOValue*)newMemory;
+    uint8_t* flags = newMemory + valuesTotal;
+    for (FunctionBlock* func : funcs) {
+        memcpy(values, func->ioValues, valuesSize(func));
+        memcpy(flags, func->ioFlags, flagsSize(func));
+        addRelocation(func, values);
+        if (func->ioArena == nullptr) {
+            oldStorage.push_back(func->ioValues);
+            oldStorageSize.push_back(valuesSize(func) + flagsSize(func));
+        }
+        func->ioValues = values;
+        func->ioFlags = flags;
+        func->ioArena = this;
+        values += func->ioCount();
+        flags += func->ioCount();
+    }
+
+    relocateReferences();
+
+    // Link handles to moved storage are dropped with it
+    for (size_t i = 0; i < oldStorage.size(); i++) {
+        HAL::releasePtr32(oldStorage[i], oldStorageSize[i]);
+        BlockPool::release(oldStorage[i]);
+    }
+    HAL::releasePtr32(memory, memorySize);
+    free(memory);
+    memory = newMemory;
+    memorySize = valuesTotal + flagsTotal;
+    releasedSize = 0;
+    members = funcs;
+
+    controller->lastCompaction = {
+        .freeHeapBefore = freeHeapBefore,
+        .maxAllocBefore = maxAllocBefore,
+        .freeHeapAfter  = controller->freeHeap(),
+        .maxAllocAfter  = controller->maxAllocHeap()
+    };
+
+    // Compiled plans, input bindings and link clients hold pointers to the old storage
+    ExecutionPlan::invalidate();
+    layoutRevision++;
+    return true;
+}
+
+void IOArena::release(FunctionBlock* func) {
+    for (size_t i = 0; i < members.size(); i++) {
+        if (members.at(i) == func) {
+            members.erase(members.begin() + i);
+            releasedSize += valuesSize(func) + flagsSize(func);
+            break;
+        }
+    }
+    func->ioArena = nullptr;
+    func->ioValues = nullptr;
+    func->ioFlags = nullptr;
+}
+
+void IOArena::detachAll() {
+    pack(std::vector<FunctionBlock*>());
+    // Functions that got no storage of their own still live in the arena memory
+    if (!members.empty()) return;
+    HAL::releasePtr32(memory, memorySize);
+    free(memory);
+    memory = nullptr;
+    memorySize = 0;
+}
+
+void IOArena::addRelocation(FunctionBlock* func, IOValue* newValues) {
+    Relocation relocation = {
+        .begin  = func->outputs(),
+        .end    = func->outputs() + func->numOutputs,
+        .target = newValues + func->numInputs
+    };
+    if (relocation.begin != relocation.end) relocations.push_back(relocation);
+}
+
+IOValue* IOArena::relocate(IOValue* ref) {
+    auto it = std::upper_bound(relocations.begin(), relocations.end(), ref,
+        [](IOValue* ref, const Relocation& relocation) { return ref < relocation.begin; });
+    if (it == relocations.begin()) return ref;
+    --it;
+    return (ref < it->end) ? it->target + (ref - it->begin) : ref;
+}
+
+void IOArena::relocateReferences() {
+    std::sort(relocations.begin(), relocations.end(),
+        [](const Relocation& a, const Relocation& b) { return a.begin < b.begin; });
+
+    std::vector<FunctionBlock*> stack(controller->funcList.begin(), controller->funcList.end());
+    for (CyclicTask* task : controller->tasks) {
+        stack.insert(stack.end(), task->funcList.begin(), task->funcList.end());
+    }
+    while (!stack.empty()) {
+        FunctionBlock* func = stack.back();
+        stack.pop_back();
+        bool relocated = false;
+        for (size_t i = 0; i < func->numInputs; i++) {
+            if (!(func->inputFlags()[i] & IO_FLAG_REF)) continue;
+            IOValue* ref = relocate(func->inputs()[i].ref);
+            if (ref != func->inputs()[i].ref) {
+                func->inputs()[i].ref = ref;
+                relocated = true;
+            }
+        }
+        if (relocated) func->bindInputs();
+        if (func->opcode == OPCODE_CIRCUIT) {
+            Circuit* circ = (Circuit*)func;
+            for (size_t i = 0; i < circ->numOutputs; i++) {
+                if (circ->outputRefs[i]) circ->outputRefs[i] = relocate(circ->outputRefs[i]);
+            }
+            stack.insert(stack.end(), circ->funcList.begin(), circ->funcList.end());
+        }
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Common.h"
+#include "FunctionBlock.h"
+#include "ExecutionPlan.h"
+
+class Controller;
+
+// Single allocation holding IO values and flags of all functions in an execution plan.
+// Values are laid out in execution order so that producer outputs sit next to consumer inputs
+class IOArena
+{
+    struct Relocation {
+        IOValue*    begin;
+        IOValue*    end;
+        IOValue*    target;
+    };
+
+    Controller* controller;
+    uint8_t*    memory = nullptr;
+    size_t      memorySize = 0;
+    size_t      releasedSize = 0;
+
+    std::vector<FunctionBlock*> members;
+    std::vector<Relocation> relocations;
+
+    void addRelocation(FunctionBlock* func, IOValue* newValues);
+    void relocateReferences();
+    IOValue* relocate(IOValue* ref);
+
+public:
+    IOArena(Controller* controller);
+    ~IOArena();
+
+    // Lay out IO storage of functions in execution order. Returns true if IO storage was moved,
+    // which invalidates the plans. Pack before compiling the plans of the moved functions
+    bool pack(const std::vector<FunctionBlock*>& planFuncs);
+
+    // Release storage of a deleted function. Space is reclaimed on next pack
+    void release(FunctionBlock* func);
+
+    // Move all functions back to storage of their own
+    void detachAll();
+
+    // Changes whenever IO storage of a function moves or is freed. Link memory requests name the
+    // revision their pointers were read at and are rejected after a change
+    static uint32_t layoutRevision;
+
+    inline size_t size() { return memorySize; }
+    inline size_t freeSize() { return releasedSize; }
+};
@@ -0,0 +1,274 @@
+#include "InstancedCircuit.h"
+#include "Circuit.h"
+#include "Controller.h"
+#include "ExecutionPlan.h"
+#include "FunctionLib.h"
+#include "FuncLibs/MathLib.h"
+#include "FuncLibs/LogicLib.h"
+#include <map>
+
+// Nested circuit outputs follow their references
+static void circuitOutputKernel(const LaneValue* const* inputs, LaneValue* const* outputs, uint8_t numInputs, uint32_t count) {
+    for (uint8_t i = 0; i < numInputs; i++) {
+        memcpy(outputs[i], inputs[i], count * sizeof(LaneValue));
+    }
+}
+
+// Struct-of-arrays kernel of a function. Returns nullptr if the function has none
+static InstanceKernel instanceKernel(uint16_t opcode) {
+    const uint8_t libID = opcode >> 8;
+    const uint8_t funcID = opcode & 0xFF;
+    if (libID == LIB_ID_MATH) {
+        switch (funcID) {
+            case MathLib::FUNC_ID_ADD: return &MathLib::ADD::runInstances;
+            case MathLib::FUNC_ID_MUL: return &MathLib::MUL::runInstances;
+            case MathLib::FUNC_ID_DIV: return &MathLib::DIV::runInstances;
+            case MathLib::FUNC_ID_SIN: return &MathLib::SIN::runInstances;
+        }
+    }
+    if (libID == LIB_ID_LOGIC) {
+        switch (funcID) {
+            case LogicLib::FUNC_ID_AND: return &LogicLib::AND::runInstances;
+            case LogicLib::FUNC_ID_OR:  return &LogicLib::OR::runInstances;
+        }
+    }
+    return nullptr;
+}
+
+InstancedCircuit::InstancedCircuit(Circuit* definition, uint32_t instanceCount) :
+    definition (definition),
+    instanceCount (instanceCount)
+{}
+
+uint32_t InstancedCircuit::addColumn(std::vector<IOValue>& initialValues, IOValue value) {
+    initialValues.push_back(value);
+    return columnCount++;
+}
+
+// Function IO identified by function and IO index. Kept over recompiles to preserve instance values
+typedef std::pair<FunctionBlock*, uint8_t> IOKey;
+
+bool InstancedCircuit::compile() {
+    if (!definition->plan.isValid()) definition->compile();
+    const std::vector<Instruction>& instructions = definition->plan.instructions;
+
+    // Functions with internal state would share it between instances
+    for (const Instruction& instr : instructions) {
+        if (instr.func->flags & FUNC_FLAG_CONTINUOUS) {
+            compiledRevision = 0;
+            return false;
+        }
+    }
+
+    // Columns of the previous layout
+    std::map<IOKey, uint32_t> previousColumns;
+    for (const Step& step : steps) {
+        for (uint8_t i = 0; i < step.numInputs; i++) previousColumns[{ step.func, i }] = inputColumns[step.firstInput + i];
+        for (uint8_t o = 0; o < step.numOutputs; o++) previousColumns[{ step.func, step.numInputs + o }] = outputColumns[step.firstOutput + o];
+    }
+    std::vector<LaneValue> previousLanes;
+    previousLanes.swap(lanes);
+    const uint32_t previousStride = stride;
+
+    steps.clear();
+    copies.clear();
+    inputColumns.clear();
+    outputColumns.clear();
+    circuitOutputs.clear();
+    columnCount = 0;
+    std::vector<IOValue> initialValues;
+    std::map<IOKey, uint32_t> keyColumns;
+
+    // Every output has a column
+    std::map<const IOValue*, uint32_t> producedColumns;
+    for (const Instruction& instr : instructions) {
+        for (uint8_t o = 0; o < instr.numOutputs; o++) {
+            uint32_t column = addColumn(initialValues, instr.outputs[o]);
+            producedColumns[&instr.outputs[o]] = column;
+            keyColumns[{ instr.func, instr.numInputs + o }] = column;
+        }
+    }
+
+    size_t maxIOCount = 0;
+    for (const Instruction& instr : instructions) {
+        const bool isCircuit = (instr.opcode == OPCODE_CIRCUIT);
+        Step step = {
+            .instanceKernel = isCircuit ? &circuitOutputKernel : instanceKernel(instr.opcode),
+            .kernel         = instr.func->kernel,
+            .func           = instr.func,
+            .firstInput     = (uint32_t)inputColumns.size(),
+            .firstOutput    = (uint32_t)outputColumns.size(),
+            .firstCopy      = (uint32_t)copies.size(),
+            .numCopies      = 0,
+            .numInputs      = isCircuit ? instr.numOutputs : instr.numInputs,
+            .numOutputs     = instr.numOutputs
+        };
+        for (uint8_t o = 0; o < instr.numOutputs; o++) {
+            outputColumns.push_back(producedColumns[&instr.outputs[o]]);
+        }
+        auto isOwnOutput = [&](uint32_t column) {
+            for (uint8_t o = 0; o < step.numOutputs; o++) {
+                if (outputColumns[step.firstOutput + o] == column) return true;
+            }
+            return false;
+        };
+
+        for (uint8_t i = 0; i < step.numInputs; i++) {
+            const IOValue* ref = nullptr;
+            uint8_t flags = 0;
+            if (isCircuit) {
+                // Nested circuit inputs are the output references
+                Circuit* nested = (Circuit*)instr.func;
+                ref = nested->outputRefs[i] ? nested->outputRefs[i] : &instr.outputs[i];
+            } else {
+                for (uint8_t b = 0; b < instr.numInputBindings; b++) {
+                    const InputBinding& binding = instr.inputBindings[b];
+                    if (binding.index != i) continue;
+                    ref = binding.source;
+                    if (binding.op != BIND_REF) flags = binding.flags;
+                }
+            }
+            uint32_t column;
+            if (!ref) {
+                // Constant input is a per instance parameter
+                column = addColumn(initialValues, instr.inputs[i]);
+                keyColumns[{ instr.func, i }] = column;
+            } else {
+                auto produced = producedColumns.find(ref);
+                if (produced == producedColumns.end()) {
+                    // Value outside the definition is shared by all instances
+                    column = addColumn(initialValues, *ref);
+                    copies.push_back({ .external = ref, .source = 0, .target = column, .flags = flags });
+                } else if (flags || isOwnOutput(produced->second)) {
+                    column = addColumn(initialValues, *ref);
+                    copies.push_back({ .external = nullptr, .source = produced->second, .target = column, .flags = flags });
+                } else {
+                    column = produced->second;
+                }
+            }
+            inputColumns.push_back(column);
+        }
+        step.numCopies = copies.size() - step.firstCopy;
+        maxIOCount = std::max(maxIOCount, (size_t)(step.numInputs + step.numOutputs));
+        steps.push_back(step);
+    }
+
+    // Circuit outputs
+    for (uint8_t o = 0; o < definition->numOutputs; o++) {
+        const IOValue* ref = definition->outputRefs[o];
+        if (!ref) ref = &definition->outputs()[o];
+        auto produced = producedColumns.find(ref);
+        if (produced == producedColumns.end()) circuitOutputs.push_back({ .external = ref, .source = 0, .target = 0, .flags = 0 });
+        else circuitOutputs.push_back({ .external = nullptr, .source = produced->second, .target = 0, .flags = 0 });
+    }
+
+    // Columns are padded to full vectors of instances
+    stride = (instanceCount + 15) & ~15U;
+    lanes.resize(columnCount * stride);
+    for (uint32_t c = 0; c < columnCount; c++) {
+        LaneValue* values = column(c);
+        for (uint32_t n = 0; n < instanceCount; n++) values[n].u = initialValues[c].u;
+    }
+    for (const auto& key : keyColumns) {
+        auto previous = previousColumns.find(key.first);
+        if (previous == previousColumns.end()) continue;
+        memcpy(column(key.second), &previousLanes[previous->second * previousStride], instanceCount * sizeof(LaneValue));
+    }
+
+    inputPointers.resize(inputColumns.size());
+    for (size_t i = 0; i < inputColumns.size(); i++) inputPointers[i] = column(inputColumns[i]);
+    outputPointers.resize(outputColumns.size());
+    for (size_t i = 0; i < outputColumns.size(); i++) outputPointers[i] = column(outputColumns[i]);
+    scalarBuffer.assign(maxIOCount, {});
+
+    compiledRevision = ExecutionPlan::revision;
+    return true;
+}
+
+bool InstancedCircuit::isValid() {
+    return compiledRevision == ExecutionPlan::revision && definition->plan.isValid();
+}
+
+void InstancedCircuit::copyInput(const InputCopy& copy) {
+    LaneValue* target = column(copy.target);
+    if (copy.external) {
+        IOValue value = copy.flags ? FunctionBlock::decodeInput(*copy.external, copy.flags) : *copy.external;
+        for (uint32_t n = 0; n < instanceCount; n++) target[n].u = value.u;
+        return;
+    }
+    const LaneValue* source = column(copy.source);
+    if (!copy.flags) {
+        memcpy(target, source, instanceCount * sizeof(LaneValue));
+        return;
+    }
+    for (uint32_t n = 0; n < instanceCount; n++) {
+        IOValue value = {};
+        value.u = source[n].u;
+        target[n].u = FunctionBlock::decodeInput(value, copy.flags).u;
+    }
+}
+
+// Run the scalar kernel once per instance
+void InstancedCircuit::runScalar(const Step& step, uint32_t dt) {
+    IOValue* inputValues = scalarBuffer.data();
+    IOValue* outputValues = inputValues + step.numInputs;
+    const LaneValue* const* inputs = &inputPointers[step.firstInput];
+    LaneValue* const* outputs = &outputPointers[step.firstOutput];
+    for (uint32_t n = 0; n < instanceCount; n++) {
+        for (uint8_t i = 0; i < step.numInputs; i++) inputValues[i].u = inputs[i][n].u;
+        for (uint8_t o = 0; o < step.numOutputs; o++) outputValues[o].u = outputs[o][n].u;
+        step.kernel(step.func, inputValues, outputValues, dt);
+        for (uint8_t o = 0; o < step.numOutputs; o++) outputs[o][n].u = outputValues[o].u;
+    }
+}
+
+bool InstancedCircuit::run(uint32_t dt) {
+    if (!isValid() && !compile()) return false;
+    for (const Step& step : steps) {
+        for (uint32_t c = step.firstCopy; c < step.firstCopy + step.numCopies; c++) copyInput(copies[c]);
+        if (step.instanceKernel) step.instanceKernel(&inputPointers[step.firstInput], &outputPointers[step.firstOutput], step.numInputs, instanceCount);
+        else runScalar(step, dt);
+    }
+    return true;
+}
+
+const InstancedCircuit::Step* InstancedCircuit::findStep(FunctionBlock* func) {
+    for (const Step& step : steps) {
+        if (step.func == func) return &step;
+    }
+    return nullptr;
+}
+
+bool InstancedCircuit::setInput(uint32_t instance, FunctionBlock* func, uint8_t input, IOValue value) {
+    if (!isValid() && !compile()) return false;
+    const Step* step = findStep(func);
+    if (!step || instance >= instanceCount || input >= step->numInputs || func->opcode == OPCODE_CIRCUIT) return false;
+    if (func->inputFlags()[input] & IO_FLAG_REF) return false;
+    column(inputColumns[step->firstInput + input])[instance].u = value.u;
+    return true;
+}
+
+IOValue InstancedCircuit::inputValue(uint32_t instance, FunctionBlock* func, uint8_t input) {
+    IOValue value = {};
+    const Step* step = findStep(func);
+    if (!step || instance >= instanceCount || input >= step->numInputs) return value;
+    value.u = inputPointers[step->firstInput + input][instance].u;
+    return value;
+}
+
+IOValue InstancedCircuit::outputValue(uint32_t instance, FunctionBlock* func, uint8_t output) {
+    IOValue value = {};
+    const Step* step = findStep(func);
+    if (!step || instance >= instanceCount || output >= step->numOutputs) return value;
+    value.u = outputPointers[step->firstOutput + output][instance].u;
+    return value;
+}
+
+IOValue InstancedCircuit::circuitOutputValue(uint32_t instance, uint8_t output) {
+    IOValue value = {};
+    if (instance >= instanceCount || output >= circuitOutputs.size()) return value;
+    const InputCopy& source = circuitOutputs[output];
+    if (source.external) value.u = source.external->u;
+    else value.u = column(source.source)[instance].u;
+    return value;
+}
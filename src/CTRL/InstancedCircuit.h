@@ -0,0 +1,77 @@
+#pragma once
+
+#include "Common.h"
+#include "FunctionBlock.h"
+
+class Circuit;
+
+// Multiple instances of one circuit definition run in lockstep. IO values are stored as columns
+// holding the value of every instance, so struct-of-arrays kernels process all instances in one
+// pass. Functions without such a kernel are run instance by instance with their scalar kernel
+class InstancedCircuit
+{
+    // Function of the definition
+    struct Step {
+        InstanceKernel  instanceKernel;
+        FunctionKernel  kernel;
+        FunctionBlock*  func;
+        uint32_t        firstInput;
+        uint32_t        firstOutput;
+        uint32_t        firstCopy;
+        uint32_t        numCopies;
+        uint8_t         numInputs;
+        uint8_t         numOutputs;
+    };
+
+    // Input value fetched to a column of its own before the step runs
+    struct InputCopy {
+        const IOValue*  external;
+        uint32_t        source;
+        uint32_t        target;
+        uint8_t         flags;
+    };
+
+    Circuit* definition;
+
+    std::vector<Step>       steps;
+    std::vector<InputCopy>  copies;
+    std::vector<uint32_t>   inputColumns;
+    std::vector<uint32_t>   outputColumns;
+    std::vector<InputCopy>  circuitOutputs;
+
+    std::vector<LaneValue>  lanes;
+    std::vector<const LaneValue*> inputPointers;
+    std::vector<LaneValue*> outputPointers;
+    std::vector<IOValue>    scalarBuffer;
+
+    uint32_t columnCount = 0;
+    uint32_t stride = 0;
+    uint32_t compiledRevision = 0;
+
+    inline LaneValue* column(uint32_t index) { return &lanes[index * stride]; }
+    uint32_t addColumn(std::vector<IOValue>& initialValues, IOValue value);
+    const Step* findStep(FunctionBlock* func);
+    void copyInput(const InputCopy& copy);
+    void runScalar(const Step& step, uint32_t dt);
+
+public:
+    const uint32_t instanceCount;
+
+    InstancedCircuit(Circuit* definition, uint32_t instanceCount);
+
+    // Build column storage from the definition. Instance values of functions still in the definition are
+    // kept, new functions start from definition values. Returns false if the definition has functions
+    // with internal state, which can not be instanced
+    bool compile();
+
+    bool isValid();
+
+    // Run one cycle of all instances. Definition is compiled first if it has changed
+    bool run(uint32_t dt);
+
+    // Per instance parameters. Connected inputs can not be set
+    bool setInput(uint32_t instance, FunctionBlock* func, uint8_t input, IOValue value);
+    IOValue inputValue(uint32_t instance, FunctionBlock* func, uint8_t input);
+    IOValue outputValue(uint32_t instance, FunctionBlock* func, uint8_t output);
+    IOValue circuitOutputValue(uint32_t instance, uint8_t output);
+};
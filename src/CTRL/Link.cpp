@@ -2,7 +2,11 @@
 #include "FunctionBlock.h"
 #include "Circuit.h"
 #include "CyclicTask.h"
-#include "Esp.h"
+#include "ExecutionPlan.h"
+#include "BlockPool.h"
+#include "TraceRecorder.h"
+#include "HAL.h"
+#include <math.h>
 
 #define LOG_INFO 0
 
@@ -20,6 +24,7 @@ Link::~Link() {
 
 void Link::connected() {
     isConnected = true;
+    keyframePending = true;
     MsgResponseHeader_t response {
         .msgType    = MSG_TYPE_PING,
         .msgID      = 0,
@@ -39,41 +44,117 @@ void Link::disconnected() {
     }
 }
 
+// Copy a received request to the ingress buffer. Called from the network task, without allocation
 void Link::receiveData(void* data, size_t len) {
     if (len < sizeof(MsgRequestHeader_t)) return;
-    void* store = malloc(len);
-    memcpy(store, data, len);
-    RequestData_t cmd = {
-        .data = store,
-        .size = len
-    };
-    if (!dataQueue.push(cmd)) {
-        Serial.println("Link command buffer full!");
+    receivedRequests.fetch_add(1, std::memory_order_relaxed);
+    uint8_t* record = ingress.reserve(len);
+    if (!record) {
+        MsgRequestHeader_t request;
+        memcpy(&request, data, sizeof(request));
+        droppedRequests.fetch_add(1, std::memory_order_relaxed);
+        rejectedRequests.push(request);
+        return;
+    }
+    memcpy(record, data, len);
+    ingress.commit();
+}
+
+// Requests reading program data run alongside the workers. Modifying requests wait for all
+// workers to finish their cycle and are applied between cycles
+static bool isModifyingRequest(const MsgRequest_t* msg) {
+    switch (msg->header.msgType) {
+        case MSG_TYPE_PING:
+        case MSG_TYPE_CONTROLLER_INFO:
+        case MSG_TYPE_TASK_INFO:
+        case MSG_TYPE_CIRCUIT_INFO:
+        case MSG_TYPE_FUNCTION_INFO:
+        case MSG_TYPE_GET_MEM_DATA:
+        case MSG_TYPE_LINK_STATUS:
+        // Link state only
+        case MSG_TYPE_MONITORING_SET_MODE:
+        case MSG_TYPE_MONITORING_SET_DEADBAND:
+            return false;
+        // Non-zero payload resets statistics
+        case MSG_TYPE_FUNCTION_PROFILE:
+        case MSG_TYPE_TASK_TIMING_STATS:
+            return msg->payload;
+        default:
+            return true;
     }
 }
 
-void Link::processData() {
-    while (!dataQueue.wasEmpty()) {
-        RequestData_t* cmd = dataQueue.pop();
-        handleRequest(cmd->data, cmd->size);
-        free(cmd->data);
+// Handle queued requests in place until the time budget is used. Returns true if requests are left
+bool Link::processData(uint32_t budget_us) {
+    const Time start = HAL::time();
+    answerDroppedRequests();
+    uint8_t* data;
+    size_t len;
+    while (HAL::time() - start < budget_us && (data = ingress.read(len))) {
+        // Requests without payload are read from a zero-filled copy
+        MsgRequest_t shortRequest {};
+        if (len < sizeof(MsgRequest_t)) data = (uint8_t*)memcpy(&shortRequest, data, len);
+        programLocked = isModifyingRequest((MsgRequest_t*)data);
+        if (programLocked) controller->lockProgram();
+        else {
+            controller->lockStructure();
+            // Workers compile invalid plans under the program lock, so reads can not wait for their next cycle
+            if (!controller->tasksValid()) {
+                controller->unlockStructure();
+                controller->lockProgram();
+                programLocked = true;
+            }
+        }
+        handleRequest(data, len);
+        if (programLocked) controller->unlockProgram();
+        else controller->unlockStructure();
+        programLocked = false;
+        ingress.release();
     }
     reportMonitoringData();
+    reportTraceData();
+    return !ingress.wasEmpty();
+}
+
+// Fail the requests dropped since the last call and report the drop count to the client
+void Link::answerDroppedRequests() {
+    MsgRequestHeader_t request;
+    while (rejectedRequests.pop(request)) sendConfirmation(request, REQUEST_FAILED);
+    const uint32_t dropped = droppedRequests.load(std::memory_order_relaxed);
+    if (dropped == reportedDroppedRequests) return;
+    reportedDroppedRequests = dropped;
+    MsgLinkStatus_t status = linkStatus();
+    sendResponse({ .msgType = MSG_TYPE_LINK_STATUS, .msgID = 0, .pointer = 0 }, &status, sizeof(status));
+}
+
+MsgLinkStatus_t Link::linkStatus() {
+    return {
+        .ingressCapacity    = (uint32_t)ingress.capacity(),
+        .ingressFree        = (uint32_t)ingress.freeBytes(),
+        .receivedRequests   = receivedRequests.load(std::memory_order_relaxed),
+        .droppedRequests    = droppedRequests.load(std::memory_order_relaxed)
+    };
 }
 
 void Link::handleRequest(void* data, size_t len) {
 
+    // Requests without a complete header can not be answered
+    if (len < sizeof(MsgRequestHeader_t)) {
+        HAL::log("INVALID REQUEST: message size %u smaller than header \n", (uint32_t)len);
+        return;
+    }
+
     MsgRequest_t* msg = (MsgRequest_t*)data;
     MsgRequestHeader_t header = msg->header;
-    void* pointer = (void*)header.pointer;
+    void* pointer = HAL::fromPtr32(header.pointer);
     void* payload = &msg->payload;
     size_t payloadSize = len - sizeof(header);
     MESSAGE_TYPE msgType = (MESSAGE_TYPE)header.msgType;
 
-    if (LOG_INFO) Serial.printf("Received ws request type: %d ptr: %p size: %d \n", header.msgType, pointer, len);
+    if (LOG_INFO) HAL::log("Received ws request type: %d ptr: %p size: %d \n", header.msgType, pointer, len);
 
-    if ((header.pointer < ADDRESS_MIN || header.pointer >= ADDRESS_MAX) && header.msgType > MSG_TYPE_CONTROLLER_INFO) {
-        Serial.printf("INVALID REQUEST: invalid pointer %p in message header \n", pointer);
+    if (!HAL::isValidPtr32(header.pointer) && header.msgType > MSG_TYPE_CONTROLLER_INFO) {
+        HAL::log("INVALID REQUEST: invalid pointer %p in message header \n", pointer);
         return;
     }
 
@@ -86,16 +167,26 @@ void Link::handleRequest(void* data, size_t len) {
 
         case MSG_TYPE_CONTROLLER_INFO: {
             MsgControllerInfo_t info = {
-                .pointer         = (uint32_t)controller,
-                .freeHeap        = ESP.getFreeHeap(),
-                .cpuFreq         = ESP.getCpuFreqMHz(),
+                .pointer         = HAL::toPtr32(controller),
+                .freeHeap        = controller->freeHeap(),
+                .cpuFreq         = controller->cpuFreq(),
                 .RSSI            = controller->getRSSI(),
-                .aliveTime       = (uint32_t)(esp_timer_get_time() / 1000000),
+                .aliveTime       = (uint32_t)(controller->getTime() / 1000000),
                 .tickCount       = controller->tickCount,
-                .taskCount       = controller->tasks.size(),
-                .taskList        = (uint32_t)controller->tasks.data(),
-                .funcCount       = controller->funcList.size(),
-                .funcList        = (uint32_t)controller->funcList.data()
+                .taskCount       = (uint32_t)controller->tasks.size(),
+                .taskList        = HAL::toPtr32(controller->tasks.data()),
+                .funcCount       = (uint32_t)controller->funcList.size(),
+                .funcList        = HAL::toPtr32(controller->funcList.data()),
+                .maxAllocHeap    = controller->maxAllocHeap(),
+                .ioArenaSize     = controller->ioArenaSize(),
+                .compactFreeHeapBefore = controller->lastCompaction.freeHeapBefore,
+                .compactMaxAllocBefore = controller->lastCompaction.maxAllocBefore,
+                .compactFreeHeapAfter  = controller->lastCompaction.freeHeapAfter,
+                .compactMaxAllocAfter  = controller->lastCompaction.maxAllocAfter,
+                .blockPoolSlabs  = BlockPool::slabCount,
+                .blockPoolSlots  = BlockPool::slotCount,
+                .workerCount     = controller->workerCount,
+                .ioRevision      = IOArena::layoutRevision
             };
             sendResponse(header, &info, sizeof(info));
             break;
@@ -103,18 +194,28 @@ void Link::handleRequest(void* data, size_t len) {
 
         case MSG_TYPE_TASK_INFO: {
             CyclicTask* task = (CyclicTask*)pointer;
+            if (!captureTaskRead(task)) {
+                sendConfirmation(header, REQUEST_FAILED);
+                break;
+            }
+            const CyclicTask::ReadSnapshot& snapshot = task->readSnapshot;
             MsgTaskInfo_t info = {
-                .pointer         = (uint32_t)task,
+                .pointer         = HAL::toPtr32(task),
                 .interval        = task->interval_ms,
                 .offset          = task->offset_ms,
-                .runCount        = task->runCount,
-                .lastCPUTime     = task->lastCPUTime,
-                .avgCPUTime      = task->averageCPUTime(),
-                .lastActInterval = task->lastActualInterval_ms,
-                .avgActInterval  = task->averageActualInterval_ms(),
-                .driftTime       = task->drift_us,
-                .funcCount       = task->funcList.size(),
-                .funcList        = (uint32_t)task->funcList.data()
+                .runCount        = snapshot.runCount,
+                .lastCPUTime     = snapshot.lastCPUTime,
+                .avgCPUTime      = snapshot.avgCPUTime,
+                .lastActInterval = snapshot.lastActualInterval_ms,
+                .avgActInterval  = snapshot.avgActualInterval_ms,
+                .driftTime       = snapshot.drift_us,
+                .funcCount       = (uint32_t)task->funcList.size(),
+                .funcList        = HAL::toPtr32(task->funcList.data()),
+                .evaluationMode  = task->plan.mode,
+                .planSize        = (uint32_t)task->plan.instructions.size(),
+                .evaluatedCount  = snapshot.evaluatedCount,
+                .worker          = task->worker,
+                .priority        = task->priority
             };
             sendResponse(header, &info, sizeof(info));
             break;
@@ -123,11 +224,14 @@ void Link::handleRequest(void* data, size_t len) {
         case MSG_TYPE_CIRCUIT_INFO: {
             Circuit* circuit = (Circuit*)pointer;
             MsgCircuitInfo_t info = {
-                .pointer         = (uint32_t)circuit,
-                .funcCount       = circuit->funcList.size(),
-                .funcList        = (uint32_t)circuit->funcList.data(),
+                .pointer         = HAL::toPtr32(circuit),
+                .funcCount       = (uint32_t)circuit->funcList.size(),
+                .funcList        = HAL::toPtr32(circuit->funcList.data()),
                 .outputRefCount  = circuit->numOutputs,
-                .outputRefList   = (uint32_t)circuit->outputRefs,
+                .outputRefList   = HAL::toPtr32(circuit->outputRefs),
+                .autoOrder       = circuit->autoOrder,
+                .feedbackCount   = circuit->feedbackCount,
+                .latencyCycles   = circuit->latencyCycles,
             };
             sendResponse(header, &info, sizeof(info));
             break;
@@ -136,38 +240,136 @@ void Link::handleRequest(void* data, size_t len) {
         case MSG_TYPE_FUNCTION_INFO: {
             FunctionBlock* func = (FunctionBlock*)pointer;
             MsgFunctionInfo_t info = {
-                .pointer         = (uint32_t)func,
+                .pointer         = HAL::toPtr32(func),
                 .numInputs       = func->numInputs,
                 .numOutputs      = func->numOutputs,
                 .opcode          = func->opcode,
                 .flags           = func->flags,
-                .ioValuesPtr     = (uint32_t)func->ioValues,
-                .ioFlagsPtr      = (uint32_t)func->ioFlags,
-                .nameLength      = strlen(func->name()),
-                .namePtr         = (uint32_t)func->name(),
+                .ioValuesPtr     = HAL::toPtr32(func->ioValues),
+                .ioFlagsPtr      = HAL::toPtr32(func->ioFlags),
+                .nameLength      = (uint32_t)strlen(func->name()),
+                .namePtr         = HAL::toPtr32(func->name()),
+                .ioRevision      = IOArena::layoutRevision
             };
             sendResponse(header, &info, sizeof(info));
             break;
         }
 
+        case MSG_TYPE_FUNCTION_PROFILE: {
+#ifdef CTRL_PROFILING
+            FunctionBlock* func = (FunctionBlock*)pointer;
+            FunctionProfile profile;
+            CyclicTask* task = func->profile ? runningTaskWriting(func, 1) : nullptr;
+            if (task) {
+                if (!captureTaskRead(task, func->profile, sizeof(FunctionProfile))) {
+                    sendConfirmation(header, REQUEST_FAILED);
+                    break;
+                }
+                memcpy(&profile, task->readSnapshot.data.data(), sizeof(profile));
+            }
+            else if (func->profile) profile = *func->profile;
+            MsgFunctionProfile_t info = {
+                .pointer        = HAL::toPtr32(func),
+                .calls          = profile.calls,
+                .lastCycles     = profile.lastCycles,
+                .minCycles      = profile.calls ? profile.minCycles : 0,
+                .maxCycles      = profile.maxCycles,
+                .avgCycles      = profile.averageCycles(),
+                .cpuFreq        = controller->cpuFreq()
+            };
+            // Non-zero payload resets the statistics after reading
+            if (msg->payload && func->profile) func->profile->reset();
+            sendResponse(header, &info, sizeof(info));
+#else
+            sendConfirmation(header, REQUEST_FAILED);
+#endif
+            break;
+        }
+
+        case MSG_TYPE_TASK_TIMING_STATS: {
+            CyclicTask* task = (CyclicTask*)pointer;
+            if (!captureTaskRead(task, nullptr, 0, true)) {
+                sendConfirmation(header, REQUEST_FAILED);
+                break;
+            }
+            const CyclicTask::ReadSnapshot& snapshot = task->readSnapshot;
+            struct {
+                MsgTaskTimingStats_t    info;
+                uint32_t                counts[3][HISTOGRAM_BUCKETS];
+            } stats;
+            stats.info = {
+                .pointer            = HAL::toPtr32(task),
+                .runCount           = snapshot.runCount,
+                .deadlineMisses     = snapshot.deadlineMisses,
+                .skippedCycles      = snapshot.skippedCycles,
+                .consecutiveOverruns    = snapshot.consecutiveOverruns,
+                .maxConsecutiveOverruns = snapshot.maxConsecutiveOverruns,
+                .worstOverrun       = snapshot.worstOverrun_us,
+                .overrunPolicy      = task->overrunPolicy,
+                .degraded           = snapshot.degraded,
+                .bucketCount        = HISTOGRAM_BUCKETS,
+                .subBucketBits      = HISTOGRAM_SUB_BUCKET_BITS,
+                .intervalJitterMax  = snapshot.intervalJitter.maxValue,
+                .startDriftMax      = snapshot.startDrift.maxValue,
+                .cpuTimeMax         = snapshot.cpuTime.maxValue
+            };
+            memcpy(stats.counts[0], snapshot.intervalJitter.counts, sizeof(stats.counts[0]));
+            memcpy(stats.counts[1], snapshot.startDrift.counts, sizeof(stats.counts[1]));
+            memcpy(stats.counts[2], snapshot.cpuTime.counts, sizeof(stats.counts[2]));
+            // Non-zero payload resets the statistics after reading
+            if (msg->payload) task->resetTimingStats();
+            sendResponse(header, &stats, sizeof(stats));
+            break;
+        }
+
+        case MSG_TYPE_LINK_STATUS: {
+            MsgLinkStatus_t status = linkStatus();
+            sendResponse(header, &status, sizeof(status));
+            break;
+        }
+
         case MSG_TYPE_GET_MEM_DATA: {
-            uint32_t size = *(uint32_t*)payload;
-            sendResponse(header, pointer, size);
+            MsgMemRead_t* params = (MsgMemRead_t*)payload;
+            if (payloadSize < sizeof(MsgMemRead_t) || params->ioRevision != IOArena::layoutRevision) {
+                sendConfirmation(header, REQUEST_FAILED);
+                break;
+            }
+            uint32_t size = params->size;
+            CyclicTask* task = runningTaskWriting(pointer, size);
+            if (!task) {
+                sendResponse(header, pointer, size);
+                break;
+            }
+            if (!captureTaskRead(task, pointer, size)) {
+                sendConfirmation(header, REQUEST_FAILED);
+                break;
+            }
+            sendResponse(header, task->readSnapshot.data.data(), size);
             break;
         }
 
         case MSG_TYPE_SET_MEM_DATA: {
-            memcpy(pointer, payload, payloadSize);
+            MsgMemWrite_t* params = (MsgMemWrite_t*)payload;
+            if (payloadSize < sizeof(MsgMemWrite_t) || params->ioRevision != IOArena::layoutRevision) {
+                sendConfirmation(header, REQUEST_FAILED);
+                break;
+            }
+            const size_t size = payloadSize - sizeof(MsgMemWrite_t);
+            FunctionBlock* func = constantInputOwner(pointer, size);
+            memcpy(pointer, params + 1, size);
+            // Constant inputs are rerun by change-driven plans. Other writes may have changed IO references or flags
+            if (func) func->markInputsChanged();
+            else ExecutionPlan::invalidate();
             sendConfirmation(header, REQUEST_SUCCESSFUL);
             break;
         }
 
         case MSG_TYPE_MONITORING_ENABLE: {
             FunctionBlock* func = (FunctionBlock*)pointer;
-            boolean once = msg->payload;
-            func->enableMonitoring(once);
-            monitoredFunctions.insert(func);
-            sendConfirmation(header, REQUEST_SUCCESSFUL);
+            bool once = msg->payload;
+            bool success = func->enableMonitoring(once);
+            if (success) monitoredFunctions.insert(func);
+            sendConfirmation(header, success ? REQUEST_SUCCESSFUL : REQUEST_FAILED);
             break;
         }
 
@@ -175,6 +377,7 @@ void Link::handleRequest(void* data, size_t len) {
             FunctionBlock* func = (FunctionBlock*)pointer;
             func->disableMonitoring();
             monitoredFunctions.erase(func);
+            monitoringStates.erase(func);
             sendConfirmation(header, REQUEST_SUCCESSFUL);
             break;
         }
@@ -183,6 +386,92 @@ void Link::handleRequest(void* data, size_t len) {
             break;
         }
 
+        case MSG_TYPE_MONITORING_SET_MODE: {
+            MsgMonitoringMode_t* params = (MsgMonitoringMode_t*)payload;
+            bool success = payloadSize >= sizeof(MsgMonitoringMode_t) && params->mode <= MONITORING_MODE_DELTA;
+            if (success) {
+                monitoringMode = (MONITORING_MODE)params->mode;
+                keyframeInterval = params->keyframeInterval;
+                keyframePending = true;
+            }
+            sendConfirmation(header, success ? REQUEST_SUCCESSFUL : REQUEST_FAILED);
+            break;
+        }
+
+        // Deadbands apply to float values in delta mode. They are cleared when monitoring is disabled
+        case MSG_TYPE_MONITORING_SET_DEADBAND: {
+            FunctionBlock* func = (FunctionBlock*)pointer;
+            MsgMonitoringDeadband_t* params = (MsgMonitoringDeadband_t*)payload;
+            bool success = payloadSize >= sizeof(MsgMonitoringDeadband_t) && params->ioNum < (uint32_t)(func->numInputs + func->numOutputs);
+            if (success) monitoringState(func).deadbands[params->ioNum] = { params->absolute, params->percent };
+            sendConfirmation(header, success ? REQUEST_SUCCESSFUL : REQUEST_FAILED);
+            break;
+        }
+
+        case MSG_TYPE_MONITORING_DELTA_REPORT: {
+            break;
+        }
+
+        case MSG_TYPE_TRACE_START: {
+            CyclicTask* task = (CyclicTask*)pointer;
+            MsgTraceStart_t* params = (MsgTraceStart_t*)payload;
+            MsgTraceSignal_t* signalList = (MsgTraceSignal_t*)(params + 1);
+            bool success = payloadSize >= sizeof(MsgTraceStart_t)
+                && params->signalCount > 0 && params->signalCount <= TRACE_MAX_SIGNALS
+                && payloadSize >= sizeof(MsgTraceStart_t) + params->signalCount * sizeof(MsgTraceSignal_t)
+                && params->capacity > 0 && params->capacity <= TRACE_MAX_RING_WORDS
+                && params->chunkSamples > 0 && params->chunkSamples <= params->capacity
+                && TraceRecorder::ringWords(params->capacity, params->signalCount) <= TRACE_MAX_RING_WORDS;
+            std::vector<TraceSignal> signals;
+            for (uint32_t i = 0; success && i < params->signalCount; i++) {
+                success = HAL::isValidPtr32(signalList[i].pointer);
+                FunctionBlock* func = success ? (FunctionBlock*)HAL::fromPtr32(signalList[i].pointer) : nullptr;
+                success = success && signalList[i].ioNum < func->ioCount();
+                if (success) signals.push_back({ func, (uint8_t)signalList[i].ioNum });
+            }
+            if (success) {
+                delete task->trace;
+                task->trace = new TraceRecorder(signals, params->capacity, params->chunkSamples);
+            }
+            sendConfirmation(header, success ? REQUEST_SUCCESSFUL : REQUEST_FAILED);
+            break;
+        }
+
+        // Remaining streamed samples are sent before confirmation
+        case MSG_TYPE_TRACE_STOP: {
+            CyclicTask* task = (CyclicTask*)pointer;
+            bool success = (task->trace != nullptr);
+            if (success) {
+                if (isConnected && task->trace->state == TRACE_STATE_STREAMING) sendTraceData(task, task->trace->available());
+                delete task->trace;
+                task->trace = nullptr;
+            }
+            sendConfirmation(header, success ? REQUEST_SUCCESSFUL : REQUEST_FAILED);
+            break;
+        }
+
+        case MSG_TYPE_TRACE_DATA: {
+            break;
+        }
+
+        case MSG_TYPE_TRACE_SET_TRIGGER: {
+            TraceRecorder* trace = ((CyclicTask*)pointer)->trace;
+            MsgTraceTrigger_t* params = (MsgTraceTrigger_t*)payload;
+            const bool triggered = (params->condition != TRACE_TRIGGER_NONE);
+            bool success = trace && payloadSize >= sizeof(MsgTraceTrigger_t) && params->condition <= TRACE_TRIGGER_TRUE
+                && (!triggered || HAL::isValidPtr32(params->pointer));
+            FunctionBlock* func = (success && triggered) ? (FunctionBlock*)HAL::fromPtr32(params->pointer) : nullptr;
+            success = success && (!triggered || params->ioNum < func->ioCount());
+            success = success && trace->setTrigger({ func, (uint8_t)params->ioNum }, (TRACE_TRIGGER)params->condition,
+                params->threshold, params->preTrigger, params->postTrigger, params->rearm);
+            sendConfirmation(header, success ? REQUEST_SUCCESSFUL : REQUEST_FAILED);
+            break;
+        }
+
+        case MSG_TYPE_TRACE_CAPTURE: {
+            break;
+        }
+
         // ========================================================================
         //      CREATE
 
@@ -211,6 +500,14 @@ void Link::handleRequest(void* data, size_t len) {
             break;
         }
 
+        // Non-zero payload balances task offsets now and whenever tasks change
+        case MSG_TYPE_CONTROLLER_SET_OFFSET_BALANCING: {
+            controller->autoBalanceOffsets = msg->payload;
+            if (controller->autoBalanceOffsets) controller->requestOffsetBalance();
+            sendConfirmation(header, REQUEST_SUCCESSFUL);
+            break;
+        }
+
         // ========================================================================
         //      MODIFY CONTROLLER TASK
         
@@ -236,14 +533,49 @@ void Link::handleRequest(void* data, size_t len) {
             sendConfirmation(header, REQUEST_SUCCESSFUL);
             break;
         }
+        case MSG_TYPE_TASK_SET_EVALUATION_MODE: {
+            uint32_t mode = msg->payload;
+            if (mode > EVAL_MODE_PACKED_LOGIC) {
+                sendConfirmation(header, REQUEST_FAILED);
+                break;
+            }
+            ((CyclicTask*)pointer)->setEvaluationMode((EVALUATION_MODE)mode);
+            sendConfirmation(header, REQUEST_SUCCESSFUL);
+            break;
+        }
+        case MSG_TYPE_TASK_SET_WORKER: {
+            uint32_t worker = msg->payload;
+            bool success = worker <= UINT8_MAX && ((CyclicTask*)pointer)->setWorker(worker);
+            sendConfirmation(header, success ? REQUEST_SUCCESSFUL : REQUEST_FAILED);
+            break;
+        }
+        case MSG_TYPE_TASK_SET_PRIORITY: {
+            uint32_t priority = msg->payload;
+            if (priority <= UINT8_MAX) ((CyclicTask*)pointer)->setPriority(priority);
+            sendConfirmation(header, (priority <= UINT8_MAX) ? REQUEST_SUCCESSFUL : REQUEST_FAILED);
+            break;
+        }
+        case MSG_TYPE_TASK_SET_OVERRUN_POLICY: {
+            MsgTaskOverrunPolicy_t* params = (MsgTaskOverrunPolicy_t*)payload;
+            bool success = payloadSize >= sizeof(MsgTaskOverrunPolicy_t) && params->policy <= OVERRUN_POLICY_DEGRADE;
+            if (success) ((CyclicTask*)pointer)->setOverrunPolicy((OVERRUN_POLICY)params->policy, params->catchUpBurst);
+            sendConfirmation(header, success ? REQUEST_SUCCESSFUL : REQUEST_FAILED);
+            break;
+        }
+        case MSG_TYPE_TASK_SET_PROFILING: {
+            bool enable = msg->payload;
+            bool success = ((CyclicTask*)pointer)->setProfiling(enable);
+            sendConfirmation(header, success ? REQUEST_SUCCESSFUL : REQUEST_FAILED);
+            break;
+        }
         case MSG_TYPE_TASK_ADD_FUNCTION: {
             MsgAddItem_t* params = (MsgAddItem_t*)payload;
-            ((CyclicTask*)pointer)->addFunction((FunctionBlock*)params->pointer, params->index);
+            ((CyclicTask*)pointer)->addFunction((FunctionBlock*)HAL::fromPtr32(params->pointer), params->index);
             sendConfirmation(header, REQUEST_SUCCESSFUL);
             break;
         }
         case MSG_TYPE_TASK_REMOVE_FUNCTION: {
-            FunctionBlock* func = (FunctionBlock*)msg->payload;
+            FunctionBlock* func = (FunctionBlock*)HAL::fromPtr32(msg->payload);
             ((CyclicTask*)pointer)->removeFunction(func);
             sendConfirmation(header, REQUEST_SUCCESSFUL);
             break;
@@ -254,19 +586,27 @@ void Link::handleRequest(void* data, size_t len) {
 
         case MSG_TYPE_CIRCUIT_ADD_FUNCTION: {
             MsgAddItem_t* params = (MsgAddItem_t*)payload;
-            ((Circuit*)pointer)->addFunction((FunctionBlock*)params->pointer, params->index);
+            ((Circuit*)pointer)->addFunction((FunctionBlock*)HAL::fromPtr32(params->pointer), params->index);
             sendConfirmation(header, REQUEST_SUCCESSFUL);
             break;
         }
         case MSG_TYPE_CIRCUIT_REMOVE_FUNCTION: {
-            FunctionBlock* function = (FunctionBlock*)msg->payload;
+            FunctionBlock* function = (FunctionBlock*)HAL::fromPtr32(msg->payload);
             ((Circuit*)pointer)->removeFunction(function);
             sendConfirmation(header, REQUEST_SUCCESSFUL);
             break;
         }
         case MSG_TYPE_CIRCUIT_REORDER_FUNCTION: {
             MsgAddItem_t* params = (MsgAddItem_t*)payload;
-            ((Circuit*)pointer)->reorderFunction((FunctionBlock*)params->pointer, params->index);
+            ((Circuit*)pointer)->reorderFunction((FunctionBlock*)HAL::fromPtr32(params->pointer), params->index);
+            sendConfirmation(header, REQUEST_SUCCESSFUL);
+            break;
+        }
+
+        case MSG_TYPE_CIRCUIT_SORT_FUNCTIONS: {
+            Circuit* circuit = (Circuit*)pointer;
+            circuit->autoOrder = true;
+            ExecutionPlan::invalidate();
             sendConfirmation(header, REQUEST_SUCCESSFUL);
             break;
         }
@@ -290,13 +630,23 @@ void Link::handleRequest(void* data, size_t len) {
         case MSG_TYPE_FUNCTION_DISCONNECT_INPUT: {
             break;
         }
+        // Function flags are compiled into task plans
         case MSG_TYPE_FUNCTION_SET_FLAGS: {
+            ((FunctionBlock*)pointer)->flags = msg->payload;
+            ExecutionPlan::invalidate();
+            sendConfirmation(header, REQUEST_SUCCESSFUL);
             break;
         }
         case MSG_TYPE_FUNCTION_SET_FLAG: {
+            ((FunctionBlock*)pointer)->flags |= msg->payload;
+            ExecutionPlan::invalidate();
+            sendConfirmation(header, REQUEST_SUCCESSFUL);
             break;
         }
         case MSG_TYPE_FUNCTION_CLEAR_FLAG: {
+            ((FunctionBlock*)pointer)->flags &= ~msg->payload;
+            ExecutionPlan::invalidate();
+            sendConfirmation(header, REQUEST_SUCCESSFUL);
             break;
         }
     }
@@ -311,7 +661,7 @@ void Link::sendConfirmation(MsgRequestHeader_t request, REQUEST_RESULT result) {
         .timeStamp  = (uint32_t)(controller->getTime() / 1000ULL)
     };
     sendData(&response, sizeof(response));
-    if (LOG_INFO) Serial.printf("   Sent ws response id: %u size: %u \n", request.msgID, sizeof(response));
+    if (LOG_INFO) HAL::log("   Sent ws response id: %u size: %u \n", request.msgID, sizeof(response));
 }
 
 void Link::sendResponse(MsgRequestHeader_t request, void* payload, size_t payloadSize) {
@@ -325,7 +675,7 @@ void Link::sendResponse(MsgRequestHeader_t request, void* payload, size_t payloa
     header->timeStamp = (uint32_t)(controller->getTime() / 1000ULL);
     if (payload) memcpy(data + sizeof(MsgResponseHeader_t), payload, payloadSize);
     sendData(data, size);
-    if (LOG_INFO) Serial.printf("   Sent ws response id: %u size: %u \n", request.msgID, size);
+    if (LOG_INFO) HAL::log("   Sent ws response id: %u size: %u \n", request.msgID, size);
 }
 
 void Link::iterateForMonitoredFunctions(FunctionBlock* func) {
@@ -346,27 +696,344 @@ void Link::initMonitoringSet() {
     nextMonitoringReportTime = controller->getTime() + monitoringDataInterval_ms * 1000;
 }
 
+Time Link::nextReportTime() {
+    if (monitoredFunctions.size() == 0) return UINT64_MAX;
+    return monitoringCapturePending ? monitoringCaptureDeadline : nextMonitoringReportTime;
+}
+
 void Link::reportMonitoringData() {
 
     Time now = controller->getTime();
 
-    if ( nextMonitoringReportTime > now || monitoredFunctions.size() == 0 ) return;
+    if (monitoredFunctions.size() == 0) {
+        monitoringCapturePending = false;
+        return;
+    }
 
-    while (nextMonitoringReportTime < now)
-        nextMonitoringReportTime += monitoringDataInterval_ms * 1000;
+    if (!monitoringCapturePending) {
+        if (nextMonitoringReportTime > now) return;
+        while (nextMonitoringReportTime < now)
+            nextMonitoringReportTime += monitoringDataInterval_ms * 1000;
+        requestMonitoringCapture(now);
+    }
+    if (monitoringCapturePending && !monitoringCaptureDone() && now < monitoringCaptureDeadline) return;
+    monitoringCapturePending = false;
 
-    monitoringCollectionStart(this, monitoredFunctions.size());
+    controller->lockStructure();
+    for (CyclicTask* task : controller->tasks) readMonitoringSnapshot(task);
+    if (monitoringMode == MONITORING_MODE_DELTA) reportMonitoringDelta();
+    else {
+        monitoringCollectionStart(this, monitoredFunctions.size());
+        for (FunctionBlock* func : monitoredFunctions) func->reportMonitoringValues(this);
+        monitoringCollectionSend();
+    }
 
+    std::vector<FunctionBlock*> reportedOnce;
     for (FunctionBlock* func : monitoredFunctions) {
-        func->reportMonitoringValues(this);
-        
-        if (func->flags & FUNC_FLAG_MONITOR_ONCE) {
-            func->disableMonitoring();
-            monitoredFunctions.erase(func);
+        if (func->flags & FUNC_FLAG_MONITOR_ONCE) reportedOnce.push_back(func);
+    }
+    controller->unlockStructure();
+
+    // Monitoring buffers are written by the workers
+    if (reportedOnce.empty()) return;
+    controller->lockProgram();
+    for (FunctionBlock* func : reportedOnce) {
+        func->disableMonitoring();
+        monitoredFunctions.erase(func);
+        monitoringStates.erase(func);
+    }
+    controller->unlockProgram();
+}
+
+// Running tasks capture monitoring values at the end of their next cycle. Tasks slower than half
+// the report interval are reported with their previous capture
+void Link::requestMonitoringCapture(Time now) {
+    controller->lockStructure();
+    for (CyclicTask* task : controller->tasks) {
+        if (!task->isRunning()) continue;
+        task->monitoringCaptureRequested.store(true, std::memory_order_relaxed);
+        monitoringCapturePending = true;
+    }
+    controller->unlockStructure();
+    monitoringCaptureDeadline = now + monitoringDataInterval_ms * 500;
+}
+
+bool Link::monitoringCaptureDone() {
+    bool done = true;
+    controller->lockStructure();
+    for (CyclicTask* task : controller->tasks) {
+        if (task->monitoringCaptureRequested.load(std::memory_order_acquire)) done = false;
+    }
+    controller->unlockStructure();
+    return done;
+}
+
+// Copy the values of one capture of the task. Retried if the task captured meanwhile
+void Link::readMonitoringSnapshot(CyclicTask* task) {
+    uint32_t sequence;
+    do {
+        sequence = task->plan.monitoringSequence.load(std::memory_order_acquire);
+        for (FunctionBlock* func : task->funcList) copyMonitoringSnapshot(func);
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((sequence & 1) || task->plan.monitoringSequence.load(std::memory_order_relaxed) != sequence);
+}
+
+void Link::copyMonitoringSnapshot(FunctionBlock* func) {
+    if (func->monitoringValues) memcpy(func->monitoringSnapshot(), func->monitoringValues, func->ioCount() * sizeof(IOValue));
+    if (func->opcode == OPCODE_CIRCUIT) {
+        for (FunctionBlock* childFunc : ((Circuit*)func)->funcList) copyMonitoringSnapshot(childFunc);
+    }
+}
+
+// Function objects and IO storage are written by the task running the function
+static bool writtenByFunction(FunctionBlock* func, const uint8_t* begin, const uint8_t* end) {
+    if (begin == (const uint8_t*)func) return true;
+    const uint8_t* values = (const uint8_t*)func->ioValues;
+    const uint8_t* flags = func->ioFlags;
+    if (values && begin < values + func->ioCount() * sizeof(IOValue) && end > values) return true;
+    if (flags && begin < flags + func->ioCount() && end > flags) return true;
+    if (func->opcode == OPCODE_CIRCUIT) {
+        for (FunctionBlock* childFunc : ((Circuit*)func)->funcList) {
+            if (writtenByFunction(childFunc, begin, end)) return true;
+        }
+    }
+    return false;
+}
+
+// Running task writing the given memory. Other memory only changes while the program is locked
+CyclicTask* Link::runningTaskWriting(const void* begin, size_t size) {
+    const uint8_t* first = (const uint8_t*)begin;
+    for (CyclicTask* task : controller->tasks) {
+        if (!task->isRunning()) continue;
+        for (FunctionBlock* func : task->funcList) {
+            if (writtenByFunction(func, first, first + std::max(size, (size_t)1))) return task;
+        }
+    }
+    return nullptr;
+}
+
+// Capture task statistics, given memory and optionally timing statistics at the end of the next task
+// cycle. Stopped tasks and tasks of paused workers are copied right away. Fails if the task does not
+// complete a cycle within two intervals or the minimum wait
+bool Link::captureTaskRead(CyclicTask* task, const void* source, size_t size, bool timingStats) {
+    const bool direct = programLocked || !task->isRunning();
+    // Capture of an earlier request may still be pending
+    if (!direct && !waitReadCapture(task)) return false;
+    task->readSnapshot.timingStats = timingStats;
+    task->readSnapshot.source = source;
+    task->readSnapshot.data.resize(source ? size : 0);
+    if (direct) {
+        task->captureReadSnapshot();
+        task->readCaptureRequested.store(false, std::memory_order_relaxed);
+        return true;
+    }
+    task->readCaptureRequested.store(true, std::memory_order_release);
+    return waitReadCapture(task);
+}
+
+// Function holding the given memory in values of unconnected inputs
+static FunctionBlock* constantInputFunction(FunctionBlock* func, const uint8_t* begin, const uint8_t* end) {
+    const uint8_t* values = (const uint8_t*)func->ioValues;
+    if (values && begin >= values && end <= values + func->numInputs * sizeof(IOValue)) {
+        const size_t first = (begin - values) / sizeof(IOValue);
+        const size_t last = (end - 1 - values) / sizeof(IOValue);
+        for (size_t i = first; i <= last; i++) {
+            if (func->inputFlag(i) & IO_FLAG_REF) return nullptr;
         }
+        return func;
     }
+    if (func->opcode == OPCODE_CIRCUIT) {
+        for (FunctionBlock* childFunc : ((Circuit*)func)->funcList) {
+            FunctionBlock* owner = constantInputFunction(childFunc, begin, end);
+            if (owner) return owner;
+        }
+    }
+    return nullptr;
+}
+
+FunctionBlock* Link::constantInputOwner(const void* begin, size_t size) {
+    if (!size) return nullptr;
+    const uint8_t* first = (const uint8_t*)begin;
+    for (CyclicTask* task : controller->tasks) {
+        for (FunctionBlock* func : task->funcList) {
+            FunctionBlock* owner = constantInputFunction(func, first, first + size);
+            if (owner) return owner;
+        }
+    }
+    return nullptr;
+}
+
+bool Link::waitReadCapture(CyclicTask* task) {
+    const Time deadline = HAL::time() + std::max((Time)task->interval_ms * 2000, (Time)LINK_READ_CAPTURE_MIN_WAIT_US);
+    while (task->readCaptureRequested.load(std::memory_order_acquire)) {
+        if (HAL::time() >= deadline) return false;
+        HAL::waitUntil(HAL_WAKEUP_LINK, deadline);
+    }
+    return true;
+}
+
+// Delta state of a function sized to its current IO count
+Link::MonitoringState& Link::monitoringState(FunctionBlock* func) {
+    MonitoringState& state = monitoringStates[func];
+    const size_t ioCount = func->numInputs + func->numOutputs;
+    if (state.lastSent.size() != ioCount) {
+        state.lastSent.assign(ioCount, 0);
+        state.deadbands.assign(ioCount, { 0.f, 0.f });
+        state.sent = false;
+    }
+    return state;
+}
+
+static inline bool withinDeadband(uint32_t value, uint32_t lastSent, float absolute, float percent) {
+    if (absolute == 0.f && percent == 0.f) return false;
+    IOValue current = { .u = value };
+    IOValue previous = { .u = lastSent };
+    const float band = std::max(absolute, percent * 0.01f * fabsf(previous.f));
+    return fabsf(current.f - previous.f) <= band;
+}
 
-    monitoringCollectionSend();
+// Encode changed values of monitored functions from their snapshots
+void Link::reportMonitoringDelta() {
+    if (!isConnected) return;
+    const bool keyframe = keyframePending || (keyframeInterval && reportsSinceKeyframe >= keyframeInterval);
+    reportsSinceKeyframe = keyframe ? 0 : reportsSinceKeyframe + 1;
+    keyframePending = false;
+
+    // Largest report size with every value changed
+    size_t maxSize = sizeof(MsgResponseHeader_t) + sizeof(MsgMonitoringDelta_t);
+    for (FunctionBlock* func : monitoredFunctions) {
+        const size_t ioCount = func->numInputs + func->numOutputs;
+        maxSize += sizeof(MsgMonitoringDeltaItem_t) + ((ioCount + 31) / 32 + ioCount) * sizeof(uint32_t);
+    }
+    if (reportBuffer.size() < maxSize) reportBuffer.resize(maxSize);
+    uint8_t* data = reportBuffer.data();
+
+    MsgResponseHeader_t* header = (MsgResponseHeader_t*)data;
+    header->msgType = MSG_TYPE_MONITORING_DELTA_REPORT;
+    header->msgID = 0;
+    header->result = REQUEST_SUCCESSFUL;
+    header->timeStamp = (uint32_t)(controller->getTime() / 1000ULL);
+
+    MsgMonitoringDelta_t* report = (MsgMonitoringDelta_t*)(data + sizeof(MsgResponseHeader_t));
+    report->itemCount = 0;
+    report->keyframe = keyframe;
+    size_t size = sizeof(MsgResponseHeader_t) + sizeof(MsgMonitoringDelta_t);
+
+    for (FunctionBlock* func : monitoredFunctions) {
+        if (!func->monitoringValues) continue;
+        const uint32_t* values = (const uint32_t*)func->monitoringSnapshot();
+        MonitoringState& state = monitoringState(func);
+        const uint32_t ioCount = state.lastSent.size();
+        const bool full = keyframe || !state.sent;
+
+        MsgMonitoringDeltaItem_t* item = (MsgMonitoringDeltaItem_t*)(data + size);
+        uint32_t* bitmap = (uint32_t*)(item + 1);
+        const uint32_t bitmapWords = (ioCount + 31) / 32;
+        uint32_t* changedValues = bitmap + bitmapWords;
+        memset(bitmap, 0, bitmapWords * sizeof(uint32_t));
+
+        uint32_t valueCount = 0;
+        for (uint32_t i = 0; i < ioCount; i++) {
+            const uint32_t value = values[i];
+            if (!full) {
+                if (value == state.lastSent[i]) continue;
+                const IO_TYPE type = (i < func->numInputs) ? func->readInputType(i) : func->readOutputType(i - func->numInputs);
+                const Deadband& deadband = state.deadbands[i];
+                if (type == IO_TYPE_FLOAT && withinDeadband(value, state.lastSent[i], deadband.absolute, deadband.percent)) continue;
+            }
+            bitmap[i / 32] |= 1u << (i % 32);
+            changedValues[valueCount++] = value;
+            state.lastSent[i] = value;
+        }
+        if (valueCount == 0) continue;
+
+        state.sent = true;
+        item->pointer = HAL::toPtr32(func);
+        item->ioCount = ioCount;
+        item->valueCount = valueCount;
+        size += sizeof(MsgMonitoringDeltaItem_t) + (bitmapWords + valueCount) * sizeof(uint32_t);
+        report->itemCount++;
+    }
+
+    if (report->itemCount == 0 && !keyframe) return;
+    if (LOG_INFO) HAL::log("   Sent ws response type: %u payload len: %u \n", header->msgType, size - sizeof(MsgResponseHeader_t));
+    sendData(data, size);
+}
+
+// Stream completed chunks of task traces and upload completed triggered captures
+void Link::reportTraceData() {
+    if (!isConnected) return;
+    controller->lockStructure();
+    for (CyclicTask* task : controller->tasks) {
+        TraceRecorder* trace = task->trace;
+        if (!trace) continue;
+        const TRACE_STATE state = trace->state.load(std::memory_order_acquire);
+        if (state == TRACE_STATE_COMPLETE) sendTraceCapture(task);
+        if (state != TRACE_STATE_STREAMING) continue;
+        for (uint32_t chunks = trace->available() / trace->chunkSamples; chunks > 0; chunks--) {
+            sendTraceData(task, trace->chunkSamples);
+        }
+    }
+    controller->unlockStructure();
+}
+
+void Link::sendTraceData(CyclicTask* task, uint32_t maxSamples) {
+    TraceRecorder* trace = task->trace;
+    const size_t sampleSize = trace->sampleWords() * sizeof(uint32_t);
+    const size_t maxSize = sizeof(MsgResponseHeader_t) + sizeof(MsgTraceData_t) + maxSamples * sampleSize;
+    if (reportBuffer.size() < maxSize) reportBuffer.resize(maxSize);
+    uint8_t* data = reportBuffer.data();
+
+    MsgResponseHeader_t* header = (MsgResponseHeader_t*)data;
+    header->msgType = MSG_TYPE_TRACE_DATA;
+    header->msgID = 0;
+    header->result = REQUEST_SUCCESSFUL;
+    header->timeStamp = (uint32_t)(controller->getTime() / 1000ULL);
+
+    MsgTraceData_t* info = (MsgTraceData_t*)(data + sizeof(MsgResponseHeader_t));
+    const uint32_t sampleCount = trace->read((uint32_t*)(info + 1), maxSamples);
+    *info = {
+        .pointer            = HAL::toPtr32(task),
+        .sampleCount        = sampleCount,
+        .signalCount        = trace->signalCount(),
+        .droppedSamples     = trace->droppedSamples.load(std::memory_order_relaxed),
+        .lastCaptureCycles  = trace->lastCaptureCycles,
+        .maxCaptureCycles   = trace->maxCaptureCycles,
+        .cpuFreq            = controller->cpuFreq()
+    };
+    const size_t size = sizeof(MsgResponseHeader_t) + sizeof(MsgTraceData_t) + sampleCount * sampleSize;
+    if (LOG_INFO) HAL::log("   Sent ws response type: %u payload len: %u \n", header->msgType, size - sizeof(MsgResponseHeader_t));
+    sendData(data, size);
+}
+
+void Link::sendTraceCapture(CyclicTask* task) {
+    TraceRecorder* trace = task->trace;
+    const size_t sampleSize = trace->sampleWords() * sizeof(uint32_t);
+    const size_t maxSize = sizeof(MsgResponseHeader_t) + sizeof(MsgTraceCapture_t) + trace->windowSamples() * sampleSize;
+    if (reportBuffer.size() < maxSize) reportBuffer.resize(maxSize);
+    uint8_t* data = reportBuffer.data();
+
+    MsgResponseHeader_t* header = (MsgResponseHeader_t*)data;
+    header->msgType = MSG_TYPE_TRACE_CAPTURE;
+    header->msgID = 0;
+    header->result = REQUEST_SUCCESSFUL;
+    header->timeStamp = (uint32_t)(controller->getTime() / 1000ULL);
+
+    MsgTraceCapture_t* info = (MsgTraceCapture_t*)(data + sizeof(MsgResponseHeader_t));
+    uint32_t triggerIndex = 0;
+    const uint32_t sampleCount = trace->readCapture((uint32_t*)(info + 1), triggerIndex);
+    *info = {
+        .pointer            = HAL::toPtr32(task),
+        .sampleCount        = sampleCount,
+        .signalCount        = trace->signalCount(),
+        .triggerIndex       = triggerIndex,
+        .triggerCount       = trace->triggerCount,
+        .maxCaptureCycles   = trace->maxCaptureCycles,
+        .cpuFreq            = controller->cpuFreq()
+    };
+    const size_t size = sizeof(MsgResponseHeader_t) + sizeof(MsgTraceCapture_t) + sampleCount * sampleSize;
+    if (LOG_INFO) HAL::log("   Sent ws response type: %u payload len: %u \n", header->msgType, size - sizeof(MsgResponseHeader_t));
+    sendData(data, size);
 }
 
 void Link::monitoringCollectionStart(void* reportingTask, size_t maxItemCount) {
@@ -413,7 +1080,7 @@ void Link::monitoringCollectionSend() {
     for (int i = 0; i < monitoringCollectionCount; i++) {
         MonitoringCollectionItem_t item = monitoringCollection[i];
         MsgMonitoringCollectionItem_t* msgItem = itemList + i;
-        msgItem->pointer = (uint32_t)item.func;
+        msgItem->pointer = HAL::toPtr32(item.func);
         msgItem->size = item.size;
         msgItem->offset = dataOffset;
 
@@ -422,7 +1089,7 @@ void Link::monitoringCollectionSend() {
         dataOffset += item.size;
     }
 
-    if (LOG_INFO) Serial.printf("   Sent ws response type: %u payload len: %u \n", header->msgType, dataSize - sizeof(MsgResponseHeader_t));
+    if (LOG_INFO) HAL::log("   Sent ws response type: %u payload len: %u \n", header->msgType, dataSize - sizeof(MsgResponseHeader_t));
     sendData(data, dataSize);
 
     monitoringCollectionCount = 0;
@@ -3,10 +3,16 @@
 #include "Common.h"
 #include "Controller.h"
 #include "FIFO.h"
+#include "ByteRing.h"
+#include "HAL.h"
 #include <set>
+#include <map>
 
-#define ADDRESS_MIN 0x3F400000
-#define ADDRESS_MAX 0x50002000
+// Size of the buffer holding received requests until they are handled
+#define LINK_INGRESS_SIZE       4096
+
+// Minimum wait for a running task to capture a read. Covers wake-up latency of tasks with short intervals
+#define LINK_READ_CAPTURE_MIN_WAIT_US   50000
 
 enum REQUEST_RESULT {
     REQUEST_FAILED,     // = 0
@@ -54,10 +60,31 @@ enum MESSAGE_TYPE {
     MSG_TYPE_FUNCTION_SET_FLAGS,
     MSG_TYPE_FUNCTION_SET_FLAG,
     MSG_TYPE_FUNCTION_CLEAR_FLAG,
-};
 
-typedef uint32_t ptr32_t;
+    MSG_TYPE_TASK_SET_EVALUATION_MODE,
+    MSG_TYPE_CIRCUIT_SORT_FUNCTIONS,
+    MSG_TYPE_TASK_SET_WORKER,
+    MSG_TYPE_FUNCTION_PROFILE,
+    MSG_TYPE_TASK_SET_PROFILING,
+    MSG_TYPE_TASK_TIMING_STATS,
+    MSG_TYPE_TASK_SET_PRIORITY,
+    MSG_TYPE_TASK_SET_OVERRUN_POLICY,
+    MSG_TYPE_CONTROLLER_SET_OFFSET_BALANCING,
+    MSG_TYPE_MONITORING_SET_MODE,
+    MSG_TYPE_MONITORING_SET_DEADBAND,
+    MSG_TYPE_MONITORING_DELTA_REPORT,
+    MSG_TYPE_TRACE_START,
+    MSG_TYPE_TRACE_STOP,
+    MSG_TYPE_TRACE_DATA,
+    MSG_TYPE_TRACE_SET_TRIGGER,
+    MSG_TYPE_TRACE_CAPTURE,
+    MSG_TYPE_LINK_STATUS,
+};
 
+enum MONITORING_MODE {
+    MONITORING_MODE_FULL,       // Reports carry all IO values of monitored functions
+    MONITORING_MODE_DELTA       // Reports carry changed IO values, with periodic full keyframes
+};
 
 //  Request header
 
@@ -101,6 +128,16 @@ struct MsgControllerInfo_t {
     ptr32_t     taskList;
     uint32_t    funcCount;
     ptr32_t     funcList;
+    uint32_t    maxAllocHeap;
+    uint32_t    ioArenaSize;
+    uint32_t    compactFreeHeapBefore;
+    uint32_t    compactMaxAllocBefore;
+    uint32_t    compactFreeHeapAfter;
+    uint32_t    compactMaxAllocAfter;
+    uint32_t    blockPoolSlabs;
+    uint32_t    blockPoolSlots;
+    uint32_t    workerCount;
+    uint32_t    ioRevision;
 };
 
 struct MsgTaskInfo_t {
@@ -115,6 +152,11 @@ struct MsgTaskInfo_t {
     uint32_t    driftTime;
     uint32_t    funcCount;
     ptr32_t     funcList;
+    uint32_t    evaluationMode;
+    uint32_t    planSize;
+    uint32_t    evaluatedCount;
+    uint32_t    worker;
+    uint32_t    priority;
 };
 
 struct MsgCircuitInfo_t {
@@ -123,6 +165,9 @@ struct MsgCircuitInfo_t {
     ptr32_t     funcList;
     uint32_t    outputRefCount;
     ptr32_t     outputRefList;
+    uint32_t    autoOrder;
+    uint32_t    feedbackCount;
+    uint32_t    latencyCycles;
 };
 
 struct MsgFunctionInfo_t {
@@ -135,6 +180,53 @@ struct MsgFunctionInfo_t {
     ptr32_t     ioFlagsPtr;
     uint32_t    nameLength;
     ptr32_t     namePtr;
+    uint32_t    ioRevision;
+};
+
+// Memory requests carry the IO layout revision of controller or function info the pointer was read from.
+// Requests of an older revision fail, since IO storage may have moved or been freed
+
+struct MsgMemRead_t {
+    uint32_t    ioRevision;
+    uint32_t    size;
+};
+
+// Followed by the data to write
+
+struct MsgMemWrite_t {
+    uint32_t    ioRevision;
+};
+
+// Execution time of a function in CPU cycles. Circuit times include nested functions
+
+struct MsgFunctionProfile_t {
+    uint32_t    pointer;
+    uint32_t    calls;
+    uint32_t    lastCycles;
+    uint32_t    minCycles;
+    uint32_t    maxCycles;
+    float       avgCycles;
+    uint32_t    cpuFreq;
+};
+
+// Task timing statistics. Followed by interval jitter, start drift and CPU time histograms
+// of bucketCount counts each. Histogram values are in microseconds
+
+struct MsgTaskTimingStats_t {
+    uint32_t    pointer;
+    uint32_t    runCount;
+    uint32_t    deadlineMisses;
+    uint32_t    skippedCycles;
+    uint32_t    consecutiveOverruns;
+    uint32_t    maxConsecutiveOverruns;
+    uint32_t    worstOverrun;
+    uint32_t    overrunPolicy;
+    uint32_t    degraded;
+    uint32_t    bucketCount;
+    uint32_t    subBucketBits;
+    uint32_t    intervalJitterMax;
+    uint32_t    startDriftMax;
+    uint32_t    cpuTimeMax;
 };
 
 // Monitoring response structure
@@ -149,6 +241,93 @@ struct MsgMonitoringCollectionItem_t {
     uint16_t    size;
 };
 
+// Delta monitoring report. Items of functions with changes follow, each followed by a bitmap of
+// changed IO values in 32-bit words and the changed values in IO order
+
+struct MsgMonitoringDelta_t {
+    uint32_t    itemCount;
+    uint32_t    keyframe;
+};
+
+struct MsgMonitoringDeltaItem_t {
+    uint32_t    pointer;
+    uint16_t    ioCount;
+    uint16_t    valueCount;
+};
+
+// Monitoring configuration parameters
+
+struct MsgMonitoringMode_t {
+    uint32_t    mode;
+    uint32_t    keyframeInterval;
+};
+
+struct MsgMonitoringDeadband_t {
+    uint32_t    ioNum;
+    float       absolute;
+    float       percent;
+};
+
+// Request buffer state. Requests not fitting the buffer are dropped and answered as failed
+
+struct MsgLinkStatus_t {
+    uint32_t    ingressCapacity;
+    uint32_t    ingressFree;
+    uint32_t    receivedRequests;
+    uint32_t    droppedRequests;
+};
+
+// Trace start parameters. Followed by signalCount signals
+
+struct MsgTraceStart_t {
+    uint32_t    capacity;
+    uint32_t    chunkSamples;
+    uint32_t    signalCount;
+};
+
+struct MsgTraceSignal_t {
+    ptr32_t     pointer;
+    uint32_t    ioNum;
+};
+
+// Trace data chunk of a task. Followed by sampleCount samples, each a microsecond timestamp
+// and signalCount values. Capture times are in CPU cycles
+
+struct MsgTraceData_t {
+    uint32_t    pointer;
+    uint32_t    sampleCount;
+    uint32_t    signalCount;
+    uint32_t    droppedSamples;
+    uint32_t    lastCaptureCycles;
+    uint32_t    maxCaptureCycles;
+    uint32_t    cpuFreq;
+};
+
+// Trigger of a triggered trace capture. Condition none returns to streaming
+
+struct MsgTraceTrigger_t {
+    ptr32_t     pointer;
+    uint32_t    ioNum;
+    uint32_t    condition;
+    float       threshold;
+    uint32_t    preTrigger;
+    uint32_t    postTrigger;
+    uint32_t    rearm;
+};
+
+// Triggered capture window of a task. Followed by sampleCount samples like trace data.
+// Trigger index is the position of the trigger sample in the window
+
+struct MsgTraceCapture_t {
+    uint32_t    pointer;
+    uint32_t    sampleCount;
+    uint32_t    signalCount;
+    uint32_t    triggerIndex;
+    uint32_t    triggerCount;
+    uint32_t    maxCaptureCycles;
+    uint32_t    cpuFreq;
+};
+
 // Create request parameters
 
 struct MsgCreateTask_t {
@@ -163,6 +342,11 @@ struct MsgCreateFunction_t {
     uint32_t    flags;
 };
 
+struct MsgTaskOverrunPolicy_t {
+    uint32_t    policy;
+    uint32_t    catchUpBurst;
+};
+
 struct MsgAddItem_t {
     uint32_t    pointer;
     int32_t     index;
@@ -175,17 +359,14 @@ typedef void (*send_text_callback_t)(const char* text);
 
 class Link
 {
+    friend class Benchmark;
+
     struct MonitoringCollectionItem_t {
         void*       func;
         void*       values;
         size_t      size;
     };
 
-    struct RequestData_t {
-        void*   data;
-        size_t  size;
-    };
-
     Controller* controller;
     send_data_callback_t sendData;
     send_text_callback_t sendText;
@@ -200,6 +381,52 @@ class Link
     Time nextMonitoringReportTime;
     std::set<FunctionBlock*> monitoredFunctions;
 
+    // Float change smaller than the larger of the absolute and relative deadband is not reported
+    struct Deadband {
+        float       absolute;
+        float       percent;
+    };
+
+    // Values last reported of a function in delta mode
+    struct MonitoringState {
+        std::vector<uint32_t>   lastSent;
+        std::vector<Deadband>   deadbands;
+        bool                    sent = false;
+    };
+
+    MONITORING_MODE monitoringMode = MONITORING_MODE_FULL;
+    // Reports between full keyframes. Zero sends keyframes only on mode change and connection
+    uint32_t keyframeInterval = 10;
+    uint32_t reportsSinceKeyframe = 0;
+    bool keyframePending = true;
+    std::map<FunctionBlock*, MonitoringState> monitoringStates;
+    std::vector<uint8_t> reportBuffer;
+
+    MonitoringState& monitoringState(FunctionBlock* func);
+    void reportMonitoringDelta();
+
+    // Reports wait for the running tasks to capture their monitoring values, at most until the deadline
+    bool monitoringCapturePending = false;
+    Time monitoringCaptureDeadline = 0;
+
+    void requestMonitoringCapture(Time now);
+    bool monitoringCaptureDone();
+    void readMonitoringSnapshot(CyclicTask* task);
+    void copyMonitoringSnapshot(FunctionBlock* func);
+
+    // Reads of memory written by a running task are served from a copy taken at the end of its next cycle
+    bool programLocked = false;
+    CyclicTask* runningTaskWriting(const void* begin, size_t size);
+    bool captureTaskRead(CyclicTask* task, const void* source = nullptr, size_t size = 0, bool timingStats = false);
+    bool waitReadCapture(CyclicTask* task);
+
+    // Function of a task holding the given memory in constant input values. Writes to it only change function results
+    FunctionBlock* constantInputOwner(const void* begin, size_t size);
+
+    void reportTraceData();
+    void sendTraceData(CyclicTask* task, uint32_t maxSamples);
+    void sendTraceCapture(CyclicTask* task);
+
     void initMonitoringSet();
     void reportMonitoringData();
     void monitoringCollectionStart(void* reportingTask, size_t funcCount);
@@ -207,7 +434,17 @@ class Link
     void monitoringCollectionEnd();
     void iterateForMonitoredFunctions(FunctionBlock* func);
 
-    FIFOBuffer<RequestData_t, 16> dataQueue;
+    ByteRing<LINK_INGRESS_SIZE> ingress;
+
+    // Receiver side counters and headers of dropped requests to be answered. Drops beyond the
+    // rejection queue are only counted in the link status
+    std::atomic<uint32_t> receivedRequests {0};
+    std::atomic<uint32_t> droppedRequests {0};
+    uint32_t reportedDroppedRequests = 0;
+    FIFOBuffer<MsgRequestHeader_t, 16> rejectedRequests;
+
+    void answerDroppedRequests();
+    MsgLinkStatus_t linkStatus();
 
     void handleRequest(void* data, size_t len);
 
@@ -225,7 +462,11 @@ public:
 
     void receiveData(void* data, size_t len);
 
-    void processData();
+    // Time of the next monitoring report or capture deadline. Maximum time when no functions are monitored
+    Time nextReportTime();
+
+    // Handle queued requests and due monitoring reports outside the controller workers
+    bool processData(uint32_t budget_us = UINT32_MAX);
 
     void monitoringValueHandler(void* func, void* values, uint32_t byteSize);
 
@@ -0,0 +1,67 @@
+#include "LoadBalancer.h"
+#include "CyclicTask.h"
+#include <algorithm>
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// Least common multiple of task intervals limited to the maximum slot count
+static uint32_t hyperperiod(const std::vector<CyclicTask*>& tasks) {
+    uint64_t period = 1;
+    for (CyclicTask* task : tasks) {
+        period = period / gcd(period, task->interval_ms) * task->interval_ms;
+        if (period >= BALANCE_MAX_HYPERPERIOD_MS) return BALANCE_MAX_HYPERPERIOD_MS;
+    }
+    return period;
+}
+
+static float measuredCPUTime(CyclicTask* task) {
+    return task->runCount ? task->averageCPUTime() : task->lastCPUTime;
+}
+
+float balanceTaskOffsets(const std::vector<CyclicTask*>& tasks) {
+    if (tasks.empty()) return 0;
+    // Most frequent tasks are placed first, heavier ones first among equal intervals
+    std::vector<CyclicTask*> order(tasks);
+    std::sort(order.begin(), order.end(), [](CyclicTask* a, CyclicTask* b) {
+        if (a->interval_ms != b->interval_ms) return a->interval_ms < b->interval_ms;
+        return measuredCPUTime(a) > measuredCPUTime(b);
+    });
+
+    // CPU time released on each millisecond of the hyperperiod
+    const uint32_t period = hyperperiod(order);
+    std::vector<float> load(period, 0.f);
+    float peak = 0;
+
+    for (CyclicTask* task : order) {
+        const float cpuTime = measuredCPUTime(task);
+        const uint32_t interval = std::min(task->interval_ms, period);
+        uint32_t bestOffset = 0;
+        float bestPeak = 0;
+        float bestSum = 0;
+        // Offset with the lowest peak, then with the least load shared
+        for (uint32_t offset = 0; offset < interval; offset++) {
+            float offsetPeak = 0;
+            float offsetSum = 0;
+            for (uint32_t slot = offset; slot < period; slot += interval) {
+                offsetPeak = std::max(offsetPeak, load[slot]);
+                offsetSum += load[slot];
+            }
+            if (offset == 0 || offsetPeak < bestPeak || (offsetPeak == bestPeak && offsetSum < bestSum)) {
+                bestOffset = offset;
+                bestPeak = offsetPeak;
+                bestSum = offsetSum;
+            }
+        }
+        for (uint32_t slot = bestOffset; slot < period; slot += interval) load[slot] += cpuTime;
+        peak = std::max(peak, bestPeak + cpuTime);
+        if (task->offset_ms != bestOffset) task->setOffset(bestOffset);
+    }
+    return peak;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Common.h"
+
+// Longest hyperperiod in milliseconds used for balancing. Longer hyperperiods are folded into it
+#define BALANCE_MAX_HYPERPERIOD_MS  10000
+
+// Runs of each task measured before offsets are balanced
+#define BALANCE_MIN_RUNS            3
+
+class CyclicTask;
+
+// Choose offsets of tasks sharing a worker to minimize the largest CPU time released on the same
+// millisecond. Uses measured average CPU times. Returns the resulting peak load in microseconds
+float balanceTaskOffsets(const std::vector<CyclicTask*>& tasks);
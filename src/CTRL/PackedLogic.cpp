@@ -0,0 +1,257 @@
+#include "PackedLogic.h"
+#include "ExecutionPlan.h"
+#include "FunctionLib.h"
+#include "FuncLibs/LogicLib.h"
+#include <algorithm>
+#include <map>
+
+// Output storage range of a plan instruction
+struct ProducerRange {
+    const IOValue*  begin;
+    const IOValue*  end;
+    uint32_t        producer;
+};
+
+static bool findProducer(const std::vector<ProducerRange>& ranges, const IOValue* ref, uint32_t& producer) {
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), ref,
+        [](const IOValue* ref, const ProducerRange& range) { return ref < range.begin; });
+    if (it == ranges.begin() || ref >= (it - 1)->end) return false;
+    producer = (it - 1)->producer;
+    return true;
+}
+
+// Packed functions read boolean outputs of plan functions and constant inputs as truth values
+static bool isPackable(const std::vector<Instruction>& instructions, const std::vector<ProducerRange>& ranges, const Instruction& instr) {
+    if ((instr.opcode >> 8) != LIB_ID_LOGIC || instr.numOutputs != 1) return false;
+    const uint8_t funcID = instr.opcode & 0xFF;
+    const uint8_t* flags = instr.func->inputFlags();
+    const InputBinding* binding = instr.inputBindings;
+    for (uint8_t i = 0; i < instr.numInputs; i++) {
+        if (!(flags[i] & IO_FLAG_REF)) {
+            // XOR counts input values, so constants must be plain truth values
+            if (funcID == LogicLib::FUNC_ID_XOR && instr.inputs[i].u > 1) return false;
+            continue;
+        }
+        if (binding->op > BIND_REF_INVERT) return false;
+        uint32_t producer;
+        if (!findProducer(ranges, binding->source, producer)) return false;
+        const Instruction& source = instructions[producer];
+        if (source.opcode == 0) return false;
+        if (source.func->readOutputType(binding->source - source.outputs) != IO_TYPE_BOOL) return false;
+        binding++;
+    }
+    return true;
+}
+
+std::vector<PackedLogic> PackedLogic::build(const std::vector<Instruction>& instructions) {
+    std::vector<ProducerRange> ranges;
+    for (uint32_t i = 0; i < instructions.size(); i++) {
+        const Instruction& instr = instructions[i];
+        if (instr.numOutputs) ranges.push_back({ instr.outputs, instr.outputs + instr.numOutputs, i });
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const ProducerRange& a, const ProducerRange& b) { return a.begin < b.begin; });
+
+    // Segments of at least two consecutive packable functions
+    std::vector<PackedLogic> segments;
+    uint32_t begin = 0;
+    while (begin < instructions.size()) {
+        uint32_t end = begin;
+        while (end < instructions.size() && isPackable(instructions, ranges, instructions[end])) end++;
+        if (end - begin >= 2) segments.emplace_back(instructions, begin, end);
+        begin = std::max(end, begin + 1);
+    }
+    return segments;
+}
+
+PackedLogic::PackedLogic(const std::vector<Instruction>& instructions, uint32_t begin, uint32_t end) :
+    begin (begin),
+    end (end)
+{
+    const uint32_t count = end - begin;
+    std::map<const IOValue*, uint32_t> segmentOutputs;
+    for (uint32_t i = 0; i < count; i++) segmentOutputs[instructions[begin + i].outputs] = i;
+    auto segmentIndex = [&](const IOValue* ref, uint32_t& index) {
+        auto it = segmentOutputs.find(ref);
+        if (it == segmentOutputs.end()) return false;
+        index = it->second;
+        return true;
+    };
+
+    // Level after the latest producer in the segment. Producers of feedback values go after their readers
+    std::vector<uint32_t> level(count, 0);
+    std::vector<std::vector<uint32_t>> feedbackReaders(count);
+    for (uint32_t i = 0; i < count; i++) {
+        const Instruction& instr = instructions[begin + i];
+        for (uint8_t b = 0; b < instr.numInputBindings; b++) {
+            uint32_t producer;
+            if (!segmentIndex(instr.inputBindings[b].source, producer) || producer == i) continue;
+            if (producer < i) level[i] = std::max(level[i], level[producer] + 1);
+            else feedbackReaders[producer].push_back(i);
+        }
+        for (uint32_t reader : feedbackReaders[i]) level[i] = std::max(level[i], level[reader] + 1);
+    }
+
+    // Group functions by level, type and input count
+    std::map<std::tuple<uint32_t, uint8_t, uint8_t>, std::vector<uint32_t>> keyedMembers;
+    for (uint32_t i = 0; i < count; i++) {
+        const Instruction& instr = instructions[begin + i];
+        keyedMembers[std::make_tuple(level[i], (uint8_t)(instr.opcode & 0xFF), instr.numInputs)].push_back(i);
+    }
+    std::vector<uint32_t> outputBit(count);
+    for (const auto& keyed : keyedMembers) {
+        const std::vector<uint32_t>& list = keyed.second;
+        for (size_t first = 0; first < list.size(); first += 64) {
+            Group group = {
+                .funcID         = std::get<1>(keyed.first),
+                .numInputs      = std::get<2>(keyed.first),
+                .size           = (uint8_t)std::min(list.size() - first, (size_t)64),
+                .word           = (uint32_t)groups.size(),
+                .firstSource    = 0,
+                .firstInvert    = 0,
+                .firstMember    = (uint32_t)members.size(),
+                .state          = 0
+            };
+            for (uint8_t j = 0; j < group.size; j++) {
+                uint32_t index = list[first + j];
+                const Instruction& instr = instructions[begin + index];
+                outputBit[index] = group.word * 64 + j;
+                members.push_back({ instr.func, instr.outputs });
+            }
+            groups.push_back(group);
+        }
+    }
+    firstLoadWord = groups.size();
+
+    // Resolve input sources to bits. Values from outside the segment and constants are loaded
+    std::map<const IOValue*, uint32_t> loadBits;
+    auto loadBit = [&](const IOValue* source) {
+        auto it = loadBits.find(source);
+        if (it != loadBits.end()) return it->second;
+        uint32_t bit = firstLoadWord * 64 + loads.size();
+        loads.push_back({ source, bit });
+        loadBits[source] = bit;
+        return bit;
+    };
+    for (Group& group : groups) {
+        group.firstSource = sourceBits.size();
+        group.firstInvert = invertMasks.size();
+        sourceBits.resize(sourceBits.size() + group.numInputs * group.size);
+        invertMasks.resize(invertMasks.size() + group.numInputs, 0);
+        for (uint8_t j = 0; j < group.size; j++) {
+            FunctionBlock* func = members[group.firstMember + j].func;
+            const uint8_t* flags = func->inputFlags();
+            const InputBinding* binding = func->inputBindings;
+            for (uint8_t k = 0; k < group.numInputs; k++) {
+                uint32_t source;
+                if (!(flags[k] & IO_FLAG_REF)) {
+                    source = loadBit(&func->inputs()[k]);
+                } else {
+                    uint32_t producer;
+                    if (segmentIndex(binding->source, producer)) source = outputBit[producer];
+                    else source = loadBit(binding->source);
+                    if (binding->op == BIND_REF_INVERT) invertMasks[group.firstInvert + k] |= (uint64_t)1 << j;
+                    binding++;
+                }
+                sourceBits[group.firstSource + k * group.size + j] = source;
+            }
+        }
+    }
+
+    // Start from current output values
+    bits.assign(firstLoadWord + (loads.size() + 63) / 64, 0);
+    reload();
+}
+
+void PackedLogic::reload() {
+    for (Group& group : groups) {
+        uint64_t word = 0;
+        uint64_t state = 0;
+        for (uint8_t j = 0; j < group.size; j++) {
+            const Member& member = members[group.firstMember + j];
+            word |= (uint64_t)(member.output->u != 0) << j;
+            // Edge functions continue from their current state
+            if (group.funcID == LogicLib::FUNC_ID_RisingEdge) state |= (uint64_t)(((LogicLib::RisingEdge*)member.func)->prevInput != 0) << j;
+            if (group.funcID == LogicLib::FUNC_ID_FallingEdge) state |= (uint64_t)(((LogicLib::FallingEdge*)member.func)->prevInput != 0) << j;
+        }
+        bits[group.word] = word;
+        group.state = state;
+    }
+}
+
+// Input k of every group member as a word
+uint64_t IRAM_ATTR PackedLogic::gather(const Group& group, uint8_t input) {
+    const uint32_t* source = &sourceBits[group.firstSource + input * group.size];
+    uint64_t word = 0;
+    for (uint8_t j = 0; j < group.size; j++) word |= bit(source[j]) << j;
+    return word ^ invertMasks[group.firstInvert + input];
+}
+
+void IRAM_ATTR PackedLogic::writeBack(const Group& group, uint64_t outputs) {
+    for (uint8_t j = 0; j < group.size; j++) {
+        const Member& member = members[group.firstMember + j];
+        member.output->u = (outputs >> j) & 1;
+    }
+}
+
+void IRAM_ATTR PackedLogic::run() {
+    // Load values from outside the segment
+    for (uint32_t w = firstLoadWord; w < bits.size(); w++) bits[w] = 0;
+    for (const Load& load : loads) {
+        if (load.source->u) bits[load.bit >> 6] |= (uint64_t)1 << (load.bit & 63);
+    }
+
+    for (Group& group : groups) {
+        const uint64_t mask = (group.size == 64) ? ~(uint64_t)0 : (((uint64_t)1 << group.size) - 1);
+        const uint64_t previous = bits[group.word];
+        uint64_t result = 0;
+        switch (group.funcID) {
+            case LogicLib::FUNC_ID_AND: {
+                result = ~(uint64_t)0;
+                for (uint8_t k = 0; k < group.numInputs; k++) result &= gather(group, k);
+                break;
+            }
+            case LogicLib::FUNC_ID_OR: {
+                for (uint8_t k = 0; k < group.numInputs; k++) result |= gather(group, k);
+                break;
+            }
+            case LogicLib::FUNC_ID_XOR: {
+                // Exactly one input set
+                uint64_t ones = 0, many = 0;
+                for (uint8_t k = 0; k < group.numInputs; k++) {
+                    uint64_t input = gather(group, k);
+                    many |= ones & input;
+                    ones |= input;
+                }
+                result = ones & ~many;
+                break;
+            }
+            case LogicLib::FUNC_ID_NOT: {
+                result = ~gather(group, 0);
+                break;
+            }
+            // First input resets, second input sets
+            case LogicLib::FUNC_ID_RS:
+            case LogicLib::FUNC_ID_SR: {
+                result = ~gather(group, 0) & (gather(group, 1) | previous);
+                break;
+            }
+            case LogicLib::FUNC_ID_RisingEdge: {
+                uint64_t input = gather(group, 0);
+                result = input & ~group.state;
+                group.state = input;
+                for (uint8_t j = 0; j < group.size; j++) ((LogicLib::RisingEdge*)members[group.firstMember + j].func)->prevInput = (input >> j) & 1;
+                break;
+            }
+            case LogicLib::FUNC_ID_FallingEdge: {
+                uint64_t input = gather(group, 0);
+                result = ~input & group.state;
+                group.state = input;
+                for (uint8_t j = 0; j < group.size; j++) ((LogicLib::FallingEdge*)members[group.firstMember + j].func)->prevInput = (input >> j) & 1;
+                break;
+            }
+        }
+        result &= mask;
+        bits[group.word] = result;
+        writeBack(group, result);
+    }
+}
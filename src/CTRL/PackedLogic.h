@@ -0,0 +1,63 @@
+#pragma once
+
+#include "Common.h"
+#include "FunctionBlock.h"
+
+struct Instruction;
+
+// Consecutive LogicLib functions of an execution plan evaluated on boolean signals packed as bits.
+// Functions of the same type and input count on the same dependency level form a group of up to 64
+// functions, which is evaluated with word operations. Outputs are written back to IO values for
+// other consumers and monitoring
+class PackedLogic
+{
+    struct Group {
+        uint8_t     funcID;
+        uint8_t     numInputs;
+        uint8_t     size;
+        uint32_t    word;           // Output word in bits
+        uint32_t    firstSource;    // Source bits, input major
+        uint32_t    firstInvert;    // Inversion mask per input
+        uint32_t    firstMember;
+        uint64_t    state;          // Previous inputs of edge functions
+    };
+
+    // Member function of a group
+    struct Member {
+        FunctionBlock*  func;
+        IOValue*        output;
+    };
+
+    // Value read from outside the segment at the start of each run
+    struct Load {
+        const IOValue*  source;
+        uint32_t        bit;
+    };
+
+    std::vector<uint64_t>   bits;
+    std::vector<Group>      groups;
+    std::vector<uint32_t>   sourceBits;
+    std::vector<uint64_t>   invertMasks;
+    std::vector<Member>     members;
+    std::vector<Load>       loads;
+    uint32_t                firstLoadWord = 0;
+
+    inline uint64_t bit(uint32_t index) { return (bits[index >> 6] >> (index & 63)) & 1; }
+    uint64_t gather(const Group& group, uint8_t input);
+    void writeBack(const Group& group, uint64_t outputs);
+
+public:
+    // Plan instruction range of the segment
+    uint32_t begin;
+    uint32_t end;
+
+    // Find segments of packable functions in plan instructions
+    static std::vector<PackedLogic> build(const std::vector<Instruction>& instructions);
+
+    PackedLogic(const std::vector<Instruction>& instructions, uint32_t begin, uint32_t end);
+
+    void run();
+
+    // Take output bits and edge states from the member functions, after they have been run unpacked
+    void reload();
+};
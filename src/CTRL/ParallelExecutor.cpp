@@ -0,0 +1,200 @@
+#ifndef ARDUINO
+
+#include "ParallelExecutor.h"
+#include "Circuit.h"
+#include "Controller.h"
+#include <algorithm>
+
+ParallelExecutor::ParallelExecutor(uint32_t threadCount) :
+    ranges (threadCount ? threadCount : 1)
+{
+    if (threadCount == 0) threadCount = 1;
+    inputBuffers.resize(threadCount);
+    for (uint32_t i = 1; i < threadCount; i++) {
+        threads.emplace_back(&ParallelExecutor::threadLoop, this, i);
+    }
+}
+
+ParallelExecutor::~ParallelExecutor() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) thread.join();
+}
+
+// Output storage range of a plan instruction
+struct InstructionOutputs {
+    const IOValue*  begin;
+    const IOValue*  end;
+    uint32_t        producer;
+};
+
+// A function is placed on the level after its latest producer. Producers of feedback values are
+// placed after the functions reading them, so the previous cycle value is read as in sequential run
+void ParallelExecutor::compile(Circuit* circ) {
+    if (!circ->plan.isValid()) circ->compile();
+    const std::vector<Instruction>& planInstructions = circ->plan.instructions;
+    const uint32_t count = planInstructions.size();
+
+    std::vector<InstructionOutputs> outputs;
+    for (uint32_t i = 0; i < count; i++) {
+        const Instruction& instr = planInstructions[i];
+        if (instr.numOutputs) outputs.push_back({ instr.outputs, instr.outputs + instr.numOutputs, i });
+    }
+    std::sort(outputs.begin(), outputs.end(), [](const InstructionOutputs& a, const InstructionOutputs& b) { return a.begin < b.begin; });
+
+    auto findProducer = [&outputs](const IOValue* ref, uint32_t& producer) {
+        auto it = std::upper_bound(outputs.begin(), outputs.end(), ref,
+            [](const IOValue* ref, const InstructionOutputs& range) { return ref < range.begin; });
+        if (it == outputs.begin() || ref >= (it - 1)->end) return false;
+        producer = (it - 1)->producer;
+        return true;
+    };
+
+    // Collect read references of each instruction
+    std::vector<std::vector<uint32_t>> producers(count);
+    std::vector<std::vector<uint32_t>> feedbackReaders(count);
+    for (uint32_t i = 0; i < count; i++) {
+        const Instruction& instr = planInstructions[i];
+        std::vector<const IOValue*> refs;
+        for (uint8_t b = 0; b < instr.numInputBindings; b++) refs.push_back(instr.inputBindings[b].source);
+        if (instr.opcode == OPCODE_CIRCUIT) {
+            Circuit* nested = (Circuit*)instr.func;
+            for (uint8_t o = 0; o < nested->numOutputs; o++) {
+                if (nested->outputRefs[o]) refs.push_back(nested->outputRefs[o]);
+            }
+        }
+        for (const IOValue* ref : refs) {
+            uint32_t producer;
+            if (!findProducer(ref, producer) || producer == i) continue;
+            if (producer < i) producers[i].push_back(producer);
+            else feedbackReaders[producer].push_back(i);
+        }
+    }
+
+    std::vector<uint32_t> level(count, 0);
+    uint32_t maxLevel = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        for (uint32_t producer : producers[i]) level[i] = std::max(level[i], level[producer] + 1);
+        for (uint32_t reader : feedbackReaders[i]) level[i] = std::max(level[i], level[reader] + 1);
+        maxLevel = std::max(maxLevel, level[i]);
+    }
+
+    // Order instructions by level keeping plan order within a level
+    levelIndex.assign(count ? maxLevel + 2 : 1, 0);
+    for (uint32_t i = 0; i < count; i++) levelIndex[level[i] + 1]++;
+    for (size_t l = 1; l < levelIndex.size(); l++) levelIndex[l] += levelIndex[l - 1];
+    std::vector<uint32_t> position(levelIndex.begin(), levelIndex.end() - 1);
+    instructions.resize(count);
+    size_t maxInputs = 1;
+    for (uint32_t i = 0; i < count; i++) {
+        instructions[position[level[i]]++] = planInstructions[i];
+        maxInputs = std::max(maxInputs, (size_t)planInstructions[i].numInputs);
+    }
+    for (std::vector<IOValue>& buffer : inputBuffers) buffer.resize(maxInputs);
+
+    circuit = circ;
+    compiledRevision = ExecutionPlan::revision;
+}
+
+void ParallelExecutor::run(Circuit* circ, uint32_t dt) {
+    if (circ != circuit || compiledRevision != ExecutionPlan::revision || !circ->plan.isValid()) compile(circ);
+    this->dt = dt;
+    const uint32_t threadCount = this->threadCount();
+
+    for (uint32_t l = 0; l < levelCount(); l++) {
+        const uint32_t begin = levelIndex[l];
+        const uint32_t end = levelIndex[l + 1];
+        const uint32_t size = end - begin;
+        // Run small levels on the calling thread
+        if (threadCount == 1 || size < parallelThreshold) {
+            IOValue* buffer = inputBuffers[0].data();
+            for (uint32_t i = begin; i < end; i++) ExecutionPlan::execute(instructions[i], buffer, dt);
+            continue;
+        }
+        // Split level evenly between threads
+        levelInstructions = &instructions[begin];
+        for (uint32_t t = 0; t < threadCount; t++) {
+            uint64_t rangeBegin = (uint64_t)size * t / threadCount;
+            uint64_t rangeEnd = (uint64_t)size * (t + 1) / threadCount;
+            ranges[t].range.store(rangeBegin | rangeEnd << 32, std::memory_order_relaxed);
+        }
+        pending.store(threads.size(), std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            generation++;
+        }
+        wake.notify_all();
+        runLevel(0);
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending.load(std::memory_order_acquire) == 0; });
+    }
+
+    // Update circuit outputs from references
+    Circuit::updateOutputs(circ, circ->inputs(), circ->outputs(), dt);
+}
+
+void ParallelExecutor::threadLoop(uint32_t thread) {
+    uint32_t seenGeneration = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) return;
+            seenGeneration = generation;
+        }
+        runLevel(thread);
+        if (pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.notify_one();
+        }
+    }
+}
+
+void ParallelExecutor::runLevel(uint32_t thread) {
+    IOValue* buffer = inputBuffers[thread].data();
+    uint32_t begin, end;
+    while (takeWork(thread, begin, end) || stealWork(thread, begin, end)) {
+        for (uint32_t i = begin; i < end; i++) ExecutionPlan::execute(levelInstructions[i], buffer, dt);
+    }
+}
+
+// Take a grain from the front of own range
+bool ParallelExecutor::takeWork(uint32_t thread, uint32_t& begin, uint32_t& end) {
+    std::atomic<uint64_t>& range = ranges[thread].range;
+    uint64_t current = range.load(std::memory_order_acquire);
+    for (;;) {
+        uint32_t rangeBegin = current, rangeEnd = current >> 32;
+        if (rangeBegin >= rangeEnd) return false;
+        uint32_t taken = std::min(rangeBegin + grainSize, rangeEnd);
+        if (range.compare_exchange_weak(current, taken | (uint64_t)rangeEnd << 32, std::memory_order_acq_rel)) {
+            begin = rangeBegin;
+            end = taken;
+            return true;
+        }
+    }
+}
+
+// Take a grain from the back of another thread's range
+bool ParallelExecutor::stealWork(uint32_t thread, uint32_t& begin, uint32_t& end) {
+    const uint32_t threadCount = this->threadCount();
+    for (uint32_t offset = 1; offset < threadCount; offset++) {
+        std::atomic<uint64_t>& range = ranges[(thread + offset) % threadCount].range;
+        uint64_t current = range.load(std::memory_order_acquire);
+        for (;;) {
+            uint32_t rangeBegin = current, rangeEnd = current >> 32;
+            if (rangeBegin >= rangeEnd) break;
+            uint32_t stolen = rangeEnd - std::min(grainSize, rangeEnd - rangeBegin);
+            if (range.compare_exchange_weak(current, rangeBegin | (uint64_t)stolen << 32, std::memory_order_acq_rel)) {
+                begin = stolen;
+                end = rangeEnd;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+#endif
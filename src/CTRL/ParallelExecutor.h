@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Common.h"
+#include "ExecutionPlan.h"
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+class Circuit;
+
+// Runs a circuit on a pool of threads. Plan instructions are grouped to levels of independent
+// functions, each level is split between threads which steal work from each other when done.
+// Results are identical to sequential Circuit::run. Host builds only, the firmware runs circuits
+// on the task workers
+class ParallelExecutor
+{
+    // Instruction range of a thread packed as begin | end << 32. Owner takes from the front,
+    // other threads steal from the back
+    struct alignas(64) WorkRange {
+        std::atomic<uint64_t> range {0};
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<WorkRange> ranges;
+    std::vector<std::vector<IOValue>> inputBuffers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    uint32_t generation = 0;
+    bool stopping = false;
+    std::atomic<uint32_t> pending {0};
+
+    // Level ordered instructions of the compiled circuit
+    const Circuit* circuit = nullptr;
+    uint32_t compiledRevision = 0;
+    std::vector<Instruction> instructions;
+    std::vector<uint32_t> levelIndex;
+    const Instruction* levelInstructions = nullptr;
+    uint32_t dt = 0;
+
+    void compile(Circuit* circ);
+    void runLevel(uint32_t thread);
+    bool takeWork(uint32_t thread, uint32_t& begin, uint32_t& end);
+    bool stealWork(uint32_t thread, uint32_t& begin, uint32_t& end);
+    void threadLoop(uint32_t thread);
+
+public:
+    // Instructions taken from a range at a time
+    uint32_t grainSize = 64;
+    // Smaller levels are run on the calling thread
+    uint32_t parallelThreshold = 256;
+
+    // Calling thread takes part in execution, so threadCount - 1 threads are started
+    ParallelExecutor(uint32_t threadCount = std::thread::hardware_concurrency());
+    ~ParallelExecutor();
+
+    // Run one cycle of the circuit
+    void run(Circuit* circ, uint32_t dt);
+
+    inline uint32_t levelCount() { return levelIndex.size() ? levelIndex.size() - 1 : 0; }
+    inline uint32_t threadCount() { return threads.size() + 1; }
+};
@@ -0,0 +1,284 @@
+#pragma once
+
+#include "Common.h"
+#include "FunctionBlock.h"
+
+// Reductions over function input values for variadic blocks. Vector instructions are selected at
+// build time: AVX2, SSE2 or NEON on host builds, plain loops elsewhere. Integer and boolean results
+// are identical on every backend, float sums and products are reassociated on vector backends.
+//
+// Fused variants read connected inputs directly from their sources, so the inputs are not gathered
+// to a buffer first. Bindings must be plain references or inverted references
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define SIMD_BACKEND_AVX2
+    #define SIMD_VECTOR
+    #define SIMD_BACKEND_NAME "AVX2"
+#elif defined(__SSE2__)
+    #include <immintrin.h>
+    #define SIMD_BACKEND_SSE2
+    #define SIMD_VECTOR
+    #define SIMD_BACKEND_NAME "SSE2"
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+    #define SIMD_BACKEND_NEON
+    #define SIMD_VECTOR
+    #define SIMD_BACKEND_NAME "NEON"
+#else
+    #define SIMD_BACKEND_NAME "portable"
+#endif
+
+namespace Simd
+{
+
+// IO values are 4 bytes on target. On 64 bit hosts the reference member widens them to 8 bytes,
+// so loads pick the low word of each value
+static const bool WIDE_IO_VALUE = (sizeof(IOValue) == 8);
+
+#if defined(SIMD_BACKEND_AVX2)
+
+static const uint32_t WIDTH = 8;
+typedef __m256  VecF;
+typedef __m256i VecU;
+
+inline VecF loadF(const IOValue* values) {
+    if (!WIDE_IO_VALUE) return _mm256_loadu_ps((const float*)values);
+    // Lane order is mixed, which does not matter for reductions
+    __m256 a = _mm256_loadu_ps((const float*)values);
+    __m256 b = _mm256_loadu_ps((const float*)(values + 4));
+    return _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+}
+inline VecU loadU(const IOValue* values)    { return _mm256_castps_si256(loadF(values)); }
+inline void storeF(float* out, VecF v)      { _mm256_storeu_ps(out, v); }
+inline void storeU(uint32_t* out, VecU v)   { _mm256_storeu_si256((__m256i*)out, v); }
+inline VecF addF(VecF a, VecF b)            { return _mm256_add_ps(a, b); }
+inline VecF mulF(VecF a, VecF b)            { return _mm256_mul_ps(a, b); }
+inline VecU addU(VecU a, VecU b)            { return _mm256_add_epi32(a, b); }
+inline VecU mulU(VecU a, VecU b)            { return _mm256_mullo_epi32(a, b); }
+inline VecU orU(VecU a, VecU b)             { return _mm256_or_si256(a, b); }
+inline VecU zeroU()                         { return _mm256_setzero_si256(); }
+inline VecU eqZeroU(VecU v)                 { return _mm256_cmpeq_epi32(v, _mm256_setzero_si256()); }
+inline bool anyU(VecU v)                    { return !_mm256_testz_si256(v, v); }
+
+#elif defined(SIMD_BACKEND_SSE2)
+
+static const uint32_t WIDTH = 4;
+typedef __m128  VecF;
+typedef __m128i VecU;
+
+inline VecF loadF(const IOValue* values) {
+    if (!WIDE_IO_VALUE) return _mm_loadu_ps((const float*)values);
+    __m128 a = _mm_loadu_ps((const float*)values);
+    __m128 b = _mm_loadu_ps((const float*)(values + 2));
+    return _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+}
+inline VecU loadU(const IOValue* values)    { return _mm_castps_si128(loadF(values)); }
+inline void storeF(float* out, VecF v)      { _mm_storeu_ps(out, v); }
+inline void storeU(uint32_t* out, VecU v)   { _mm_storeu_si128((__m128i*)out, v); }
+inline VecF addF(VecF a, VecF b)            { return _mm_add_ps(a, b); }
+inline VecF mulF(VecF a, VecF b)            { return _mm_mul_ps(a, b); }
+inline VecU addU(VecU a, VecU b)            { return _mm_add_epi32(a, b); }
+inline VecU mulU(VecU a, VecU b) {
+#if defined(__SSE4_1__)
+    return _mm_mullo_epi32(a, b);
+#else
+    // Multiply even and odd lanes separately and interleave low words of the products
+    __m128i even = _mm_mul_epu32(a, b);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+#endif
+}
+inline VecU orU(VecU a, VecU b)             { return _mm_or_si128(a, b); }
+inline VecU zeroU()                         { return _mm_setzero_si128(); }
+inline VecU eqZeroU(VecU v)                 { return _mm_cmpeq_epi32(v, _mm_setzero_si128()); }
+inline bool anyU(VecU v)                    { return _mm_movemask_epi8(_mm_cmpeq_epi32(v, _mm_setzero_si128())) != 0xFFFF; }
+
+#elif defined(SIMD_BACKEND_NEON)
+
+static const uint32_t WIDTH = 4;
+typedef float32x4_t VecF;
+typedef uint32x4_t  VecU;
+
+inline VecU loadU(const IOValue* values) {
+    if (!WIDE_IO_VALUE) return vld1q_u32((const uint32_t*)values);
+    return vld2q_u32((const uint32_t*)values).val[0];
+}
+inline VecF loadF(const IOValue* values)    { return vreinterpretq_f32_u32(loadU(values)); }
+inline void storeF(float* out, VecF v)      { vst1q_f32(out, v); }
+inline void storeU(uint32_t* out, VecU v)   { vst1q_u32(out, v); }
+inline VecF addF(VecF a, VecF b)            { return vaddq_f32(a, b); }
+inline VecF mulF(VecF a, VecF b)            { return vmulq_f32(a, b); }
+inline VecU addU(VecU a, VecU b)            { return vaddq_u32(a, b); }
+inline VecU mulU(VecU a, VecU b)            { return vmulq_u32(a, b); }
+inline VecU orU(VecU a, VecU b)             { return vorrq_u32(a, b); }
+inline VecU zeroU()                         { return vdupq_n_u32(0); }
+inline VecU eqZeroU(VecU v)                 { return vceqq_u32(v, vdupq_n_u32(0)); }
+inline bool anyU(VecU v) {
+    uint32x2_t folded = vorr_u32(vget_low_u32(v), vget_high_u32(v));
+    return (vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) != 0;
+}
+
+#else
+
+static const uint32_t WIDTH = 0;
+
+#endif
+
+// Vector loops are used when the block has at least two full vectors of inputs
+#define SIMD_MIN_COUNT (2 * Simd::WIDTH)
+
+inline float sumFloat(const IOValue* values, uint32_t count) {
+    float result = values[0].f;
+    uint32_t i = 1;
+#ifdef SIMD_VECTOR
+    if (count >= SIMD_MIN_COUNT) {
+        VecF acc = loadF(values);
+        for (i = WIDTH; i + WIDTH <= count; i += WIDTH) acc = addF(acc, loadF(values + i));
+        float lanes[WIDTH];
+        storeF(lanes, acc);
+        result = lanes[0];
+        for (uint32_t l = 1; l < WIDTH; l++) result += lanes[l];
+    }
+#endif
+    for (; i < count; i++) result += values[i].f;
+    return result;
+}
+
+inline float productFloat(const IOValue* values, uint32_t count) {
+    float result = values[0].f;
+    uint32_t i = 1;
+#ifdef SIMD_VECTOR
+    if (count >= SIMD_MIN_COUNT) {
+        VecF acc = loadF(values);
+        for (i = WIDTH; i + WIDTH <= count; i += WIDTH) acc = mulF(acc, loadF(values + i));
+        float lanes[WIDTH];
+        storeF(lanes, acc);
+        result = lanes[0];
+        for (uint32_t l = 1; l < WIDTH; l++) result *= lanes[l];
+    }
+#endif
+    for (; i < count; i++) result *= values[i].f;
+    return result;
+}
+
+// Wrapping sum, same for signed and unsigned values
+inline uint32_t sumUint(const IOValue* values, uint32_t count) {
+    uint32_t result = values[0].u;
+    uint32_t i = 1;
+#ifdef SIMD_VECTOR
+    if (count >= SIMD_MIN_COUNT) {
+        VecU acc = loadU(values);
+        for (i = WIDTH; i + WIDTH <= count; i += WIDTH) acc = addU(acc, loadU(values + i));
+        uint32_t lanes[WIDTH];
+        storeU(lanes, acc);
+        result = lanes[0];
+        for (uint32_t l = 1; l < WIDTH; l++) result += lanes[l];
+    }
+#endif
+    for (; i < count; i++) result += values[i].u;
+    return result;
+}
+
+// Wrapping product, same for signed and unsigned values
+inline uint32_t productUint(const IOValue* values, uint32_t count) {
+    uint32_t result = values[0].u;
+    uint32_t i = 1;
+#ifdef SIMD_VECTOR
+    if (count >= SIMD_MIN_COUNT) {
+        VecU acc = loadU(values);
+        for (i = WIDTH; i + WIDTH <= count; i += WIDTH) acc = mulU(acc, loadU(values + i));
+        uint32_t lanes[WIDTH];
+        storeU(lanes, acc);
+        result = lanes[0];
+        for (uint32_t l = 1; l < WIDTH; l++) result *= lanes[l];
+    }
+#endif
+    for (; i < count; i++) result *= values[i].u;
+    return result;
+}
+
+// True if no value is zero
+inline bool allTrue(const IOValue* values, uint32_t count) {
+    uint32_t i = 0;
+#ifdef SIMD_VECTOR
+    if (count >= SIMD_MIN_COUNT) {
+        VecU zeros = zeroU();
+        for (; i + WIDTH <= count; i += WIDTH) zeros = orU(zeros, eqZeroU(loadU(values + i)));
+        if (anyU(zeros)) return false;
+    }
+#endif
+    for (; i < count; i++) {
+        if (!values[i].u) return false;
+    }
+    return true;
+}
+
+// True if any value is not zero
+inline bool anyTrue(const IOValue* values, uint32_t count) {
+    uint32_t i = 0;
+#ifdef SIMD_VECTOR
+    if (count >= SIMD_MIN_COUNT) {
+        VecU bits = zeroU();
+        for (; i + WIDTH <= count; i += WIDTH) bits = orU(bits, loadU(values + i));
+        if (anyU(bits)) return true;
+    }
+#endif
+    for (; i < count; i++) {
+        if (values[i].u) return true;
+    }
+    return false;
+}
+
+// Fetch an input value, reading connected inputs through the next binding. Bindings are in input order
+inline IOValue fetchInput(const IOValue* inputs, const uint8_t* flags, uint32_t index, const InputBinding*& binding) {
+    if (!(flags[index] & IO_FLAG_REF)) return inputs[index];
+    IOValue value = *binding->source;
+    if (binding->op == BIND_REF_INVERT) value.u = (value.u) ? 0 : 1;
+    binding++;
+    return value;
+}
+
+// Fused variants keep the input order, so results equal the gathered scalar loop
+
+inline float sumFloat(const IOValue* inputs, const uint8_t* flags, uint32_t count, const InputBinding* bindings) {
+    float result = fetchInput(inputs, flags, 0, bindings).f;
+    for (uint32_t i = 1; i < count; i++) result += fetchInput(inputs, flags, i, bindings).f;
+    return result;
+}
+
+inline float productFloat(const IOValue* inputs, const uint8_t* flags, uint32_t count, const InputBinding* bindings) {
+    float result = fetchInput(inputs, flags, 0, bindings).f;
+    for (uint32_t i = 1; i < count; i++) result *= fetchInput(inputs, flags, i, bindings).f;
+    return result;
+}
+
+inline uint32_t sumUint(const IOValue* inputs, const uint8_t* flags, uint32_t count, const InputBinding* bindings) {
+    uint32_t result = fetchInput(inputs, flags, 0, bindings).u;
+    for (uint32_t i = 1; i < count; i++) result += fetchInput(inputs, flags, i, bindings).u;
+    return result;
+}
+
+inline uint32_t productUint(const IOValue* inputs, const uint8_t* flags, uint32_t count, const InputBinding* bindings) {
+    uint32_t result = fetchInput(inputs, flags, 0, bindings).u;
+    for (uint32_t i = 1; i < count; i++) result *= fetchInput(inputs, flags, i, bindings).u;
+    return result;
+}
+
+// Stops at the first false input
+inline bool allTrue(const IOValue* inputs, const uint8_t* flags, uint32_t count, const InputBinding* bindings) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (!fetchInput(inputs, flags, i, bindings).u) return false;
+    }
+    return true;
+}
+
+// Stops at the first true input
+inline bool anyTrue(const IOValue* inputs, const uint8_t* flags, uint32_t count, const InputBinding* bindings) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (fetchInput(inputs, flags, i, bindings).u) return true;
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,140 @@
+#include "TraceRecorder.h"
+#include "FunctionBlock.h"
+#include "HAL.h"
+
+static uint32_t roundUpPow2(uint32_t value) {
+    uint32_t result = 1;
+    while (result < value) result <<= 1;
+    return result;
+}
+
+static inline IOValue readSignal(const TraceSignal& signal) {
+    FunctionBlock* func = signal.func;
+    return (signal.ioNum < func->numInputs) ? func->inputValue(signal.ioNum) : func->ioValues[signal.ioNum];
+}
+
+uint32_t TraceRecorder::ringWords(uint32_t capacity, uint32_t signalCount) {
+    return roundUpPow2(capacity) * (1 + signalCount);
+}
+
+TraceRecorder::TraceRecorder(const std::vector<TraceSignal>& signals, uint32_t capacity, uint32_t chunkSamples) :
+    signals (signals),
+    capacityMask (roundUpPow2(capacity) - 1),
+    chunkSamples (chunkSamples)
+{
+    ring.resize(ringWords(capacity, signals.size()));
+}
+
+// Constant time per signal, no allocation. Nothing is done while a capture waits for upload
+bool IRAM_ATTR TraceRecorder::capture(uint32_t timeStamp) {
+    const TRACE_STATE current = state.load(std::memory_order_acquire);
+    if (current == TRACE_STATE_COMPLETE || current == TRACE_STATE_IDLE) return false;
+
+    const uint32_t startCycles = HAL::cycleCount();
+    const uint32_t sampleNum = head.load(std::memory_order_relaxed);
+    if (current == TRACE_STATE_STREAMING && sampleNum - tail.load(std::memory_order_acquire) > capacityMask) {
+        droppedSamples.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    uint32_t* sample = &ring[(sampleNum & capacityMask) * sampleWords()];
+    sample[0] = timeStamp;
+    for (size_t i = 0; i < signals.size(); i++) {
+        sample[1 + i] = readSignal(signals[i]).u;
+    }
+    head.store(sampleNum + 1, std::memory_order_release);
+
+    bool completed = false;
+    if (current == TRACE_STATE_STREAMING) {
+        completed = (sampleNum + 1 - tail.load(std::memory_order_relaxed)) == chunkSamples;
+    }
+    else if (current == TRACE_STATE_ARMED) {
+        if (triggerFired(readTriggerValue())) {
+            triggerSample = sampleNum;
+            postTriggerLeft = postTrigger;
+            triggerCount++;
+            completed = (postTrigger == 0);
+            state.store(completed ? TRACE_STATE_COMPLETE : TRACE_STATE_TRIGGERED, std::memory_order_release);
+        }
+    }
+    else if (--postTriggerLeft == 0) {
+        completed = true;
+        state.store(TRACE_STATE_COMPLETE, std::memory_order_release);
+    }
+
+    lastCaptureCycles = HAL::cycleCount() - startCycles;
+    if (lastCaptureCycles > maxCaptureCycles) maxCaptureCycles = lastCaptureCycles;
+    return completed;
+}
+
+float IRAM_ATTR TraceRecorder::readTriggerValue() {
+    FunctionBlock* func = triggerSignal.func;
+    const uint8_t ioNum = triggerSignal.ioNum;
+    const IOValue value = readSignal(triggerSignal);
+    const IO_TYPE type = (ioNum < func->numInputs) ? func->readInputType(ioNum) : func->readOutputType(ioNum - func->numInputs);
+    switch (type) {
+        case IO_TYPE_FLOAT: return value.f;
+        case IO_TYPE_INT:   return value.i;
+        default:            return value.u;
+    }
+}
+
+// Edges need a previous value. The first value after arming only sets it
+bool IRAM_ATTR TraceRecorder::triggerFired(float value) {
+    bool fired = false;
+    switch (triggerCondition) {
+        case TRACE_TRIGGER_RISING:   fired = hasPreviousValue && previousValue < threshold && value >= threshold; break;
+        case TRACE_TRIGGER_FALLING:  fired = hasPreviousValue && previousValue >= threshold && value < threshold; break;
+        case TRACE_TRIGGER_CROSSING: fired = hasPreviousValue && (previousValue < threshold) != (value < threshold); break;
+        case TRACE_TRIGGER_TRUE:     fired = (value != 0); break;
+        default: break;
+    }
+    previousValue = value;
+    hasPreviousValue = true;
+    return fired;
+}
+
+void TraceRecorder::copySamples(uint32_t* dest, uint32_t first, uint32_t count) {
+    const uint32_t words = sampleWords();
+    for (uint32_t n = 0; n < count; n++) {
+        memcpy(&dest[n * words], &ring[((first + n) & capacityMask) * words], words * sizeof(uint32_t));
+    }
+}
+
+uint32_t TraceRecorder::read(uint32_t* dest, uint32_t maxSamples) {
+    const uint32_t first = tail.load(std::memory_order_relaxed);
+    const uint32_t count = std::min(available(), maxSamples);
+    copySamples(dest, first, count);
+    tail.store(first + count, std::memory_order_release);
+    return count;
+}
+
+bool TraceRecorder::setTrigger(TraceSignal signal, TRACE_TRIGGER condition, float threshold, uint32_t preTrigger, uint32_t postTrigger, bool rearm) {
+    if (condition != TRACE_TRIGGER_NONE && (preTrigger >= capacity() || postTrigger > capacity() - 1 - preTrigger)) return false;
+    triggerSignal = signal;
+    triggerCondition = condition;
+    this->threshold = threshold;
+    this->preTrigger = preTrigger;
+    this->postTrigger = postTrigger;
+    this->rearm = rearm;
+    hasPreviousValue = false;
+    // Start over with an empty ring
+    const uint32_t sampleNum = head.load(std::memory_order_relaxed);
+    tail.store(sampleNum, std::memory_order_relaxed);
+    armedSample = sampleNum;
+    state.store((condition == TRACE_TRIGGER_NONE) ? TRACE_STATE_STREAMING : TRACE_STATE_ARMED, std::memory_order_release);
+    return true;
+}
+
+// Pre-trigger history is limited to the samples recorded since arming
+uint32_t TraceRecorder::readCapture(uint32_t* dest, uint32_t& triggerIndex) {
+    if (state.load(std::memory_order_acquire) != TRACE_STATE_COMPLETE) return 0;
+    const uint32_t end = head.load(std::memory_order_relaxed);
+    const uint32_t history = std::min(preTrigger, triggerSample - armedSample);
+    const uint32_t first = triggerSample - history;
+    copySamples(dest, first, end - first);
+    triggerIndex = history;
+    armedSample = end;
+    hasPreviousValue = false;
+    state.store(rearm ? TRACE_STATE_ARMED : TRACE_STATE_IDLE, std::memory_order_release);
+    return end - first;
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "Common.h"
+#include <atomic>
+
+// Signals captured per sample at most
+#define TRACE_MAX_SIGNALS       16
+// Largest ring buffer in 32-bit words, timestamps included
+#define TRACE_MAX_RING_WORDS    16384
+
+class FunctionBlock;
+
+// Traced IO value of a function. IO numbers count inputs first, then outputs
+struct TraceSignal {
+    FunctionBlock*  func;
+    uint8_t         ioNum;
+};
+
+// Condition of the trigger signal starting a triggered capture. Values are compared as floats
+enum TRACE_TRIGGER
+{
+    TRACE_TRIGGER_NONE,         // Stream every sample
+    TRACE_TRIGGER_RISING,       // Value rises to or above threshold
+    TRACE_TRIGGER_FALLING,      // Value falls below threshold
+    TRACE_TRIGGER_CROSSING,     // Value rises or falls across threshold
+    TRACE_TRIGGER_TRUE          // Value is non-zero, e.g. a boolean output of a condition block
+};
+
+enum TRACE_STATE
+{
+    TRACE_STATE_STREAMING,      // Samples are streamed in chunks
+    TRACE_STATE_ARMED,          // Pre-trigger history is recorded until the trigger condition is met
+    TRACE_STATE_TRIGGERED,      // Post-trigger samples are recorded
+    TRACE_STATE_COMPLETE,       // Capture window is waiting for upload
+    TRACE_STATE_IDLE            // Single capture was uploaded
+};
+
+// Samples of selected signals captured at the end of every task cycle. The task worker writes
+// samples to a preallocated ring and the link reads them. Streamed samples captured while the
+// ring is full are dropped and counted. Triggered captures overwrite the oldest samples until
+// the post-trigger samples are recorded
+class TraceRecorder
+{
+    std::vector<TraceSignal>    signals;
+    // Samples of a timestamp followed by the signal values
+    std::vector<uint32_t>       ring;
+    uint32_t                    capacityMask;
+
+    // Free running sample counters. Head is written by the worker, tail by the link
+    std::atomic<uint32_t>       head {0};
+    std::atomic<uint32_t>       tail {0};
+
+    // Trigger configuration and state
+    TraceSignal     triggerSignal {};
+    TRACE_TRIGGER   triggerCondition = TRACE_TRIGGER_NONE;
+    float           threshold = 0;
+    float           previousValue = 0;
+    bool            hasPreviousValue = false;
+    uint32_t        armedSample = 0;
+    uint32_t        triggerSample = 0;
+    uint32_t        postTriggerLeft = 0;
+
+    float readTriggerValue();
+    bool triggerFired(float value);
+    void copySamples(uint32_t* dest, uint32_t first, uint32_t count);
+
+public:
+    // Samples per streamed chunk
+    const uint32_t chunkSamples;
+
+    std::atomic<uint32_t> droppedSamples {0};
+    std::atomic<TRACE_STATE> state {TRACE_STATE_STREAMING};
+
+    // Triggered capture window around the trigger sample, in cycles
+    uint32_t preTrigger = 0;
+    uint32_t postTrigger = 0;
+    // Arm again after a capture was uploaded
+    bool rearm = false;
+    uint32_t triggerCount = 0;
+
+    // Capture overhead in CPU cycles
+    uint32_t lastCaptureCycles = 0;
+    uint32_t maxCaptureCycles = 0;
+
+    // Capacity is rounded up to a power of two
+    TraceRecorder(const std::vector<TraceSignal>& signals, uint32_t capacity, uint32_t chunkSamples);
+
+    // Capture values of the signals. Worker side. Returns true when a chunk or a triggered capture was completed
+    bool capture(uint32_t timeStamp);
+
+    // Copy up to given number of oldest streamed samples and release them. Link side. Returns number of samples copied
+    uint32_t read(uint32_t* dest, uint32_t maxSamples);
+
+    // Arm a triggered capture of given window, or return to streaming with TRACE_TRIGGER_NONE.
+    // Capture must not be running. Returns false if the window does not fit the ring
+    bool setTrigger(TraceSignal signal, TRACE_TRIGGER condition, float threshold, uint32_t preTrigger, uint32_t postTrigger, bool rearm);
+
+    // Copy the completed capture window and arm again or go idle. Link side. Returns number of samples copied.
+    // Trigger index is set to the position of the trigger sample in the window
+    uint32_t readCapture(uint32_t* dest, uint32_t& triggerIndex);
+
+    inline uint32_t available() { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed); }
+    inline uint32_t capacity() { return capacityMask + 1; }
+    inline uint32_t signalCount() { return signals.size(); }
+    inline uint32_t sampleWords() { return 1 + signals.size(); }
+    inline uint32_t windowSamples() { return preTrigger + 1 + postTrigger; }
+
+    // Ring size in words for given sample capacity and signal count
+    static uint32_t ringWords(uint32_t capacity, uint32_t signalCount);
+};
@@ -17,21 +17,33 @@
 #include "CTRL/CyclicTask.h"
 #include "CTRL/FunctionLib.h"
 #include "CTRL/FunctionFactory.h"
+#include "CTRL/Benchmark.h"
+#include "CTRL/HAL.h"
 
 #define OLED_CLOCK  15
 #define OLED_DATA    4
 #define OLED_RESET  16
 
 #define CONTROLLER_PRIORITY 2
+#define CONTROLLER_WORKER_COUNT 2
 
-#define MIN_CONTROLLER_INTERVAL 1U
-#define MAX_CONTROLLER_INTERVAL 10U
+// Link requests are handled below controller priority, at most the time budget per interval
+#define LINK_PRIORITY           1
+#define LINK_TIME_BUDGET_US     2000U
+#define LINK_INTERVAL_US        5000U
+
+// Busy wait before each release for sub-millisecond precision. Zero blocks until the release
+#define CONTROLLER_SPIN_TIME_US 0U
 
 Controller* controller;
 Link* commLink;
 FunctionFactory* funcFactory;
 
-TaskHandle_t taskController = NULL;
+TaskHandle_t taskController[CONTROLLER_WORKER_COUNT] = {};
+TaskHandle_t taskLink = nullptr;
+
+// Worker 0 runs alone on the controller core. Worker 1 shares the network core with the link and the TCP stack
+const BaseType_t workerCores[CONTROLLER_WORKER_COUNT] = { CONTROLLER_RUNNING_CORE, CONFIG_ASYNC_TCP_RUNNING_CORE };
 
 void printFunctionBlockIOValues(FunctionBlock *func)
 {
@@ -140,6 +152,7 @@ void IRAM_ATTR onWSEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, A
         else
         {
             commLink->receiveData(data, len);
+            HAL::wake(HAL_WAKEUP_LINK);
         }
     }
 }
@@ -149,13 +162,19 @@ void IRAM_ATTR onWSEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, A
 //    CTRL32 setup
 // ***********************************************
 
-void IRAM_ATTR ControllerLoop(void *) {
+void IRAM_ATTR ControllerLoop(void* param) {
+    uint8_t worker = (uint32_t)param;
+    for (;;) {
+        Time nextUpdateTime = controller->tick(worker);
+        HAL::waitUntil(worker, nextUpdateTime, CONTROLLER_SPIN_TIME_US);
+    }
+}
+
+void LinkLoop(void* param) {
     for (;;) {
-        Time nextUpdateTime = controller->tick();
-        commLink->processData();
-        uint32_t remainingTimeToUpdate = nextUpdateTime - esp_timer_get_time();
-        uint32_t delayTime = min(max(remainingTimeToUpdate, MIN_CONTROLLER_INTERVAL), MAX_CONTROLLER_INTERVAL);
-        delay(delayTime);
+        bool pending = commLink->processData(LINK_TIME_BUDGET_US);
+        Time nextProcessTime = pending ? esp_timer_get_time() + LINK_INTERVAL_US : commLink->nextReportTime();
+        HAL::waitUntil(HAL_WAKEUP_LINK, nextProcessTime);
     }
 }
 
@@ -188,7 +207,7 @@ Circuit* createTestCircuit() {
 
 void ControllerSetup()
 {
-    controller = new Controller();
+    controller = new Controller(CONTROLLER_WORKER_COUNT);
     commLink = new Link(controller, &onWSSendData, &onWSSendText);
     funcFactory = new FunctionFactory();
 
@@ -201,13 +220,42 @@ void ControllerSetup()
 
     task1s->start();
 
-    Serial.println("Creating a FreeRTOS task");
-    xTaskCreatePinnedToCore(ControllerLoop, "CTRL32", 4*1024, NULL, CONTROLLER_PRIORITY, &taskController, CONTROLLER_RUNNING_CORE);
+    Serial.println("Creating FreeRTOS tasks");
+    for (uint32_t worker = 0; worker < CONTROLLER_WORKER_COUNT; worker++) {
+        xTaskCreatePinnedToCore(ControllerLoop, "CTRL32", 4*1024, (void*)worker, CONTROLLER_PRIORITY, &taskController[worker], workerCores[worker]);
+    }
+    xTaskCreatePinnedToCore(LinkLoop, "CTRL32 link", 4*1024, nullptr, LINK_PRIORITY, &taskLink, CONFIG_ASYNC_TCP_RUNNING_CORE);
 
     Serial.println("Controller tasks running");
 }
 
 
+// ***********************************************
+//    Benchmark
+// ***********************************************
+
+// Reduced benchmark run on target. Enabled by the benchmark build environment
+#define BENCHMARK_MAX_BLOCKS    1000
+#define BENCHMARK_MIN_TIME_MS   100
+
+void printBenchmarkText(const char* text)
+{
+    Serial.print(text);
+}
+
+void BenchmarkSetup()
+{
+    Controller* benchController = new Controller();
+    FunctionFactory* benchFactory = new FunctionFactory();
+    Benchmark benchmark(benchController, benchFactory);
+    benchmark.minTime_us = BENCHMARK_MIN_TIME_MS * 1000;
+    benchmark.run(BENCHMARK_MAX_BLOCKS);
+    benchmark.writeJSON(&printBenchmarkText);
+    delete benchFactory;
+    delete benchController;
+}
+
+
 // ***********************************************
 //    Setup
 // ***********************************************
@@ -263,6 +311,11 @@ void setup()
 
     webServer.begin();
 
+#ifdef CTRL_BENCHMARK
+    // Benchmark before controller workers start to have the CPU to itself
+    BenchmarkSetup();
+#endif
+
     ControllerSetup();
 }
 
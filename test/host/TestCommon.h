@@ -0,0 +1,36 @@
+#pragma once
+
+#include "Common.h"
+#include "FunctionBlock.h"
+#include <cstdio>
+
+// Minimal checks of the host tests. A test executable returns non-zero if any check failed
+
+static int testFailures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            testFailures++; \
+        } \
+    } while (0)
+
+// Compare output values bitwise. Reports the first differing function of a list
+static bool sameOutputs(const std::vector<FunctionBlock*>& expected, const std::vector<FunctionBlock*>& actual, const char* context, uint32_t cycle) {
+    for (size_t i = 0; i < expected.size() && i < actual.size(); i++) {
+        for (uint8_t o = 0; o < expected[i]->numOutputs; o++) {
+            if (expected[i]->outputs()[o].u == actual[i]->outputs()[o].u) continue;
+            fprintf(stderr, "%s: cycle %u function %zu %s output %u: expected 0x%08x, got 0x%08x\n", context, cycle, i,
+                expected[i]->name(), o, expected[i]->outputs()[o].u, actual[i]->outputs()[o].u);
+            testFailures++;
+            return false;
+        }
+    }
+    return expected.size() == actual.size();
+}
+
+static inline int testResult(const char* name) {
+    if (testFailures) fprintf(stderr, "%s: %d checks failed\n", name, testFailures);
+    else printf("%s: passed\n", name);
+    return testFailures ? 1 : 0;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Common.h"
+#include "FunctionBlock.h"
+#include "FunctionFactory.h"
+
+enum TEST_PROGRAM_KIND {
+    TEST_PROGRAM_MIXED,         // Math and logic functions. Logic functions read math outputs as booleans too
+    TEST_PROGRAM_LOGIC,         // Logic functions only, packable as a whole
+    TEST_PROGRAM_INSTANCEABLE   // Mixed program without continuously running functions, which can not be instanced
+};
+
+// Random program of math and logic functions reading earlier functions, so list order is a valid
+// execution order. Programs built with equal seeds are identical, one copy is run function by function
+// with FunctionBlock::update as the reference for the execution mode under test
+class TestProgram
+{
+    uint32_t seed;
+
+    uint32_t random() {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        return seed;
+    }
+
+public:
+    // Constant input changed between cycles
+    struct Stimulus {
+        FunctionBlock*  func;
+        uint8_t         input;
+        bool            isLogic;
+    };
+    std::vector<Stimulus> stimuli;
+
+    std::vector<FunctionBlock*> funcs;
+
+    // Functions are created in the shared pool unless a pool is given
+    TestProgram(FunctionFactory& factory, uint32_t blockCount, uint32_t seed, TEST_PROGRAM_KIND kind = TEST_PROGRAM_MIXED, BlockPool* pool = nullptr) :
+        seed (seed)
+    {
+        const bool logicOnly = (kind == TEST_PROGRAM_LOGIC);
+        // Edge functions are last in the list
+        const uint32_t logicFuncCount = (kind == TEST_PROGRAM_INSTANCEABLE) ? 6 : 8;
+        static const uint8_t mathFuncs[] = { MathLib::FUNC_ID_ADD, MathLib::FUNC_ID_SUB, MathLib::FUNC_ID_MUL,
+                                             MathLib::FUNC_ID_DIV, MathLib::FUNC_ID_ABS, MathLib::FUNC_ID_SIN };
+        static const uint8_t logicFuncs[] = { LogicLib::FUNC_ID_AND, LogicLib::FUNC_ID_OR, LogicLib::FUNC_ID_XOR, LogicLib::FUNC_ID_NOT,
+                                              LogicLib::FUNC_ID_RS, LogicLib::FUNC_ID_SR, LogicLib::FUNC_ID_RisingEdge, LogicLib::FUNC_ID_FallingEdge };
+        std::vector<FunctionBlock*> mathProducers;
+        std::vector<FunctionBlock*> logicProducers;
+        for (uint32_t i = 0; i < blockCount; i++) {
+            const bool isLogic = logicOnly || (random() & 1);
+            FunctionBlock* func = isLogic
+                ? factory.createFunction(LIB_ID_LOGIC, logicFuncs[random() % logicFuncCount], 2 + random() % 3, 0, pool)
+                : factory.createFunction(LIB_ID_MATH, mathFuncs[random() % sizeof(mathFuncs)], 2 + random() % 3, 0, pool);
+            for (uint8_t k = 0; k < func->numInputs; k++) {
+                std::vector<FunctionBlock*>& producers = (isLogic && (logicOnly || random() % 8)) ? logicProducers : mathProducers;
+                if (producers.size() && random() % 4) {
+                    func->connectInput(k, producers[random() % producers.size()], 0, isLogic && random() % 4 == 0);
+                } else {
+                    stimuli.push_back({ func, k, isLogic });
+                }
+            }
+            (isLogic ? logicProducers : mathProducers).push_back(func);
+            funcs.push_back(func);
+        }
+        applyStimuli(0);
+    }
+
+    // Stimuli hold their values for a few cycles so change-driven evaluation has quiet periods
+    IOValue stimulusValue(size_t index, uint32_t cycle) {
+        uint32_t hash = (cycle / 3 + index * 7919) * 2654435761u;
+        hash ^= hash >> 15;
+        IOValue value = {};
+        if (stimuli[index].isLogic) value.u = (hash >> 7) & 1;
+        else value.f = (float)((int32_t)(hash % 21) - 10) * 0.25f;
+        return value;
+    }
+
+    void applyStimuli(uint32_t cycle) {
+        for (size_t i = 0; i < stimuli.size(); i++) {
+            stimuli[i].func->setInput(stimuli[i].input, stimulusValue(i, cycle));
+        }
+    }
+
+    // Drop a function removed from the program
+    void forget(FunctionBlock* func) {
+        funcs.erase(std::remove(funcs.begin(), funcs.end(), func), funcs.end());
+        stimuli.erase(std::remove_if(stimuli.begin(), stimuli.end(), [func](const Stimulus& stimulus) { return stimulus.func == func; }), stimuli.end());
+    }
+
+    void runReference(uint32_t dt) {
+        for (FunctionBlock* func : funcs) func->update(dt);
+    }
+};
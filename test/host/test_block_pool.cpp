@@ -0,0 +1,111 @@
+#include "TestCommon.h"
+#include "TestProgram.h"
+#include "Circuit.h"
+#include "Controller.h"
+#include "CyclicTask.h"
+
+// Blocks and their IO storage come from slab pools. A circuit frees the slabs of its pool at once
+
+static void testCircuitPool(FunctionFactory& factory) {
+    const uint32_t slots = BlockPool::slotCount;
+
+    Circuit* circuit = new Circuit(0, 1);
+    TestProgram reference(factory, 500, 3);
+    TestProgram program(factory, 500, 3, TEST_PROGRAM_MIXED, &circuit->pool);
+    for (FunctionBlock* func : program.funcs) {
+        CHECK(&BlockPool::owner(func) == &circuit->pool);
+        CHECK(&BlockPool::owner(func->ioValues) == &circuit->pool);
+        circuit->addFunction(func);
+    }
+    for (uint32_t cycle = 0; cycle < 20; cycle++) {
+        reference.applyStimuli(cycle);
+        program.applyStimuli(cycle);
+        reference.runReference(10);
+        circuit->update(10);
+        if (!sameOutputs(reference.funcs, program.funcs, "circuit pool", cycle)) break;
+    }
+    for (FunctionBlock* func : reference.funcs) delete func;
+
+    // Blocks, IO storage and input bindings of the circuit pool
+    CHECK(BlockPool::slotCount > slots + 1000);
+    const uint32_t slabs = BlockPool::slabCount;
+    delete circuit;
+    CHECK(BlockPool::slotCount == slots);
+    CHECK(BlockPool::slabCount + 50 < slabs);
+}
+
+// Functions of a circuit pool packed to a task arena return their arena storage on delete
+static void testCircuitPoolInTask(FunctionFactory& factory) {
+    const uint32_t slots = BlockPool::slotCount;
+    Controller* controller = new Controller();
+    CyclicTask* task = new CyclicTask(controller, 10);
+    controller->tasks.push_back(task);
+
+    Circuit* circuit = new Circuit(0, 1);
+    TestProgram program(factory, 200, 5, TEST_PROGRAM_MIXED, &circuit->pool);
+    for (FunctionBlock* func : program.funcs) circuit->addFunction(func);
+    controller->addFunction(circuit, task);
+    controller->compileTasks();
+    task->update();
+    CHECK(program.funcs[0]->ioArena == &task->arena);
+
+    controller->removeFunction(circuit);
+    task->removeFunction(circuit);
+    controller->compileTasks();
+    delete circuit;
+    delete task;
+    delete controller;
+    CHECK(BlockPool::slotCount == slots);
+}
+
+// Released slots are reused before new slabs are created
+static void testSlotReuse(FunctionFactory& factory) {
+    std::vector<FunctionBlock*> funcs;
+    for (int i = 0; i < 100; i++) funcs.push_back(factory.createFunction(LIB_ID_LOGIC, LogicLib::FUNC_ID_AND, 2));
+    const uint32_t slabs = BlockPool::slabCount;
+    for (int i = 0; i < 100; i += 2) {
+        delete funcs[i];
+        funcs[i] = factory.createFunction(LIB_ID_LOGIC, LogicLib::FUNC_ID_AND, 2);
+    }
+    CHECK(BlockPool::slabCount == slabs);
+    for (FunctionBlock* func : funcs) delete func;
+}
+
+// Blocks whose IO storage, input bindings or monitoring buffer do not fit the pool fail to be created,
+// connected or monitored, and leave nothing allocated
+static void testExhaustedPool(FunctionFactory& factory) {
+    BlockPool pool;
+    pool.maxSlabs = 1;
+    const uint32_t slots = BlockPool::slotCount;
+    CHECK(factory.createFunction(LIB_ID_MATH, MathLib::FUNC_ID_ADD, 2, 0, &pool) == nullptr);
+    CHECK(BlockPool::slotCount == slots);
+
+    pool.maxSlabs = 2;
+    FunctionBlock* source = factory.createFunction(LIB_ID_MATH, MathLib::FUNC_ID_ADD, 2, 0, &pool);
+    FunctionBlock* func = factory.createFunction(LIB_ID_MATH, MathLib::FUNC_ID_ADD, 2, 0, &pool);
+    CHECK(source && func);
+    if (!source || !func) return;
+    func->setInput(0, 1.5f);
+    CHECK(!func->connectInput(0, source, 0));
+    CHECK(!(func->inputFlag(0) & IO_FLAG_REF));
+    CHECK(func->inputValue(0).f == 1.5f);
+    CHECK(func->numInputBindings == 0);
+    CHECK(!func->enableMonitoring());
+    CHECK(!(func->flags & FUNC_FLAG_MONITORING));
+
+    pool.maxSlabs = UINT32_MAX;
+    CHECK(func->connectInput(0, source, 0));
+    CHECK(func->numInputBindings == 1);
+    CHECK(func->enableMonitoring());
+    delete func;
+    delete source;
+}
+
+int main() {
+    FunctionFactory factory;
+    testCircuitPool(factory);
+    testCircuitPoolInTask(factory);
+    testSlotReuse(factory);
+    testExhaustedPool(factory);
+    return testResult("block_pool");
+}
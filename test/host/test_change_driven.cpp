@@ -0,0 +1,105 @@
+#include "TestCommon.h"
+#include "TestProgram.h"
+#include "Circuit.h"
+#include "Controller.h"
+#include "CyclicTask.h"
+#include "Link.h"
+#include "HAL.h"
+#include <unordered_set>
+
+// Change-driven plans give the same outputs as updating functions one by one and skip
+// functions whose inputs did not change. Constant inputs are written through the link,
+// which schedules the written functions without recompiling the plans
+
+#define TEST_CYCLES 60
+
+static void onSendData(const void* data, size_t len) {}
+static void onSendText(const char* text) {}
+
+// Write changed stimuli of the program like a client sets constant inputs
+static void writeStimuli(Link& link, TestProgram& program, uint32_t cycle) {
+    for (size_t i = 0; i < program.stimuli.size(); i++) {
+        const TestProgram::Stimulus& stimulus = program.stimuli[i];
+        const IOValue value = program.stimulusValue(i, cycle);
+        if (stimulus.func->inputs()[stimulus.input].u == value.u) continue;
+        struct {
+            MsgRequestHeader_t  header;
+            MsgMemWrite_t       params;
+            uint32_t            value;
+        } msg = {
+            .header = { .msgType = MSG_TYPE_SET_MEM_DATA, .msgID = 1, .pointer = HAL::toPtr32(&stimulus.func->inputs()[stimulus.input]) },
+            .params = { .ioRevision = IOArena::layoutRevision },
+            .value  = value.u
+        };
+        link.receiveData(&msg, sizeof(msg));
+        link.processData();
+    }
+}
+
+// Functions a quiet cycle runs: continuous functions and consumers of outputs changed on this cycle.
+// Programs read earlier functions only, so there is no feedback left over from the previous cycle
+static uint32_t expectedEvaluations(TestProgram& program, const std::vector<IOValue>& previousOutputs) {
+    std::unordered_set<const IOValue*> changed;
+    size_t index = 0;
+    for (FunctionBlock* func : program.funcs) {
+        for (uint8_t o = 0; o < func->numOutputs; o++, index++) {
+            if (func->outputs()[o].u != previousOutputs[index].u) changed.insert(&func->outputs()[o]);
+        }
+    }
+    uint32_t count = 0;
+    for (FunctionBlock* func : program.funcs) {
+        bool runs = func->flags & FUNC_FLAG_CONTINUOUS;
+        for (uint8_t i = 0; !runs && i < func->numInputs; i++) {
+            runs = (func->inputFlag(i) & IO_FLAG_REF) && changed.count(func->inputs()[i].ref);
+        }
+        count += runs;
+    }
+    return count;
+}
+
+static void testChangeDriven(FunctionFactory& factory, uint32_t blockCount, uint32_t seed) {
+    TestProgram reference(factory, blockCount, seed);
+    TestProgram program(factory, blockCount, seed);
+    Controller* controller = new Controller();
+    Link link(controller, &onSendData, &onSendText);
+    link.connected();
+    CyclicTask* task = new CyclicTask(controller, 10);
+    controller->tasks.push_back(task);
+    Circuit* circuit = new Circuit(0, 1);
+    for (FunctionBlock* func : program.funcs) circuit->addFunction(func);
+    controller->addFunction(circuit, task);
+    circuit->plan.setMode(EVAL_MODE_CHANGE_DRIVEN);
+
+    uint32_t compiledRevision = 0;
+    std::vector<IOValue> previousOutputs;
+    for (uint32_t cycle = 0; cycle < TEST_CYCLES; cycle++) {
+        reference.applyStimuli(cycle);
+        writeStimuli(link, program, cycle);
+        previousOutputs.clear();
+        for (FunctionBlock* func : program.funcs) previousOutputs.insert(previousOutputs.end(), func->outputs(), func->outputs() + func->numOutputs);
+
+        reference.runReference(10);
+        circuit->update(10);
+        if (!sameOutputs(reference.funcs, program.funcs, "change driven", cycle)) break;
+        // Plan is compiled once, input writes do not invalidate it
+        if (cycle == 0) compiledRevision = ExecutionPlan::revision;
+        CHECK(ExecutionPlan::revision == compiledRevision);
+        // Stimuli change every third cycle
+        if (cycle % 3) CHECK(circuit->plan.evaluatedCount == expectedEvaluations(program, previousOutputs));
+    }
+
+    controller->tasks.clear();
+    delete task;
+    delete circuit;
+    delete controller;
+    for (FunctionBlock* func : reference.funcs) delete func;
+}
+
+int main() {
+    FunctionFactory factory;
+    for (uint32_t seed = 1; seed <= 5; seed++) {
+        testChangeDriven(factory, 10, seed);
+        testChangeDriven(factory, 1000, seed);
+    }
+    return testResult("change_driven");
+}
@@ -0,0 +1,63 @@
+#include "TestCommon.h"
+#include "TestProgram.h"
+#include "Circuit.h"
+
+// Compiled circuit plans give the same outputs as updating functions one by one
+
+#define TEST_CYCLES 60
+
+static void testCircuitPlan(FunctionFactory& factory, uint32_t blockCount, uint32_t seed) {
+    TestProgram reference(factory, blockCount, seed);
+    TestProgram program(factory, blockCount, seed);
+    Circuit* circuit = new Circuit(0, 1);
+    for (FunctionBlock* func : program.funcs) circuit->addFunction(func);
+
+    for (uint32_t cycle = 0; cycle < TEST_CYCLES; cycle++) {
+        reference.applyStimuli(cycle);
+        program.applyStimuli(cycle);
+        reference.runReference(10);
+        circuit->update(10);
+        if (!sameOutputs(reference.funcs, program.funcs, "circuit plan", cycle)) break;
+    }
+    CHECK(circuit->plan.evaluatedCount == blockCount);
+
+    delete circuit;
+    for (FunctionBlock* func : reference.funcs) delete func;
+}
+
+// Plan is recompiled after the structure changes and keeps the function values
+static void testRecompile(FunctionFactory& factory) {
+    TestProgram reference(factory, 200, 7);
+    TestProgram program(factory, 200, 7);
+    Circuit* circuit = new Circuit(0, 1);
+    for (FunctionBlock* func : program.funcs) circuit->addFunction(func);
+
+    for (uint32_t cycle = 0; cycle < TEST_CYCLES; cycle++) {
+        reference.applyStimuli(cycle);
+        program.applyStimuli(cycle);
+        if (cycle == TEST_CYCLES / 2) {
+            // Reconnecting an input to its current source changes nothing but the revision
+            FunctionBlock* func = program.funcs.back();
+            CHECK(circuit->plan.isValid());
+            func->connectInput(0, program.funcs[0], 0);
+            reference.funcs.back()->connectInput(0, reference.funcs[0], 0);
+            CHECK(!circuit->plan.isValid());
+        }
+        reference.runReference(10);
+        circuit->update(10);
+        if (!sameOutputs(reference.funcs, program.funcs, "recompiled plan", cycle)) break;
+    }
+
+    delete circuit;
+    for (FunctionBlock* func : reference.funcs) delete func;
+}
+
+int main() {
+    FunctionFactory factory;
+    for (uint32_t seed = 1; seed <= 5; seed++) {
+        testCircuitPlan(factory, 10, seed);
+        testCircuitPlan(factory, 1000, seed);
+    }
+    testRecompile(factory);
+    return testResult("execution_plan");
+}
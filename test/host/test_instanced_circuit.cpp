@@ -0,0 +1,83 @@
+#include "TestCommon.h"
+#include "TestProgram.h"
+#include "Circuit.h"
+#include "InstancedCircuit.h"
+
+// Every instance of an instanced circuit gives the same outputs as a circuit of its own run with
+// Circuit::run. Instances get parameters of their own
+
+#define TEST_CYCLES 30
+
+// Instances see stimuli of different cycles
+static uint32_t instanceCycle(uint32_t instance, uint32_t cycle) { return cycle + instance * 1000; }
+
+static bool sameInstanceOutputs(InstancedCircuit& instanced, uint32_t instance, TestProgram& definition, TestProgram& expected, uint32_t cycle) {
+    for (size_t i = 0; i < expected.funcs.size(); i++) {
+        FunctionBlock* func = expected.funcs[i];
+        for (uint8_t o = 0; o < func->numOutputs; o++) {
+            IOValue actual = instanced.outputValue(instance, definition.funcs[i], o);
+            if (actual.u == func->outputs()[o].u) continue;
+            fprintf(stderr, "instanced: cycle %u instance %u function %zu %s output %u: expected 0x%08x, got 0x%08x\n",
+                cycle, instance, i, func->name(), o, func->outputs()[o].u, actual.u);
+            testFailures++;
+            return false;
+        }
+    }
+    return true;
+}
+
+static void testInstanced(FunctionFactory& factory, uint32_t blockCount, uint32_t seed, uint32_t instanceCount) {
+    TestProgram definitionProgram(factory, blockCount, seed, TEST_PROGRAM_INSTANCEABLE);
+    Circuit* definition = new Circuit(0, 1);
+    for (FunctionBlock* func : definitionProgram.funcs) definition->addFunction(func);
+    InstancedCircuit instanced(definition, instanceCount);
+
+    std::vector<TestProgram*> programs;
+    std::vector<Circuit*> circuits;
+    for (uint32_t n = 0; n < instanceCount; n++) {
+        TestProgram* program = new TestProgram(factory, blockCount, seed, TEST_PROGRAM_INSTANCEABLE);
+        Circuit* circuit = new Circuit(0, 1);
+        for (FunctionBlock* func : program->funcs) circuit->addFunction(func);
+        programs.push_back(program);
+        circuits.push_back(circuit);
+    }
+
+    bool same = true;
+    for (uint32_t cycle = 0; cycle < TEST_CYCLES && same; cycle++) {
+        for (uint32_t n = 0; n < instanceCount; n++) {
+            programs[n]->applyStimuli(instanceCycle(n, cycle));
+            circuits[n]->update(10);
+            for (size_t i = 0; i < definitionProgram.stimuli.size(); i++) {
+                const TestProgram::Stimulus& stimulus = definitionProgram.stimuli[i];
+                CHECK(instanced.setInput(n, stimulus.func, stimulus.input, definitionProgram.stimulusValue(i, instanceCycle(n, cycle))));
+            }
+        }
+        CHECK(instanced.run(10));
+
+        for (uint32_t n = 0; n < instanceCount && same; n++) same = sameInstanceOutputs(instanced, n, definitionProgram, *programs[n], cycle);
+    }
+
+    for (Circuit* circuit : circuits) delete circuit;
+    for (TestProgram* program : programs) delete program;
+    delete definition;
+}
+
+// Definitions with continuously running functions can not be instanced
+static void testContinuousRejected(FunctionFactory& factory) {
+    Circuit* definition = new Circuit(0, 1);
+    definition->addFunction(factory.createFunction(LIB_ID_LOGIC, LogicLib::FUNC_ID_RisingEdge));
+    InstancedCircuit instanced(definition, 4);
+    CHECK(!instanced.compile());
+    CHECK(!instanced.run(10));
+    delete definition;
+}
+
+int main() {
+    FunctionFactory factory;
+    for (uint32_t seed = 1; seed <= 5; seed++) {
+        testInstanced(factory, 10, seed, 3);
+        testInstanced(factory, 300, seed, 19);
+    }
+    testContinuousRejected(factory);
+    return testResult("instanced_circuit");
+}
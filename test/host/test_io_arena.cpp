@@ -0,0 +1,186 @@
+#include "TestCommon.h"
+#include "TestProgram.h"
+#include "Controller.h"
+#include "CyclicTask.h"
+#include "Link.h"
+#include "HAL.h"
+
+// Tasks running from packed IO arenas give the same outputs as updating functions one by one,
+// also after functions are added and removed and storage is relocated. Link memory requests
+// with pointers from before a relocation are rejected
+
+#define TEST_CYCLES 90
+
+static void runCycle(Controller* controller) {
+    if (!controller->tasksValid()) {
+        // One compile pass covers the arena moves
+        controller->compileTasks();
+        CHECK(controller->tasksValid());
+    }
+    for (CyclicTask* task : controller->tasks) task->update();
+}
+
+static bool inArena(CyclicTask* task, FunctionBlock* func) {
+    return func->ioArena == &task->arena;
+}
+
+// Remove a function and disconnect its consumers, the way the controller does
+static void removeReference(TestProgram& reference, size_t index) {
+    FunctionBlock* parting = reference.funcs[index];
+    reference.forget(parting);
+    for (FunctionBlock* func : reference.funcs) {
+        for (uint8_t i = 0; i < func->numInputs; i++) {
+            if ((func->inputFlags()[i] & IO_FLAG_REF) && func->inputs()[i].ref == parting->outputs()) func->disconnectInput(i);
+        }
+    }
+    delete parting;
+}
+
+static void testRelocation(FunctionFactory& factory, uint32_t blockCount, uint32_t seed) {
+    Controller* controller = new Controller();
+    // Second task reads outputs of the first
+    CyclicTask* first = new CyclicTask(controller, 10);
+    CyclicTask* second = new CyclicTask(controller, 10);
+    controller->tasks.push_back(first);
+    controller->tasks.push_back(second);
+
+    TestProgram reference(factory, blockCount, seed);
+    TestProgram program(factory, blockCount, seed);
+    std::vector<FunctionBlock*>& funcs = program.funcs;
+    for (size_t i = 0; i < funcs.size(); i++) {
+        controller->addFunction(funcs[i], (i < funcs.size() / 2) ? first : second);
+    }
+
+    for (uint32_t cycle = 0; cycle < TEST_CYCLES; cycle++) {
+        reference.applyStimuli(cycle);
+        program.applyStimuli(cycle);
+
+        FunctionBlock* parting = nullptr;
+        if (cycle == TEST_CYCLES / 3) {
+            // Removed function leaves the arena with its own storage and its consumers keep the last value
+            const size_t index = funcs.size() / 4;
+            parting = funcs[index];
+            controller->removeFunction(parting);
+            program.forget(parting);
+            removeReference(reference, index);
+        }
+        if (cycle == 2 * TEST_CYCLES / 3) {
+            // Added function moves the second arena and the references into it
+            FunctionBlock* added = factory.createFunction(LIB_ID_MATH, MathLib::FUNC_ID_ADD, 2);
+            FunctionBlock* addedReference = factory.createFunction(LIB_ID_MATH, MathLib::FUNC_ID_ADD, 2);
+            const size_t source = funcs.size() - 1;
+            added->connectInput(0, funcs[source], 0);
+            addedReference->connectInput(0, reference.funcs[source], 0);
+            added->setInput(1, 1.5f);
+            addedReference->setInput(1, 1.5f);
+            controller->addFunction(added, second);
+            funcs.push_back(added);
+            reference.funcs.push_back(addedReference);
+        }
+
+        runCycle(controller);
+        reference.runReference(10);
+        if (parting) {
+            CHECK(parting->ioArena == nullptr);
+            delete parting;
+        }
+        if (!sameOutputs(reference.funcs, funcs, "io arena", cycle)) break;
+    }
+
+    for (FunctionBlock* func : funcs) CHECK(inArena(first, func) || inArena(second, func));
+    CHECK(first->arena.size() > 0);
+    CHECK(second->arena.size() > 0);
+
+    // Deleting the tasks moves the functions back to their own storage
+    controller->tasks.clear();
+    delete first;
+    delete second;
+    for (FunctionBlock* func : funcs) {
+        CHECK(func->ioArena == nullptr);
+        delete func;
+    }
+    for (FunctionBlock* func : reference.funcs) delete func;
+    delete controller;
+}
+
+static std::vector<uint8_t> response;
+
+static void onSendData(const void* data, size_t len) { response.assign((const uint8_t*)data, (const uint8_t*)data + len); }
+static void onSendText(const char* text) {}
+
+// Send a request with given parameters and data. Returns the response payload, null if the request failed
+template<typename Params>
+static const uint8_t* request(Link& link, MESSAGE_TYPE msgType, ptr32_t pointer, const Params& params, const void* data = nullptr, size_t dataSize = 0) {
+    uint8_t msg[sizeof(MsgRequestHeader_t) + sizeof(Params) + 64];
+    MsgRequestHeader_t header = { .msgType = msgType, .msgID = 1, .pointer = pointer };
+    memcpy(msg, &header, sizeof(header));
+    memcpy(msg + sizeof(header), &params, sizeof(params));
+    if (dataSize) memcpy(msg + sizeof(header) + sizeof(params), data, dataSize);
+    response.clear();
+    link.receiveData(msg, sizeof(header) + sizeof(params) + dataSize);
+    link.processData();
+    if (response.size() < sizeof(MsgResponseHeader_t)) return nullptr;
+    if (((const MsgResponseHeader_t*)response.data())->result != REQUEST_SUCCESSFUL) return nullptr;
+    return response.data() + sizeof(MsgResponseHeader_t);
+}
+
+static MsgFunctionInfo_t functionInfo(Link& link, FunctionBlock* func) {
+    MsgFunctionInfo_t info = {};
+    const uint8_t* payload = request(link, MSG_TYPE_FUNCTION_INFO, HAL::toPtr32(func), (uint32_t)0);
+    CHECK(payload);
+    if (payload) memcpy(&info, payload, sizeof(info));
+    return info;
+}
+
+static void testStalePointers(FunctionFactory& factory) {
+    Controller* controller = new Controller();
+    Link link(controller, &onSendData, &onSendText);
+    link.connected();
+    CyclicTask* task = new CyclicTask(controller, 10);
+    controller->tasks.push_back(task);
+    FunctionBlock* func = factory.createFunction(LIB_ID_MATH, MathLib::FUNC_ID_ADD, 2);
+    controller->addFunction(func, task);
+
+    // Pointers of the current revision are read and written
+    const MsgFunctionInfo_t before = functionInfo(link, func);
+    const float value = 2.5f;
+    CHECK(request(link, MSG_TYPE_SET_MEM_DATA, before.ioValuesPtr, MsgMemWrite_t { before.ioRevision }, &value, sizeof(value)));
+    CHECK(func->inputs()[0].f == value);
+    CHECK(request(link, MSG_TYPE_GET_MEM_DATA, before.ioValuesPtr, MsgMemRead_t { before.ioRevision, sizeof(IOValue) }));
+    // Revision is required
+    CHECK(!request(link, MSG_TYPE_GET_MEM_DATA, before.ioValuesPtr, (uint32_t)sizeof(IOValue)));
+
+    // Packing moves IO storage to the arena. Requests of the old revision fail, also with a pointer
+    // that happens to be valid again, as on targets where pointers are plain addresses
+    runCycle(controller);
+    CHECK(inArena(task, func));
+    CHECK(!request(link, MSG_TYPE_SET_MEM_DATA, before.ioValuesPtr, MsgMemWrite_t { before.ioRevision }, &value, sizeof(value)));
+    CHECK(!request(link, MSG_TYPE_GET_MEM_DATA, before.ioValuesPtr, MsgMemRead_t { before.ioRevision, sizeof(IOValue) }));
+    const MsgFunctionInfo_t after = functionInfo(link, func);
+    CHECK(after.ioRevision != before.ioRevision);
+    const float newValue = -1.f;
+    CHECK(!request(link, MSG_TYPE_SET_MEM_DATA, after.ioValuesPtr, MsgMemWrite_t { before.ioRevision }, &newValue, sizeof(newValue)));
+    CHECK(!request(link, MSG_TYPE_GET_MEM_DATA, after.ioValuesPtr, MsgMemRead_t { before.ioRevision, sizeof(IOValue) }));
+    CHECK(func->inputs()[0].f == value);
+
+    // Pointers of the new revision reach the moved storage
+    CHECK(request(link, MSG_TYPE_SET_MEM_DATA, after.ioValuesPtr, MsgMemWrite_t { after.ioRevision }, &newValue, sizeof(newValue)));
+    CHECK(func->inputs()[0].f == newValue);
+    const IOValue* values = (const IOValue*)request(link, MSG_TYPE_GET_MEM_DATA, after.ioValuesPtr, MsgMemRead_t { after.ioRevision, sizeof(IOValue) });
+    CHECK(values && values[0].f == newValue);
+
+    controller->tasks.clear();
+    delete task;
+    delete func;
+    delete controller;
+}
+
+int main() {
+    FunctionFactory factory;
+    testStalePointers(factory);
+    for (uint32_t seed = 1; seed <= 4; seed++) {
+        testRelocation(factory, 40, seed);
+        testRelocation(factory, 800, seed);
+    }
+    return testResult("io_arena");
+}
@@ -0,0 +1,59 @@
+#include "TestCommon.h"
+#include "FunctionFactory.h"
+#include "Controller.h"
+#include "Link.h"
+#include "HAL.h"
+
+// Requests with parameters fail if the payload is shorter than the parameters, instead of reading
+// past the received request
+
+static std::vector<uint8_t> response;
+
+// Keep the confirmation, later sends are monitoring reports
+static void onSendData(const void* data, size_t len) {
+    if (response.empty()) response.assign((const uint8_t*)data, (const uint8_t*)data + len);
+}
+static void onSendText(const char* text) {}
+
+// Send header and payload bytes of a request. Returns the request result
+static uint32_t request(Link& link, MESSAGE_TYPE msgType, const void* pointer, const void* params, size_t paramsSize) {
+    uint8_t data[sizeof(MsgRequestHeader_t) + 64];
+    MsgRequestHeader_t header = { .msgType = msgType, .msgID = 1, .pointer = HAL::toPtr32(pointer) };
+    memcpy(data, &header, sizeof(header));
+    memcpy(data + sizeof(header), params, paramsSize);
+    response.clear();
+    link.receiveData(data, sizeof(header) + paramsSize);
+    link.processData();
+    if (response.size() < sizeof(MsgResponseHeader_t)) return REQUEST_FAILED;
+    return ((const MsgResponseHeader_t*)response.data())->result;
+}
+
+// Mode is link state, the header pointer only has to be valid
+static void testMonitoringMode(Link& link, Controller* controller) {
+    MsgMonitoringMode_t params = { .mode = MONITORING_MODE_DELTA, .keyframeInterval = 10 };
+    CHECK(request(link, MSG_TYPE_MONITORING_SET_MODE, controller, &params, 0) == REQUEST_FAILED);
+    CHECK(request(link, MSG_TYPE_MONITORING_SET_MODE, controller, &params, sizeof(params.mode)) == REQUEST_FAILED);
+    CHECK(request(link, MSG_TYPE_MONITORING_SET_MODE, controller, &params, sizeof(params)) == REQUEST_SUCCESSFUL);
+}
+
+static void testMonitoringDeadband(Link& link, FunctionBlock* func) {
+    MsgMonitoringDeadband_t params = { .ioNum = 0, .absolute = 0.5f, .percent = 1.f };
+    CHECK(request(link, MSG_TYPE_MONITORING_SET_DEADBAND, func, &params, 0) == REQUEST_FAILED);
+    CHECK(request(link, MSG_TYPE_MONITORING_SET_DEADBAND, func, &params, sizeof(params.ioNum)) == REQUEST_FAILED);
+    CHECK(request(link, MSG_TYPE_MONITORING_SET_DEADBAND, func, &params, sizeof(params)) == REQUEST_SUCCESSFUL);
+}
+
+int main() {
+    FunctionFactory factory;
+    Controller* controller = new Controller();
+    Link link(controller, &onSendData, &onSendText);
+    link.connected();
+    FunctionBlock* func = factory.createFunction(LIB_ID_MATH, MathLib::FUNC_ID_ADD, 2);
+
+    testMonitoringMode(link, controller);
+    testMonitoringDeadband(link, func);
+
+    delete func;
+    delete controller;
+    return testResult("link_payload");
+}
@@ -0,0 +1,150 @@
+#include "TestCommon.h"
+#include "FunctionFactory.h"
+#include "Controller.h"
+#include "CyclicTask.h"
+#include "Link.h"
+#include "HAL.h"
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+// Task info, timing statistics, function profile and memory reads of a running task are served from
+// copies taken at the end of a task cycle, so they are answered while the worker keeps running
+
+#define TEST_READS 50
+
+static std::vector<uint8_t> response;
+
+static void onSendData(const void* data, size_t len) { response.assign((const uint8_t*)data, (const uint8_t*)data + len); }
+static void onSendText(const char* text) {}
+
+static std::atomic<bool> running { true };
+
+static void workerLoop(Controller* controller) {
+    while (running) {
+        Time nextUpdateTime = controller->tick(0);
+        HAL::waitUntil(0, nextUpdateTime);
+    }
+}
+
+// Send a request and handle it. Returns the response payload, empty if the request failed
+static const uint8_t* request(Link& link, MESSAGE_TYPE msgType, const void* pointer, uint32_t payload) {
+    MsgRequest_t msg = {
+        .header  = { .msgType = msgType, .msgID = 1, .pointer = HAL::toPtr32(pointer) },
+        .payload = payload
+    };
+    response.clear();
+    link.receiveData(&msg, sizeof(msg));
+    link.processData();
+    if (response.size() < sizeof(MsgResponseHeader_t)) return nullptr;
+    const MsgResponseHeader_t* header = (const MsgResponseHeader_t*)response.data();
+    if (header->result != REQUEST_SUCCESSFUL) return nullptr;
+    return response.data() + sizeof(MsgResponseHeader_t);
+}
+
+static const uint8_t* readMemory(Link& link, const void* pointer, uint32_t size) {
+    struct {
+        MsgRequestHeader_t  header;
+        MsgMemRead_t        params;
+    } msg = {
+        .header = { .msgType = MSG_TYPE_GET_MEM_DATA, .msgID = 1, .pointer = HAL::toPtr32(pointer) },
+        .params = { .ioRevision = IOArena::layoutRevision, .size = size }
+    };
+    response.clear();
+    link.receiveData(&msg, sizeof(msg));
+    link.processData();
+    if (response.size() < sizeof(MsgResponseHeader_t)) return nullptr;
+    if (((const MsgResponseHeader_t*)response.data())->result != REQUEST_SUCCESSFUL) return nullptr;
+    return response.data() + sizeof(MsgResponseHeader_t);
+}
+
+static void testRunningTask(FunctionFactory& factory) {
+    Controller* controller = new Controller();
+    Link link(controller, &onSendData, &onSendText);
+    link.connected();
+
+    // Counter incremented every cycle
+    CyclicTask* task = new CyclicTask(controller, 1);
+    controller->tasks.push_back(task);
+    FunctionBlock* counter = factory.createFunction(LIB_ID_MATH_UINT, MathUintLib::FUNC_ID_ADD, 2);
+    counter->setInput(0, 1);
+    counter->connectInput(1, counter, 0);
+    controller->addFunction(counter, task);
+    task->setProfiling(true);
+    task->start();
+    std::thread worker(workerLoop, controller);
+    // Plans are compiled on the first tick, reads before are copied right away
+    const MsgTaskInfo_t* started;
+    while (!(started = (const MsgTaskInfo_t*)request(link, MSG_TYPE_TASK_INFO, task, 0)) || started->runCount < 2) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    uint32_t prevRunCount = 0;
+    uint32_t prevCount = 0;
+    for (int i = 0; i < TEST_READS; i++) {
+        const MsgTaskInfo_t* info = (const MsgTaskInfo_t*)request(link, MSG_TYPE_TASK_INFO, task, 0);
+        CHECK(info);
+        if (info) {
+            CHECK(info->runCount >= prevRunCount);
+            prevRunCount = info->runCount;
+        }
+
+        const IOValue* values = (const IOValue*)readMemory(link, counter->ioValues, counter->ioCount() * sizeof(IOValue));
+        CHECK(values);
+        if (values) {
+            CHECK(values[2].u >= prevCount);
+            prevCount = values[2].u;
+        }
+
+        // Interval samples of a consistent copy match the run count
+        const MsgTaskTimingStats_t* stats = (const MsgTaskTimingStats_t*)request(link, MSG_TYPE_TASK_TIMING_STATS, task, 0);
+        CHECK(stats);
+        if (stats) {
+            const uint32_t* jitterCounts = (const uint32_t*)(stats + 1);
+            uint32_t samples = 0;
+            for (uint32_t b = 0; b < stats->bucketCount; b++) samples += jitterCounts[b];
+            CHECK(samples == stats->runCount);
+        }
+
+#ifdef CTRL_PROFILING
+        const MsgFunctionProfile_t* profile = (const MsgFunctionProfile_t*)request(link, MSG_TYPE_FUNCTION_PROFILE, counter, 0);
+        CHECK(profile);
+        if (profile) CHECK(profile->calls > 0);
+#endif
+    }
+    CHECK(prevRunCount > 0);
+    CHECK(prevCount > 0);
+
+    running = false;
+    HAL::wake(0);
+    worker.join();
+    controller->tasks.clear();
+    delete task;
+    delete counter;
+    delete controller;
+}
+
+// Stopped tasks are read right away
+static void testStoppedTask() {
+    Controller* controller = new Controller();
+    Link link(controller, &onSendData, &onSendText);
+    link.connected();
+    CyclicTask* task = new CyclicTask(controller, 1000);
+    controller->tasks.push_back(task);
+
+    const Time start = HAL::time();
+    const MsgTaskInfo_t* info = (const MsgTaskInfo_t*)request(link, MSG_TYPE_TASK_INFO, task, 0);
+    CHECK(info);
+    if (info) CHECK(info->runCount == 0);
+    CHECK(HAL::time() - start < 100000);
+    controller->tasks.clear();
+    delete task;
+    delete controller;
+}
+
+int main() {
+    FunctionFactory factory;
+    testRunningTask(factory);
+    testStoppedTask();
+    return testResult("link_reads");
+}
@@ -0,0 +1,68 @@
+#include "TestCommon.h"
+#include "Controller.h"
+#include "CyclicTask.h"
+
+// Overrun accounting of task ticks driven with given times. Catch-up runs release missed periods
+// back to back and are not counted as drift or misses
+
+#define INTERVAL_MS 10
+#define INTERVAL_US (INTERVAL_MS * 1000)
+
+static void testCatchUp() {
+    Controller* controller = new Controller();
+    CyclicTask* task = new CyclicTask(controller, INTERVAL_MS);
+    task->setOverrunPolicy(OVERRUN_POLICY_CATCH_UP, 2);
+    task->start();
+
+    // Released three and a half periods late: one late run, two catch-up runs and one skipped period
+    Time release = task->nextUpdateTime();
+    Time now = release + 3 * INTERVAL_US + INTERVAL_US / 2;
+    task->tick(now);
+    CHECK(task->deadlineMisses == 1);
+    CHECK(task->consecutiveOverruns == 1);
+    CHECK(task->skippedCycles == 1);
+    CHECK(task->startDrift.count == 1);
+
+    for (int i = 0; i < 2; i++) {
+        CHECK(task->nextUpdateTime() <= now);
+        task->tick(now);
+    }
+    CHECK(task->deadlineMisses == 1);
+    CHECK(task->startDrift.count == 1);
+    // Neither the first run nor catch-up runs take interval samples
+    CHECK(task->runCount == 0);
+
+    // Back on schedule
+    CHECK(task->nextUpdateTime() > now);
+    task->tick(task->nextUpdateTime());
+    CHECK(task->deadlineMisses == 1);
+    CHECK(task->consecutiveOverruns == 0);
+    CHECK(task->startDrift.count == 2);
+    CHECK(task->runCount == 1);
+
+    delete task;
+    delete controller;
+}
+
+static void testResetTimingStats() {
+    Controller* controller = new Controller();
+    CyclicTask* task = new CyclicTask(controller, INTERVAL_MS);
+    task->start();
+
+    Time release = task->nextUpdateTime();
+    task->tick(release + 2 * INTERVAL_US);
+    CHECK(task->consecutiveOverruns == 1);
+    task->resetTimingStats();
+    CHECK(task->consecutiveOverruns == 0);
+    CHECK(task->maxConsecutiveOverruns == 0);
+    CHECK(task->deadlineMisses == 0);
+
+    delete task;
+    delete controller;
+}
+
+int main() {
+    testCatchUp();
+    testResetTimingStats();
+    return testResult("overrun_policy");
+}
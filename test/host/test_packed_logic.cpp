@@ -0,0 +1,52 @@
+#include "TestCommon.h"
+#include "TestProgram.h"
+#include "Circuit.h"
+
+// Plans running logic functions on packed bits give the same outputs as updating functions one by one,
+// also when degraded runs execute the packed functions unpacked in between
+
+#define TEST_CYCLES 60
+
+// Degraded for a few cycles at a time
+static bool degradedCycle(uint32_t cycle) { return cycle % 10 >= 6; }
+
+static void testPacked(FunctionFactory& factory, uint32_t blockCount, uint32_t seed, TEST_PROGRAM_KIND kind, bool switchDegraded) {
+    TestProgram reference(factory, blockCount, seed, kind);
+    TestProgram program(factory, blockCount, seed, kind);
+    Circuit* circuit = new Circuit(0, 1);
+    // Feedback from the last function to the first one with a connected input, read from the packed bits
+    for (size_t i = 0; i < program.funcs.size() - 1; i++) {
+        if (!(program.funcs[i]->inputFlag(0) & IO_FLAG_REF)) continue;
+        program.funcs[i]->connectInput(0, program.funcs.back(), 0);
+        reference.funcs[i]->connectInput(0, reference.funcs.back(), 0);
+        break;
+    }
+    for (FunctionBlock* func : program.funcs) circuit->addFunction(func);
+    // Reference runs in list order, so the circuit keeps it
+    circuit->autoOrder = false;
+    circuit->plan.setMode(EVAL_MODE_PACKED_LOGIC);
+
+    for (uint32_t cycle = 0; cycle < TEST_CYCLES; cycle++) {
+        reference.applyStimuli(cycle);
+        program.applyStimuli(cycle);
+        circuit->plan.degraded = switchDegraded && degradedCycle(cycle);
+        reference.runReference(10);
+        circuit->update(10);
+        if (!sameOutputs(reference.funcs, program.funcs, switchDegraded ? "packed logic degraded" : "packed logic", cycle)) break;
+    }
+
+    delete circuit;
+    for (FunctionBlock* func : reference.funcs) delete func;
+}
+
+int main() {
+    FunctionFactory factory;
+    for (uint32_t seed = 1; seed <= 5; seed++) {
+        for (bool switchDegraded : { false, true }) {
+            testPacked(factory, 10, seed, TEST_PROGRAM_LOGIC, switchDegraded);
+            testPacked(factory, 1000, seed, TEST_PROGRAM_LOGIC, switchDegraded);
+            testPacked(factory, 1000, seed, TEST_PROGRAM_MIXED, switchDegraded);
+        }
+    }
+    return testResult("packed_logic");
+}
@@ -0,0 +1,55 @@
+#include "TestCommon.h"
+#include "TestProgram.h"
+#include "Circuit.h"
+#include "ParallelExecutor.h"
+
+// Circuits run on a thread pool give the same outputs as sequential Circuit::run
+
+#define TEST_CYCLES 60
+
+static Circuit* buildCircuit(TestProgram& program) {
+    Circuit* circuit = new Circuit(0, 1);
+    // Feedback from the last function to the first one with a connected input. Stimulus inputs are left as they are
+    for (FunctionBlock* func : program.funcs) {
+        if (func != program.funcs.back() && (func->inputFlag(0) & IO_FLAG_REF)) {
+            func->connectInput(0, program.funcs.back(), 0);
+            break;
+        }
+    }
+    for (FunctionBlock* func : program.funcs) circuit->addFunction(func);
+    return circuit;
+}
+
+static void testParallel(FunctionFactory& factory, uint32_t blockCount, uint32_t seed, uint32_t threadCount) {
+    TestProgram sequential(factory, blockCount, seed);
+    TestProgram parallel(factory, blockCount, seed);
+    Circuit* sequentialCircuit = buildCircuit(sequential);
+    Circuit* parallelCircuit = buildCircuit(parallel);
+
+    // Small grains and levels so that every level is shared and stolen between threads
+    ParallelExecutor executor(threadCount);
+    executor.grainSize = 4;
+    executor.parallelThreshold = 8;
+
+    for (uint32_t cycle = 0; cycle < TEST_CYCLES; cycle++) {
+        sequential.applyStimuli(cycle);
+        parallel.applyStimuli(cycle);
+        sequentialCircuit->update(10);
+        executor.run(parallelCircuit, 10);
+        if (!sameOutputs(sequential.funcs, parallel.funcs, "parallel executor", cycle)) break;
+    }
+    CHECK(executor.levelCount() > 1);
+
+    delete sequentialCircuit;
+    delete parallelCircuit;
+}
+
+int main() {
+    FunctionFactory factory;
+    for (uint32_t seed = 1; seed <= 5; seed++) {
+        testParallel(factory, 10, seed, 2);
+        testParallel(factory, 2000, seed, 4);
+    }
+    testParallel(factory, 500, 9, 1);
+    return testResult("parallel_executor");
+}
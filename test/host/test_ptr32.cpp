@@ -0,0 +1,41 @@
+#include "TestCommon.h"
+#include "FunctionFactory.h"
+#include "HAL.h"
+
+// Link handles of deleted functions are recycled, so programs larger than the handle table
+// can be built and rebuilt. Rounds together use more handles than the table holds
+
+#define TEST_FUNCTIONS  100000
+#define TEST_ROUNDS     6
+
+static void testRecycling(FunctionFactory& factory) {
+    for (int round = 0; round < TEST_ROUNDS; round++) {
+        std::vector<FunctionBlock*> funcs;
+        std::vector<ptr32_t> handles;
+        for (uint32_t i = 0; i < TEST_FUNCTIONS; i++) {
+            FunctionBlock* func = factory.createFunction(LIB_ID_MATH, MathLib::FUNC_ID_ADD, 2);
+            funcs.push_back(func);
+            handles.push_back(HAL::toPtr32(func));
+            handles.push_back(HAL::toPtr32(func->ioValues));
+        }
+        bool valid = true;
+        for (uint32_t i = 0; i < TEST_FUNCTIONS && valid; i++) {
+            valid = HAL::isValidPtr32(handles[2 * i]) && HAL::fromPtr32(handles[2 * i]) == funcs[i]
+                && HAL::fromPtr32(handles[2 * i + 1]) == funcs[i]->ioValues;
+            // Offsets address IO values inside the storage
+            valid = valid && HAL::fromPtr32(handles[2 * i + 1] + sizeof(IOValue)) == &funcs[i]->ioValues[1];
+        }
+        CHECK(valid);
+        for (FunctionBlock* func : funcs) delete func;
+
+        // Handles of deleted functions are invalid until reused
+        CHECK(!HAL::isValidPtr32(handles[0]));
+        CHECK(HAL::fromPtr32(handles[1]) == nullptr);
+    }
+}
+
+int main() {
+    FunctionFactory factory;
+    testRecycling(factory);
+    return testResult("ptr32");
+}
@@ -0,0 +1,218 @@
+#include "TestCommon.h"
+#include "FunctionFactory.h"
+#include "SimdReduce.h"
+#include <cmath>
+#include <random>
+
+// Variadic math and logic blocks of every size give the results of a scalar loop over their decoded
+// inputs, on the gathered and the fused path. Vector loops start at SIMD_MIN_COUNT inputs, so sizes
+// up to the largest block cover them with and without remainders. Every third input is connected,
+// with type conversions on math blocks and inverted bindings on logic blocks
+
+#define MAX_INPUTS  255
+
+enum REDUCTION { REDUCE_SUM, REDUCE_PRODUCT, REDUCE_ALL, REDUCE_ANY, REDUCE_ONE };
+
+struct Reduction {
+    uint8_t     lib;
+    uint8_t     func;
+    IO_TYPE     type;
+    REDUCTION   reduction;
+    const char* name;
+};
+
+static const Reduction reductions[] = {
+    { LIB_ID_MATH,      MathLib::FUNC_ID_ADD,       IO_TYPE_FLOAT,  REDUCE_SUM,     "float ADD" },
+    { LIB_ID_MATH,      MathLib::FUNC_ID_MUL,       IO_TYPE_FLOAT,  REDUCE_PRODUCT, "float MUL" },
+    { LIB_ID_MATH_INT,  MathIntLib::FUNC_ID_ADD,    IO_TYPE_INT,    REDUCE_SUM,     "int ADD" },
+    { LIB_ID_MATH_INT,  MathIntLib::FUNC_ID_MUL,    IO_TYPE_INT,    REDUCE_PRODUCT, "int MUL" },
+    { LIB_ID_MATH_UINT, MathUintLib::FUNC_ID_ADD,   IO_TYPE_UINT,   REDUCE_SUM,     "uint ADD" },
+    { LIB_ID_MATH_UINT, MathUintLib::FUNC_ID_MUL,   IO_TYPE_UINT,   REDUCE_PRODUCT, "uint MUL" },
+    { LIB_ID_LOGIC,     LogicLib::FUNC_ID_AND,      IO_TYPE_BOOL,   REDUCE_ALL,     "AND" },
+    { LIB_ID_LOGIC,     LogicLib::FUNC_ID_OR,       IO_TYPE_BOOL,   REDUCE_ANY,     "OR" },
+    { LIB_ID_LOGIC,     LogicLib::FUNC_ID_XOR,      IO_TYPE_BOOL,   REDUCE_ONE,     "XOR" },
+};
+
+// Sources of connected inputs, one per output type
+struct Sources {
+    FunctionBlock* floatSource;
+    FunctionBlock* intSource;
+    FunctionBlock* uintSource;
+    FunctionBlock* boolSource;
+};
+
+static std::mt19937 rng(7);
+
+static float uniform(float low, float high) { return std::uniform_real_distribution<float>(low, high)(rng); }
+
+// Products of many inputs stay in range if the inputs are close to one
+static IOValue randomValue(IO_TYPE type, REDUCTION reduction) {
+    IOValue value = {};
+    switch (type) {
+        case IO_TYPE_FLOAT: value.f = (reduction == REDUCE_PRODUCT) ? uniform(0.95f, 1.05f) : uniform(-1.f, 1.f); break;
+        case IO_TYPE_INT:   value.i = (int32_t)rng(); break;
+        default:            value.u = rng(); break;
+    }
+    return value;
+}
+
+// Sources of product inputs stay at magnitude one
+static void setSourceValues(Sources& sources, REDUCTION reduction) {
+    if (reduction == REDUCE_PRODUCT) {
+        sources.floatSource->outputs()[0].f = uniform(0.95f, 1.05f);
+        sources.intSource->outputs()[0].i = (rng() % 2) ? 1 : -1;
+        sources.uintSource->outputs()[0].u = 1;
+        return;
+    }
+    sources.floatSource->outputs()[0].f = uniform(0.f, 2.f);
+    sources.intSource->outputs()[0].i = (int32_t)(rng() % 2001) - 1000;
+    sources.uintSource->outputs()[0].u = rng() % 1000;
+}
+
+static void connectInputs(FunctionBlock* func, const Reduction& op, Sources& sources) {
+    for (uint8_t i = 1; i < func->numInputs; i += 3) {
+        if (op.type == IO_TYPE_BOOL) {
+            func->connectInput(i, sources.boolSource, 0, (i / 3) % 2);
+            continue;
+        }
+        FunctionBlock* source = nullptr;
+        switch ((i / 3) % 3) {
+            case 0: source = sources.floatSource; break;
+            case 1: source = sources.intSource; break;
+            case 2: source = sources.uintSource; break;
+        }
+        func->connectInput(i, source, 0);
+    }
+}
+
+// Boolean inputs are set for a pattern: none, one or two inputs differ from the neutral value
+static void setLogicInputs(FunctionBlock* func, const Reduction& op, Sources& sources, uint32_t pattern) {
+    const uint32_t neutral = (op.reduction == REDUCE_ALL) ? 1 : 0;
+    std::vector<uint32_t> values(func->numInputs, neutral);
+    for (uint32_t n = 0; n < pattern; n++) values[rng() % func->numInputs] = !neutral;
+    // Connected inputs all read the one source, which is set to give the value of the first of them
+    sources.boolSource->outputs()[0].u = neutral;
+    for (uint8_t i = 0; i < func->numInputs; i++) {
+        if (func->inputFlag(i) & IO_FLAG_REF) continue;
+        func->setInput(i, values[i]);
+    }
+}
+
+static IOValue scalarResult(FunctionBlock* func, const Reduction& op) {
+    IOValue result = {};
+    switch (op.reduction) {
+        case REDUCE_SUM:
+        case REDUCE_PRODUCT: {
+            result = func->inputValue(0);
+            for (uint8_t i = 1; i < func->numInputs; i++) {
+                const IOValue value = func->inputValue(i);
+                if (op.type == IO_TYPE_FLOAT) {
+                    if (op.reduction == REDUCE_SUM) result.f += value.f;
+                    else result.f *= value.f;
+                }
+                else {
+                    if (op.reduction == REDUCE_SUM) result.u += value.u;
+                    else result.u *= value.u;
+                }
+            }
+            break;
+        }
+        case REDUCE_ALL:
+            result.u = 1;
+            for (uint8_t i = 0; i < func->numInputs; i++) result.u = result.u && func->inputValue(i).u;
+            break;
+        case REDUCE_ANY:
+            result.u = 0;
+            for (uint8_t i = 0; i < func->numInputs; i++) result.u = result.u || func->inputValue(i).u;
+            break;
+        case REDUCE_ONE: {
+            uint32_t count = 0;
+            for (uint8_t i = 0; i < func->numInputs; i++) count += func->inputValue(i).u;
+            result.u = (count == 1);
+            break;
+        }
+    }
+    return result;
+}
+
+// Vector float loops reassociate, so float results are compared with a tolerance. Rounding errors of
+// sums scale with the magnitudes of the summed inputs, not with the result
+static bool sameResult(FunctionBlock* func, IOValue expected, IOValue actual, const Reduction& op) {
+    if (op.type != IO_TYPE_FLOAT || expected.u == actual.u) return expected.u == actual.u;
+    float scale = std::max(1.f, std::fabs(expected.f));
+    if (op.reduction == REDUCE_SUM) {
+        scale = 1.f;
+        for (uint8_t i = 0; i < func->numInputs; i++) scale += std::fabs(func->inputValue(i).f);
+    }
+    return std::fabs(expected.f - actual.f) <= 1e-5f * scale;
+}
+
+static void checkResult(FunctionBlock* func, const Reduction& op, const char* path, IOValue expected) {
+    const IOValue actual = func->outputs()[0];
+    if (sameResult(func, expected, actual, op)) return;
+    fprintf(stderr, "%s %s with %u inputs: expected 0x%08x (%g), got 0x%08x (%g)\n", op.name, path,
+        func->numInputs, expected.u, expected.f, actual.u, actual.f);
+    testFailures++;
+}
+
+// Execution plans run the fused kernel only for plain and inverted bindings
+static bool fusable(FunctionBlock* func) {
+    if (!func->fusedKernel) return false;
+    for (uint8_t i = 0; i < func->numInputBindings; i++) {
+        if (func->inputBindings[i].op > BIND_REF_INVERT) return false;
+    }
+    return true;
+}
+
+static void testReduction(FunctionFactory& factory, const Reduction& op, Sources& sources, uint32_t size, bool connected) {
+    FunctionBlock* func = factory.createFunction(op.lib, op.func, size);
+    CHECK(func);
+    if (!func) return;
+    if (connected) connectInputs(func, op, sources);
+
+    const uint32_t trials = (op.type == IO_TYPE_BOOL) ? 3 : 2;
+    for (uint32_t trial = 0; trial < trials; trial++) {
+        if (op.type == IO_TYPE_BOOL) setLogicInputs(func, op, sources, trial);
+        else {
+            setSourceValues(sources, op.reduction);
+            for (uint8_t i = 0; i < func->numInputs; i++) {
+                if (!(func->inputFlag(i) & IO_FLAG_REF)) func->setInput(i, randomValue(op.type, op.reduction));
+            }
+        }
+        const IOValue expected = scalarResult(func, op);
+
+        func->outputs()[0].u = ~expected.u;
+        func->update(10);
+        checkResult(func, op, connected ? "gathered" : "unbound", expected);
+
+        if (!fusable(func)) continue;
+        func->outputs()[0].u = ~expected.u;
+        func->fusedKernel(func, func->inputs(), func->outputs(), 10);
+        checkResult(func, op, "fused", expected);
+    }
+    delete func;
+}
+
+int main() {
+    FunctionFactory factory;
+    Sources sources = {
+        .floatSource    = factory.createFunction(LIB_ID_MATH, MathLib::FUNC_ID_ADD),
+        .intSource      = factory.createFunction(LIB_ID_MATH_INT, MathIntLib::FUNC_ID_ADD),
+        .uintSource     = factory.createFunction(LIB_ID_MATH_UINT, MathUintLib::FUNC_ID_ADD),
+        .boolSource     = factory.createFunction(LIB_ID_LOGIC, LogicLib::FUNC_ID_AND)
+    };
+    printf("SIMD backend %s, vector loops from %u inputs\n", SIMD_BACKEND_NAME, (uint32_t)SIMD_MIN_COUNT);
+
+    for (const Reduction& op : reductions) {
+        for (uint32_t size = 1; size <= MAX_INPUTS; size++) {
+            testReduction(factory, op, sources, size, false);
+            testReduction(factory, op, sources, size, true);
+        }
+    }
+
+    delete sources.floatSource;
+    delete sources.intSource;
+    delete sources.uintSource;
+    delete sources.boolSource;
+    return testResult("simd_reduce");
+}
@@ -9,9 +9,21 @@ import {
     MsgTaskInfo_t,
     MsgCircuitInfo_t,
     MsgFunctionInfo_t,
+    MsgMemRead_t,
+    MsgMemWrite_t,
     msgTypeNamesMaxLength,
     MsgMonitoringCollection_t,
     MsgMonitoringCollectionItem_t,
+    MsgMonitoringDelta_t,
+    MsgMonitoringDeltaItem_t,
+    MONITORING_MODE,
+    MsgTraceStart_t,
+    MsgTraceSignal_t,
+    MsgTraceData_t,
+    MsgTraceTrigger_t,
+    MsgTraceCapture_t,
+    TRACE_TRIGGER,
+    MsgLinkStatus_t,
     MsgResponseHeader_t,
 } from './C32Types.js'
 import { C32Function } from './C32Function.js'
@@ -36,6 +48,16 @@ interface PendingRequest {
 
 type RequestCallback = (result: number) => void
 
+interface TraceSignal {
+    pointer:    number
+    ioNum:      number
+}
+
+export interface TraceSample {
+    timeStamp:  number
+    values:     number[]
+}
+
 
 export class C32DataLink
 {
@@ -50,7 +72,12 @@ export class C32DataLink
         this.client.onBinaryDataReceived = this.handleMessageData
     }
 
-    readonly events = new EventEmitter<typeof this, 'controllerLoaded' | 'taskLoaded' | 'circuitLoaded' | 'functionLoaded'>(this)
+    readonly events = new EventEmitter<typeof this, 'controllerLoaded' | 'taskLoaded' | 'circuitLoaded' | 'functionLoaded' | 'traceData' | 'traceCapture' | 'linkStatus'>(this)
+
+    linkStatus: StructValues<typeof MsgLinkStatus_t>
+
+    // IO layout revision of the latest controller or function info. Memory requests with pointers of an older revision fail
+    ioRevision = 0
 
     infoLog = false
 
@@ -69,13 +96,17 @@ export class C32DataLink
     requestMemData(pointer: number, length: number, elemType: DataType, callback: (list: number[], data: ArrayBuffer) => void) {
         const size = length * sizeOfType(elemType)
         this.memDataRequests.set(this.msgID, { pointer, elemType, callback })
-        this.sendMessageWithStruct(MSG_TYPE.GET_MEM_DATA, pointer, { size: DataType.uint32 }, { size })
+        this.sendMessageWithStruct(MSG_TYPE.GET_MEM_DATA, pointer, MsgMemRead_t, { ioRevision: this.ioRevision, size })
     }
 
     //      Send a request to modify memory data on controller
 
     modifyMemData(pointer: number, dataSource: ArrayBuffer, callback?: RequestCallback) {
-        this.sendMessageWithData(MSG_TYPE.SET_MEM_DATA, pointer, dataSource, callback)
+        const paramsSize = sizeOfStruct(MsgMemWrite_t)
+        const data = new ArrayBuffer(paramsSize + dataSource.byteLength)
+        writeStruct(data, 0, MsgMemWrite_t, { ioRevision: this.ioRevision })
+        new Uint8Array(data).set(new Uint8Array(dataSource), paramsSize)
+        this.sendMessageWithData(MSG_TYPE.SET_MEM_DATA, pointer, data, callback)
     }
 
     //      Enable / Disable IO-value monitoring on function block
@@ -87,6 +118,45 @@ export class C32DataLink
         this.sendMessage(MSG_TYPE.MONITORING_DISABLE, pointer, callback)
     }
 
+    //      Report changed IO-values only with full keyframes every keyframeInterval reports
+
+    monitoringSetMode(mode: MONITORING_MODE, keyframeInterval = 10, callback?: RequestCallback) {
+        this.sendMessageWithStruct(MSG_TYPE.MONITORING_SET_MODE, this.controller?.data.pointer ?? 0, { mode: DataType.uint32, keyframeInterval: DataType.uint32 }, { mode, keyframeInterval }, callback)
+    }
+    monitoringSetDeadband(pointer: number, ioNum: number, absolute: number, percent = 0, callback?: RequestCallback) {
+        this.sendMessageWithStruct(MSG_TYPE.MONITORING_SET_DEADBAND, pointer,
+            { ioNum: DataType.uint32, absolute: DataType.float, percent: DataType.float }, { ioNum, absolute, percent }, callback)
+    }
+
+    //      Sample IO-values on every task cycle. Data is received in chunks as 'traceData' events
+
+    traceStart(taskPointer: number, signals: TraceSignal[], capacity = 1024, chunkSamples = 64, callback?: RequestCallback) {
+        const signalSize = sizeOfStruct(MsgTraceSignal_t)
+        const data = new ArrayBuffer(sizeOfStruct(MsgTraceStart_t) + signals.length * signalSize)
+        let offset = writeStruct(data, 0, MsgTraceStart_t, { capacity, chunkSamples, signalCount: signals.length })
+        signals.forEach(signal => offset = writeStruct(data, offset, MsgTraceSignal_t, signal))
+        this.traceSignals.set(taskPointer, signals)
+        this.sendMessageWithData(MSG_TYPE.TRACE_START, taskPointer, data, callback)
+    }
+    traceStop(taskPointer: number, callback?: RequestCallback) {
+        this.sendMessage(MSG_TYPE.TRACE_STOP, taskPointer, callback)
+    }
+
+    //      Capture a window of preTrigger and postTrigger cycles around the trigger as a 'traceCapture' event.
+    //      Trigger condition NONE returns to streaming
+
+    traceSetTrigger(taskPointer: number, trigger: TraceSignal, condition: TRACE_TRIGGER, threshold: number,
+                    preTrigger: number, postTrigger: number, rearm = false, callback?: RequestCallback) {
+        this.sendMessageWithStruct(MSG_TYPE.TRACE_SET_TRIGGER, taskPointer, MsgTraceTrigger_t,
+            { ...trigger, condition, threshold, preTrigger, postTrigger, rearm: +rearm }, callback)
+    }
+
+    //      Request buffer state on controller. Also received as a 'linkStatus' event when requests were dropped
+
+    requestLinkStatus(callback?: RequestCallback) {
+        this.sendMessage(MSG_TYPE.LINK_STATUS, this.controller?.data.pointer ?? 0, callback)
+    }
+
     //      Modify task on controller
 
     taskStart(pointer: number, callback?: RequestCallback) {
@@ -107,6 +177,7 @@ export class C32DataLink
     protected msgID = 1
 
     protected memDataRequests  = new Map<number, MemDataRequest>()
+    protected traceSignals     = new Map<number, TraceSignal[]>()
     protected requestCallbacks = new Map<number, PendingRequest>()
     
     //      Create a message buffer with given payload size
@@ -178,7 +249,14 @@ export class C32DataLink
             {
                 this.log.line('MEMORY DATA:')
                 const req = this.memDataRequests.get(msgID)
-                if (req) {
+                if (req && !result) {
+                    // Pointer is stale. Info of the function owning it brings the moved pointers and current revision
+                    this.memDataRequests.delete(msgID)
+                    const func = [...this.functionBlocks.values()].find(func => func.data.ioValueList == req.pointer || func.data.ioFlagList == req.pointer)
+                    if (func) func.requestData()
+                    else this.requestInfo(MSG_TYPE.CONTROLLER_INFO, 0)
+                }
+                else if (req) {
                     const array = typedArray(payload, req.elemType)
                     const values = [...array]
                     this.log.list(values)
@@ -208,6 +286,42 @@ export class C32DataLink
                 })
                 break
             }
+            case MSG_TYPE.MONITORING_DELTA_REPORT:
+            {
+                let offset = 0
+                const { itemCount } = readStruct(payload, offset, MsgMonitoringDelta_t)
+                offset += sizeOfStruct(MsgMonitoringDelta_t)
+                for (let i = 0; i < itemCount; i++) {
+                    const item = readStruct(payload, offset, MsgMonitoringDeltaItem_t)
+                    offset += sizeOfStruct(MsgMonitoringDeltaItem_t)
+                    const bitmapOffset = offset
+                    offset += Math.ceil(item.ioCount / 32) * DataSize.uint32
+                    this.handleMonitoringDelta(item.pointer, item.ioCount, payload, bitmapOffset, offset)
+                    offset += item.valueCount * DataSize.uint32
+                }
+                break
+            }
+            case MSG_TYPE.TRACE_DATA:
+            {
+                const info = readStruct(payload, 0, MsgTraceData_t)
+                const samples = this.readTraceSamples(info, payload, sizeOfStruct(MsgTraceData_t))
+                this.events.emit('traceData', { info, samples })
+                break
+            }
+            case MSG_TYPE.LINK_STATUS:
+            {
+                this.linkStatus = readStruct(payload, 0, MsgLinkStatus_t)
+                if (this.linkStatus.droppedRequests > 0) this.log.line(`Controller dropped ${this.linkStatus.droppedRequests} requests`)
+                this.events.emit('linkStatus', this.linkStatus)
+                break
+            }
+            case MSG_TYPE.TRACE_CAPTURE:
+            {
+                const info = readStruct(payload, 0, MsgTraceCapture_t)
+                const samples = this.readTraceSamples(info, payload, sizeOfStruct(MsgTraceCapture_t))
+                this.events.emit('traceCapture', { info, samples })
+                break
+            }
             default:
             {
                 this.log.line('Error: Unknown message type')
@@ -230,6 +344,7 @@ export class C32DataLink
 
     protected handleControllerData(payload: ArrayBuffer) {
         const data = readStruct(payload, 0, MsgControllerInfo_t)
+        this.ioRevision = data.ioRevision
         if (this.controller)
             this.controller.updateData(data)
         else {
@@ -268,6 +383,7 @@ export class C32DataLink
 
     protected handleFunctionData(payload: ArrayBuffer) {
         const data = readStruct(payload, 0, MsgFunctionInfo_t)
+        this.ioRevision = data.ioRevision
         if (this.functionBlocks.has(data.pointer))
             this.functionBlocks.get(data.pointer).updateData(data)
         else {
@@ -287,4 +403,38 @@ export class C32DataLink
         func.setMonitoringValues(values)
     }
 
+    // Apply changed values marked in the bitmap to the previous monitoring values
+    protected handleMonitoringDelta(pointer: number, ioCount: number, data: ArrayBuffer, bitmapOffset: number, offset: number) {
+        const func = this.functionBlocks.get(pointer)
+        if (!func) return
+        const view = new DataView(data)
+        const values = func.monitoringValues?.slice() ?? new Array(ioCount).fill(0)
+        for (let i = 0; i < ioCount; i++) {
+            const word = view.getUint32(bitmapOffset + Math.floor(i / 32) * DataSize.uint32, true)
+            if (!(word & (1 << (i % 32)))) continue
+            const dataType = IO_TYPE_MAP[ func.ioFlags[i] & IO_FLAG_TYPE_MASK ]
+            values[i] = readTypedValues(data, [dataType], offset)[0]
+            offset += DataSize.uint32
+        }
+        func.setMonitoringValues(values)
+    }
+
+    // Decode samples by the types of the traced IO-values. Untyped values are read as floats
+    protected readTraceSamples(info: { pointer: number, sampleCount: number, signalCount: number }, data: ArrayBuffer, offset: number) {
+        const signals = this.traceSignals.get(info.pointer) ?? []
+        const dataTypes = Array.from({ length: info.signalCount }, (_, i) => {
+            const signal = signals[i]
+            const func = signal && this.functionBlocks.get(signal.pointer)
+            return func?.ioFlags ? IO_TYPE_MAP[ func.ioFlags[signal.ioNum] & IO_FLAG_TYPE_MASK ] : DataType.float
+        })
+        const samples: TraceSample[] = []
+        for (let n = 0; n < info.sampleCount; n++) {
+            const timeStamp = new DataView(data).getUint32(offset, true)
+            const values = readTypedValues(data, dataTypes, offset + DataSize.uint32)
+            samples.push({ timeStamp, values })
+            offset += (1 + info.signalCount) * DataSize.uint32
+        }
+        return samples
+    }
+
 }
\ No newline at end of file
@@ -47,7 +47,8 @@ export class C32Function implements IFunctionBlockOnlineData
     requestData() { this.link.requestInfo(MSG_TYPE.FUNCTION_INFO, this.data.pointer) }
 
     updateData(data: StructValues<typeof MsgFunctionInfo_t>) {
-        const ioModified = ( data.ioValueList != this._data.ioValueList || data.ioFlagList != this._data.ioFlagList || data.numInputs+data.numOutputs != this._data.numInputs+this._data.numOutputs)
+        const ioModified = ( data.ioValueList != this._data.ioValueList || data.ioFlagList != this._data.ioFlagList || data.numInputs+data.numOutputs != this._data.numInputs+this._data.numOutputs
+                             || data.ioRevision != this._data.ioRevision )
 
         this._data = data
         this.events.emit('dataUpdated')
@@ -40,6 +40,25 @@ export const enum MSG_TYPE {
     FUNCTION_SET_FLAGS,
     FUNCTION_SET_FLAG,
     FUNCTION_CLEAR_FLAG,
+
+    TASK_SET_EVALUATION_MODE,
+    CIRCUIT_SORT_FUNCTIONS,
+    TASK_SET_WORKER,
+    FUNCTION_PROFILE,
+    TASK_SET_PROFILING,
+    TASK_TIMING_STATS,
+    TASK_SET_PRIORITY,
+    TASK_SET_OVERRUN_POLICY,
+    CONTROLLER_SET_OFFSET_BALANCING,
+    MONITORING_SET_MODE,
+    MONITORING_SET_DEADBAND,
+    MONITORING_DELTA_REPORT,
+    TRACE_START,
+    TRACE_STOP,
+    TRACE_DATA,
+    TRACE_SET_TRIGGER,
+    TRACE_CAPTURE,
+    LINK_STATUS,
 }
 
 export const msgTypeNames = [
@@ -84,4 +103,23 @@ export const msgTypeNames = [
     'FUNCTION_SET_FLAGS',
     'FUNCTION_SET_FLAG',
     'FUNCTION_CLEAR_FLAG',
+
+    'TASK_SET_EVALUATION_MODE',
+    'CIRCUIT_SORT_FUNCTIONS',
+    'TASK_SET_WORKER',
+    'FUNCTION_PROFILE',
+    'TASK_SET_PROFILING',
+    'TASK_TIMING_STATS',
+    'TASK_SET_PRIORITY',
+    'TASK_SET_OVERRUN_POLICY',
+    'CONTROLLER_SET_OFFSET_BALANCING',
+    'MONITORING_SET_MODE',
+    'MONITORING_SET_DEADBAND',
+    'MONITORING_DELTA_REPORT',
+    'TRACE_START',
+    'TRACE_STOP',
+    'TRACE_DATA',
+    'TRACE_SET_TRIGGER',
+    'TRACE_CAPTURE',
+    'LINK_STATUS',
 ]
\ No newline at end of file
@@ -14,7 +14,7 @@ export const enum IO_FLAG {
     TYPE_B0             = (1 << 0),
     TYPE_B1             = (1 << 1),
     TYPE_B2             = (1 << 2),
-    BIT3                = (1 << 3),
+    FEEDBACK            = (1 << 3),
     REF                 = (1 << 4),
     REF_INVERT          = (1 << 5),
     REF_CONV_TYPE_B0    = (1 << 6),
@@ -89,6 +89,16 @@ export const MsgControllerInfo_t = {
     taskList:           DataType.uint32,
     funcCount:          DataType.uint32,
     funcList:           DataType.uint32,
+    maxAllocHeap:       DataType.uint32,
+    ioArenaSize:        DataType.uint32,
+    compactFreeHeapBefore: DataType.uint32,
+    compactMaxAllocBefore: DataType.uint32,
+    compactFreeHeapAfter:  DataType.uint32,
+    compactMaxAllocAfter:  DataType.uint32,
+    blockPoolSlabs:     DataType.uint32,
+    blockPoolSlots:     DataType.uint32,
+    workerCount:        DataType.uint32,
+    ioRevision:         DataType.uint32,
 }
 
 export const MsgTaskInfo_t = {
@@ -103,6 +113,11 @@ export const MsgTaskInfo_t = {
     driftTime:          DataType.uint32,
     funcCount:          DataType.uint32,
     funcList:           DataType.uint32,
+    evaluationMode:     DataType.uint32,
+    planSize:           DataType.uint32,
+    evaluatedCount:     DataType.uint32,
+    worker:             DataType.uint32,
+    priority:           DataType.uint32,
 }
 
 export const MsgCircuitInfo_t = {
@@ -111,6 +126,9 @@ export const MsgCircuitInfo_t = {
     funcList:           DataType.uint32,
     outputRefCount:     DataType.uint32,
     outputRefList:      DataType.uint32,
+    autoOrder:          DataType.uint32,
+    feedbackCount:      DataType.uint32,
+    latencyCycles:      DataType.uint32,
 }
 
 export const MsgFunctionInfo_t = {
@@ -123,6 +141,47 @@ export const MsgFunctionInfo_t = {
     ioFlagList:         DataType.uint32,
     nameLength:         DataType.uint32,
     namePtr:            DataType.uint32,
+    ioRevision:         DataType.uint32,
+}
+
+// Memory requests carry the IO layout revision of the info the pointer was read from
+
+export const MsgMemRead_t = {
+    ioRevision:         DataType.uint32,
+    size:               DataType.uint32,
+}
+
+// Followed by the data to write
+
+export const MsgMemWrite_t = {
+    ioRevision:         DataType.uint32,
+}
+
+export const MsgFunctionProfile_t = {
+    pointer:            DataType.uint32,
+    calls:              DataType.uint32,
+    lastCycles:         DataType.uint32,
+    minCycles:          DataType.uint32,
+    maxCycles:          DataType.uint32,
+    avgCycles:          DataType.float,
+    cpuFreq:            DataType.uint32,
+}
+
+export const MsgTaskTimingStats_t = {
+    pointer:            DataType.uint32,
+    runCount:           DataType.uint32,
+    deadlineMisses:     DataType.uint32,
+    skippedCycles:      DataType.uint32,
+    consecutiveOverruns: DataType.uint32,
+    maxConsecutiveOverruns: DataType.uint32,
+    worstOverrun:       DataType.uint32,
+    overrunPolicy:      DataType.uint32,
+    degraded:           DataType.uint32,
+    bucketCount:        DataType.uint32,
+    subBucketBits:      DataType.uint32,
+    intervalJitterMax:  DataType.uint32,
+    startDriftMax:      DataType.uint32,
+    cpuTimeMax:         DataType.uint32,
 }
 
 export const MsgMonitoringCollection_t = {
@@ -135,6 +194,77 @@ export const MsgMonitoringCollectionItem_t = {
     size:               DataType.uint16,
 }
 
+export const enum MONITORING_MODE {
+    FULL,
+    DELTA
+}
+
+export const MsgMonitoringDelta_t = {
+    itemCount:          DataType.uint32,
+    keyframe:           DataType.uint32,
+}
+
+export const MsgMonitoringDeltaItem_t = {
+    pointer:            DataType.uint32,
+    ioCount:            DataType.uint16,
+    valueCount:         DataType.uint16,
+}
+
+export const MsgLinkStatus_t = {
+    ingressCapacity:    DataType.uint32,
+    ingressFree:        DataType.uint32,
+    receivedRequests:   DataType.uint32,
+    droppedRequests:    DataType.uint32,
+}
+
+export const MsgTraceStart_t = {
+    capacity:           DataType.uint32,
+    chunkSamples:       DataType.uint32,
+    signalCount:        DataType.uint32,
+}
+
+export const MsgTraceSignal_t = {
+    pointer:            DataType.uint32,
+    ioNum:              DataType.uint32,
+}
+
+export const enum TRACE_TRIGGER {
+    NONE,
+    RISING,
+    FALLING,
+    CROSSING,
+    TRUE
+}
+
+export const MsgTraceTrigger_t = {
+    pointer:            DataType.uint32,
+    ioNum:              DataType.uint32,
+    condition:          DataType.uint32,
+    threshold:          DataType.float,
+    preTrigger:         DataType.uint32,
+    postTrigger:        DataType.uint32,
+    rearm:              DataType.uint32,
+}
+
+export const MsgTraceCapture_t = {
+    pointer:            DataType.uint32,
+    sampleCount:        DataType.uint32,
+    signalCount:        DataType.uint32,
+    triggerIndex:       DataType.uint32,
+    triggerCount:       DataType.uint32,
+    maxCaptureCycles:   DataType.uint32,
+    cpuFreq:            DataType.uint32,
+}
+
+export const MsgTraceData_t = {
+    pointer:            DataType.uint32,
+    sampleCount:        DataType.uint32,
+    signalCount:        DataType.uint32,
+    droppedSamples:     DataType.uint32,
+    lastCaptureCycles:  DataType.uint32,
+    maxCaptureCycles:   DataType.uint32,
+    cpuFreq:            DataType.uint32,
+}
 
 // Address area Low is inclusive, High is exclusive
 const memoryAreas =